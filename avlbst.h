@@ -3,13 +3,31 @@
 
 #include <iostream>
 #include <exception>
+#include <stdexcept>
+#include <iterator>
 #include <cstdlib>
 #include <cstdint>
+#include <string>
 #include <algorithm>
+#include <future>
+#include <thread>
 #include "bst.h"
+#include "frozen.h"
 
 struct KeyError { };
 
+/**
+* One entry of a batch for AVLTree::apply_sorted_batch(): sets item.first to
+* item.second, inserting it if absent, or if erase is set removes item.first
+* (item.second is then ignored).
+*/
+template <typename Key, typename Value>
+struct BatchOp
+{
+    std::pair<Key, Value> item;
+    bool erase;
+};
+
 /**
 * A special kind of node for an AVL tree, which adds the balance as a data member, plus
 * other additional helper functions. You do NOT need to implement any functionality or
@@ -21,19 +39,27 @@ class AVLNode : public Node<Key, Value>
 public:
     // Constructor/destructor.
     AVLNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
-    virtual ~AVLNode();
+    AVLNode(const ItemBuilder<Key, Value>& builder, AVLNode<Key, Value>* parent);
+    ~AVLNode();
 
     // Getter/setter for the node's height.
     int8_t getBalance () const;
     void setBalance (int8_t balance);
     void updateBalance(int8_t diff);
 
-    // Getters for parent, left, and right. These need to be redefined since they
-    // return pointers to AVLNodes - not plain Nodes. See the Node class in bst.h
-    // for more information.
-    virtual AVLNode<Key, Value>* getParent() const override;
-    virtual AVLNode<Key, Value>* getLeft() const override;
-    virtual AVLNode<Key, Value>* getRight() const override;
+    // Getters for parent, left, and right. These hide (not override) the Node
+    // getters so they return pointers to AVLNodes - not plain Nodes - without a
+    // virtual call. See the Node class in bst.h for more information.
+    AVLNode<Key, Value>* getParent() const;
+    AVLNode<Key, Value>* getLeft() const;
+    AVLNode<Key, Value>* getRight() const;
+
+    // Augmentation hooks. AVLTree calls these through its NodeType, so a node
+    // that derives from AVLNode and hides them can keep per-subtree data
+    // current (see OSAVLNode in osavlbst.h). Here they do nothing and inline away.
+    void pullUp();
+    void swapAugmentation(AVLNode<Key, Value>* other);
+    static void adjustAncestors(AVLNode<Key, Value>* from, int delta);
 
 protected:
     int8_t balance_;    // effectively a signed char
@@ -55,6 +81,16 @@ AVLNode<Key, Value>::AVLNode(const Key& key, const Value& value, AVLNode<Key, Va
 
 }
 
+/**
+* Constructs the item in place, see ItemBuilder in bst.h.
+*/
+template<class Key, class Value>
+AVLNode<Key, Value>::AVLNode(const ItemBuilder<Key, Value>& builder, AVLNode<Key, Value> *parent) :
+    Node<Key, Value>(builder, parent), balance_(0)
+{
+
+}
+
 /**
 * A destructor which does nothing.
 */
@@ -92,8 +128,8 @@ void AVLNode<Key, Value>::updateBalance(int8_t diff)
 }
 
 /**
-* An overridden function for getting the parent since a static_cast is necessary to make sure
-* that our node is a AVLNode.
+* A getter for the parent. The static_cast is safe since an AVLTree only ever
+* links AVLNodes together, and it compiles to nothing.
 */
 template<class Key, class Value>
 AVLNode<Key, Value> *AVLNode<Key, Value>::getParent() const
@@ -120,213 +156,146 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getRight() const
 }
 
 
-/*
-  -----------------------------------------------
-  End implementations for the AVLNode class.
-  -----------------------------------------------
+/**
+* Recomputes this node's augmentation from its children after they change
+* (rotations, bulk load). Nothing to do for a plain AVLNode.
 */
+template<class Key, class Value>
+void AVLNode<Key, Value>::pullUp()
+{
 
+}
 
-template <class Key, class Value>
-class AVLTree : public BinarySearchTree<Key, Value>
+/**
+* Exchanges augmentation with another node during nodeSwap, since it
+* describes the position rather than the item. Nothing to do here.
+*/
+template<class Key, class Value>
+void AVLNode<Key, Value>::swapAugmentation(AVLNode<Key, Value>*)
 {
-public:
-    virtual void insert (const std::pair<const Key, Value> &new_item); // TODO
-    virtual void remove(const Key& key);  // TODO
-protected:
-    virtual void nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2);
 
-    // Add helper functions here
-    void insertHelper(AVLNode<Key, Value>* parent, AVLNode<Key, Value>* curr); 
-	void removeHelper(AVLNode<Key, Value>* curr, int diff); 
-	void rotateRight(AVLNode<Key, Value>* child); 
-	void rotateLeft(AVLNode<Key, Value>* child); 
-
-};
+}
 
-/*
- * Recall: If key is already in the tree, you should 
- * overwrite the current value with the updated value.
- */
+/**
+* Accounts for delta nodes linked (or unlinked, if negative) below from,
+* on from and all of its ancestors. Nothing to do here.
+*/
 template<class Key, class Value>
-void AVLTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item) {
+void AVLNode<Key, Value>::adjustAncestors(AVLNode<Key, Value>*, int)
+{
 
-    AVLNode<Key, Value>* parent = nullptr;
-    AVLNode<Key, Value>* child = nullptr;
-    AVLNode<Key, Value>* temp = static_cast<AVLNode<Key, Value>*>(this->root_);
+}
 
-    // If root empty, create new node as root
-    if (!this->root_) {
-        this->root_ = new AVLNode<Key, Value>(new_item.first, new_item.second, parent);
-        this->root_->setLeft(nullptr);
-        this->root_->setRight(nullptr);
-        return;
-    }
+/*
+  -----------------------------------------------
+  End implementations for the AVLNode class.
+  -----------------------------------------------
+*/
 
-    // Finding appropriate position to insert node
-    else {
-        while (true) {
 
-            // Update value if key already exists
-            if (temp->getKey() == new_item.first) {
-                temp->setValue(new_item.second);
-                break;
-            } 
-            
-            // If key larger go right
-            else if (temp->getKey() > new_item.first) {
-                if (!temp->getLeft()) {
-                    parent = temp;
-                    child = new AVLNode<Key, Value>(new_item.first, new_item.second, parent);
-                    temp->setLeft(child);
-                    parent->updateBalance(-1);
-
-                    // Balance if neccessary
-                    if (parent->getBalance() != 0) {
-                        insertHelper(parent, child);
-                    }
-                    break;
-                }
-                temp = temp->getLeft();
-            } 
+/*
+  ---------------------------------------------------------------
+  Begin implementations for the AVL rebalancing routines.
+
+  AVLTree and IntrusiveAVLTree share these. NodeType needs the
+  getParent/getLeft/getRight and setParent/setLeft/setRight links,
+  getBalance/setBalance/updateBalance, and pullUp(); root is the
+  tree's root pointer, which the rotations update.
+  ---------------------------------------------------------------
+*/
 
-            // If key is smaller go left
-            else if (temp->getKey() < new_item.first) {
-                if (!temp->getRight()) {
-                    parent = temp;
-                    child = new AVLNode<Key, Value>(new_item.first, new_item.second, parent);
-                    temp->setRight(child);
-                    parent->updateBalance(1);
-
-                    // Balance if neccessary
-                    if (parent->getBalance() != 0) {
-                        insertHelper(parent, child);
-                    }
-                    break;
-                }
+/**
+* Rotates node's left child up into node's place, updating root if node
+* was it. Balances are left to the caller.
+*/
+template<class NodeType, class RootPtr>
+void avlRotateRight(RootPtr& root, NodeType* node) {
+    NodeType* parent = node->getLeft();
+    NodeType* child = parent->getRight();
 
-                // Move to right child
-                temp = temp->getRight();
+    // Adjust parent pointers; a detached subtree's root is not root
+    if (!node->getParent()) {
+        parent->setParent(nullptr);
+        if (root == node) {
+            root = parent;
+        }
+    } 
+    else {
+        parent->setParent(node->getParent());
+        if (node->getParent()) {
+            if (node->getParent()->getLeft() == node) {
+                node->getParent()->setLeft(parent);
+            } 
+            else {
+                node->getParent()->setRight(parent);
             }
         }
     }
-}
-
-/*
- * Recall: The writeup specifies that if a node has 2 children you
- * should swap with the predecessor and then remove.
- */
-template<class Key, class Value>
-void AVLTree<Key, Value>::remove(const Key& key) {
-    if (!this->root_){
-        return;
-    }
 
-    int difference;
-    AVLNode<Key, Value>* parent;
-    AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(BinarySearchTree<Key, Value>::internalFind(key));
-
-    // Get parent of node if it exists
-    if (node){
-        parent = node->getParent();
-    }
-    else{
-        return;
-    }
+    // Update child pointers
+    node->setLeft(child ? (child->setParent(node), child) : nullptr);
 
-    // Swap node with predecessor if it has two children
-    if (node->getLeft() && node->getRight()) {
-        nodeSwap(static_cast<AVLNode<Key, Value>*>(BinarySearchTree<Key, Value>::predecessor(node)), node);
-        parent = node->getParent();
-    }
+    parent->setRight(node);
+    node->setParent(parent);
 
-    // Calculate difference ni heights between parent and node
-    if (parent) {
-        difference = (parent->getLeft() != node) ? -1 : 1;
-    }
+    // node is now below parent, so refresh it first
+    node->pullUp();
+    parent->pullUp();
+}
 
-    // Case 1: Node has no children
-    if (!node->getLeft() && !node->getRight()) {
-        if (this->root_ == node) {
-            delete node;
-            node = nullptr;
-            this->root_ = nullptr;
-            return;
-        } 
-        else {
-            // Update if needed removal to null
-            if (node == parent->getLeft()){
-                parent->setLeft(nullptr);
-            }
-            else{
-                parent->setRight(nullptr);
-            }
-            delete node;
-            node = nullptr;
-        }
-    } 
+/**
+* The mirror image of avlRotateRight().
+*/
+template<class NodeType, class RootPtr>
+void avlRotateLeft(RootPtr& root, NodeType* node) {
+    NodeType* parent = node->getRight();
+    NodeType* child = parent->getLeft();
 
-    // Case 2: Node has only right children
-    else if (!node->getLeft() && node->getRight()) {
-        if (this->root_ == node) {
-            this->root_ = node->getRight();
-            this->root_->setParent(nullptr);
-        }
-        if (node && parent) {
-            // Set parent's left child to node's right
-            if (parent->getLeft() == node){
-                parent->setLeft(node->getRight());
-            }
-            // Set parent's right child to node's right
-            else{
-                parent->setRight(node->getRight());
-            }
-            node->getRight()->setParent(parent);
+    // Adjust parent pointers; a detached subtree's root is not root
+    if (!node->getParent()) {
+        parent->setParent(nullptr);
+        if (root == node) {
+            root = parent;
         }
-        delete node;
-        node = nullptr;
     } 
-
-    // Case 3: Node has only left children
-    else if (node->getLeft() && !node->getRight()) {
-        if (this->root_ == node) {
-            this->root_ = this->root_->getLeft();
-            this->root_->setParent(nullptr);
-        }
-        if (node && parent) {
-            // Set parent's left child to node's left
-            if (parent->getLeft() == node){
-                parent->setLeft(node->getLeft());
-            }
-            // Set parent's right child to node's left
-            else{
-                parent->setRight(node->getLeft());
+    else {
+        parent->setParent(node->getParent());
+        if (node->getParent()) {
+            if (node->getParent()->getLeft() == node) {
+                node->getParent()->setLeft(parent);
+            } 
+            else {
+                if (node->getParent()->getRight() == node) {
+                    node->getParent()->setRight(parent);
+                }
             }
-            node->getLeft()->setParent(parent);
         }
-        delete node;
-        node = nullptr;
     }
-    removeHelper(parent, difference);
-}
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::nodeSwap(AVLNode<Key, Value>* n1, AVLNode<Key, Value>* n2) {
-    BinarySearchTree<Key, Value>::nodeSwap(n1, n2);
-    int8_t tempB = n1->getBalance();
-    n1->setBalance(n2->getBalance());
-    n2->setBalance(tempB);
+    // Update child pointers
+    node->setRight(child ? (child->setParent(node), child) : nullptr);
+
+    parent->setLeft(node);
+    node->setParent(parent);
+
+    // node is now below parent, so refresh it first
+    node->pullUp();
+    parent->pullUp();
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::insertHelper(AVLNode<Key, Value>* parent, AVLNode<Key, Value>* node) {
+/**
+* Retraces after node was linked below parent and parent's balance updated
+* for it, rotating where a subtree has become two levels taller on one side.
+*/
+template<class NodeType, class RootPtr>
+void avlInsertRetrace(RootPtr& root, NodeType* parent, NodeType* node) {
     
     // Check if parent or grand parent is null
     if (!parent || !parent->getParent()) {
         return;
     }
 
-    AVLNode<Key, Value>* grandparent = parent->getParent();
+    NodeType* grandparent = parent->getParent();
 
     // Check if parent is left child of grandparent
     if (grandparent->getLeft() && grandparent->getLeft() == parent) {
@@ -334,22 +303,22 @@ void AVLTree<Key, Value>::insertHelper(AVLNode<Key, Value>* parent, AVLNode<Key,
 
         // Check if grandparent's balance is -1
         if (grandparent->getBalance() == -1) {
-            insertHelper(grandparent, parent);
+            avlInsertRetrace(root, grandparent, parent);
         } 
 
         // Check if grandparent's balance is -2
         else if (grandparent->getBalance() == -2) {
             // Check if new node inserted in left subtree
             if (grandparent->getLeft()->getLeft() == node) {
-                rotateRight(grandparent);
+                avlRotateRight(root, grandparent);
                 parent->setBalance(0);
                 grandparent->setBalance(0);
             } 
             // Otherwise insert into right subtree
             else {
                 // Update balance factors based on rotations
-                rotateLeft(parent);
-                rotateRight(grandparent);
+                avlRotateLeft(root, parent);
+                avlRotateRight(root, grandparent);
                 if (node->getBalance() == -1) {
                     parent->setBalance(0);
                     grandparent->setBalance(1);
@@ -372,21 +341,21 @@ void AVLTree<Key, Value>::insertHelper(AVLNode<Key, Value>* parent, AVLNode<Key,
 
         // Check if balance factor is 1
         if (grandparent->getBalance() == 1) {
-            insertHelper(grandparent, parent);
+            avlInsertRetrace(root, grandparent, parent);
         } 
         // Check if balance factor is 2
         else if (grandparent->getBalance() == 2) {
             // Check if node inserted into right subtree
             if (grandparent->getRight()->getRight() == node) {
-                rotateLeft(grandparent);
+                avlRotateLeft(root, grandparent);
                 parent->setBalance(0);
                 grandparent->setBalance(0);
             } 
             // Otherwise, insert into left subtree
             else {
                 // Update balance factors as needed
-                rotateRight(parent);
-                rotateLeft(grandparent);
+                avlRotateRight(root, parent);
+                avlRotateLeft(root, grandparent);
                 if (node->getBalance() == 1) {
                     parent->setBalance(0);
                     grandparent->setBalance(-1);
@@ -405,19 +374,23 @@ void AVLTree<Key, Value>::insertHelper(AVLNode<Key, Value>* parent, AVLNode<Key,
     }
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::removeHelper(AVLNode<Key, Value>* node, int diff) {
+/**
+* Retraces after the subtree on one side of node got a level shorter: diff
+* is 1 if it was the left side and -1 if it was the right.
+*/
+template<class NodeType, class RootPtr>
+void avlRemoveRetrace(RootPtr& root, NodeType* node, int diff) {
     // Check if the node is null
     if (node == nullptr) {
         return;
     }
 
-    AVLNode<Key, Value>* parent = nullptr;
-    AVLNode<Key, Value>* child = nullptr;
+    NodeType* parent = nullptr;
+    NodeType* child = nullptr;
     int difference = 0;
     parent = node->getParent();
     if (parent) {
-        difference = (node->getKey() == parent->getLeft()->getKey()) ? 1 : -1;
+        difference = (parent->getLeft() == node) ? 1 : -1;
     }
 
     // Check for left rotation balancing
@@ -428,15 +401,15 @@ void AVLTree<Key, Value>::removeHelper(AVLNode<Key, Value>* node, int diff) {
 
             // Single right rotation if the left child's balance is -1
             if (child->getBalance() == -1) {
-                rotateRight(node);
+                avlRotateRight(root, node);
                 child->setBalance(0);
                 node->setBalance(0);
-                removeHelper(parent, difference);
+                avlRemoveRetrace(root, parent, difference);
             } 
 
             // Left-right rotation if the left child's balance is 0
             else if (child->getBalance() == 0) {
-                rotateRight(node);
+                avlRotateRight(root, node);
                 child->setBalance(1);
                 node->setBalance(-1);
                 return;
@@ -444,9 +417,9 @@ void AVLTree<Key, Value>::removeHelper(AVLNode<Key, Value>* node, int diff) {
 
             // Left-right rotation followed and single right rotation if the left child's balance is 1
             else if (child->getBalance() == 1) {
-                AVLNode<Key, Value>* rightChild = child->getRight();
-                rotateLeft(child);
-                rotateRight(node);
+                NodeType* rightChild = child->getRight();
+                avlRotateLeft(root, child);
+                avlRotateRight(root, node);
                 if (rightChild) {
 
                     // Adjust balance factors after rotations
@@ -466,7 +439,7 @@ void AVLTree<Key, Value>::removeHelper(AVLNode<Key, Value>* node, int diff) {
                         child->setBalance(0);
                     }
                 }
-                removeHelper(parent, difference);
+                avlRemoveRetrace(root, parent, difference);
             }
         } 
         // Update balance as needed
@@ -477,37 +450,37 @@ void AVLTree<Key, Value>::removeHelper(AVLNode<Key, Value>* node, int diff) {
         // Update balance as needed
         else if (diff + node->getBalance() == 0) {
             node->setBalance(0);
-            removeHelper(parent, difference);
+            avlRemoveRetrace(root, parent, difference);
         }
     } 
     // Check for right rotation balancing
     else if (diff == 1) {
         if (node->getBalance() + diff == 2) {
-            AVLNode<Key, Value>* rightChild = node->getRight();
+            NodeType* rightChild = node->getRight();
 
             // Case where the node's right subtree is unbalanced.
             if (rightChild) {
 
                 // Single left rotation if the right child's balance is 1
                 if (rightChild->getBalance() == 1) {
-                    rotateLeft(node);
+                    avlRotateLeft(root, node);
                     rightChild->setBalance(0);
                     node->setBalance(0);
-                    removeHelper(parent, difference);
+                    avlRemoveRetrace(root, parent, difference);
                 } 
 
                 // Right-left rotation if the right child's balance is 0
                 else if (rightChild->getBalance() == 0) {
-                    rotateLeft(node);
+                    avlRotateLeft(root, node);
                     rightChild->setBalance(-1);
                     node->setBalance(1);
                     return;
                 } 
                 // Right-left rotation and single left rotation if the right child's balance is -1
                 else if (rightChild->getBalance() == -1) {
-                    AVLNode<Key, Value>* leftGrandchild = rightChild->getLeft();
-                    rotateRight(rightChild);
-                    rotateLeft(node);
+                    NodeType* leftGrandchild = rightChild->getLeft();
+                    avlRotateRight(root, rightChild);
+                    avlRotateLeft(root, node);
                     if (leftGrandchild->getBalance() == -1) {
                         leftGrandchild->setBalance(0);
                         node->setBalance(0);
@@ -523,7 +496,7 @@ void AVLTree<Key, Value>::removeHelper(AVLNode<Key, Value>* node, int diff) {
                         node->setBalance(-1);
                         rightChild->setBalance(0);
                     }
-                    removeHelper(parent, difference);
+                    avlRemoveRetrace(root, parent, difference);
                 }
             }
         } 
@@ -535,69 +508,1282 @@ void AVLTree<Key, Value>::removeHelper(AVLNode<Key, Value>* node, int diff) {
         // Update balance as needed
         else if (node->getBalance() + diff == 0) {
             node->setBalance(0);
-            removeHelper(parent, difference);
+            avlRemoveRetrace(root, parent, difference);
         }
     }
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::rotateRight(AVLNode<Key, Value>* node) {
-    AVLNode<Key, Value>* parent = node->getLeft();
-    AVLNode<Key, Value>* child = parent->getRight();
+/*
+  ---------------------------------------------------------------
+  End implementations for the AVL rebalancing routines.
+  ---------------------------------------------------------------
+*/
 
-    // Adjust parent pointers
-    if (!node->getParent()) {
-        parent->setParent(nullptr);
-        this->root_ = parent;
-    } 
-    else {
-        parent->setParent(node->getParent());
-        if (node->getParent()) {
-            if (node->getParent()->getLeft() == node) {
-                node->getParent()->setLeft(parent);
-            } 
-            else {
-                node->getParent()->setRight(parent);
-            }
+
+template <class Key, class Value,
+          class Compare = std::less<Key>,
+          class Alloc = std::allocator<std::pair<const Key, Value> >,
+          class NodeType = AVLNode<Key, Value> >
+class AVLTree : public BinarySearchTree<Key, Value, Compare, Alloc>
+{
+public:
+    explicit AVLTree(const Compare& comp = Compare(), const Alloc& alloc = Alloc());
+    template<class ForwardIt>
+    AVLTree(ForwardIt first, ForwardIt last,
+            const Compare& comp = Compare(), const Alloc& alloc = Alloc());
+    virtual ~AVLTree();
+    template<class ForwardIt>
+    void assign(ForwardIt first, ForwardIt last);
+    virtual void remove(const Key& key);  // TODO
+    bool validate() const;
+    FrozenMap<Key, Value, Compare> freeze() const;
+    void save(const std::string& path, bool durable = false) const;
+    static FrozenMap<Key, Value, Compare> load_mapped(const std::string& path, const Compare& comp = Compare());
+
+    // Join-based bulk operations. split and join move nodes between trees,
+    // so the trees' allocators must compare equal (for SlabAllocator: the
+    // trees were built from the same allocator, see slab_alloc.h).
+    void split(const Key& key, AVLTree& right);
+    void join(AVLTree& left, const std::pair<const Key, Value>& middle, AVLTree& right);
+    void join(AVLTree& left, AVLTree& right);
+    void union_with(const AVLTree& other);
+    void intersect_with(const AVLTree& other);
+    void difference_with(const AVLTree& other);
+
+    void apply_sorted_batch(const std::vector<BatchOp<Key, Value> >& ops);
+protected:
+    virtual void nodeSwap( NodeType* n1, NodeType* n2);
+    typedef typename std::allocator_traits<Alloc>::template rebind_alloc<NodeType> AVLNodeAllocator;
+    NodeType* createNode(const Key& key, const Value& value, NodeType* parent);
+    virtual Node<Key, Value>* createNode(const ItemBuilder<Key, Value>& builder, Node<Key, Value>* parent);
+    virtual void linkNode(Node<Key, Value>* parent, bool isLeft, Node<Key, Value>* node);
+    virtual void destroyNode(Node<Key, Value>* node);
+    virtual void releaseNodes();
+
+    // Add helper functions here
+    void insertHelper(NodeType* parent, NodeType* curr); 
+	void removeHelper(NodeType* curr, int diff); 
+	void rotateRight(NodeType* child); 
+	void rotateLeft(NodeType* child); 
+    template<class ForwardIt>
+    NodeType* buildSorted(ForwardIt& it, size_t n);
+    static int sortedHeight(size_t n);
+    void removeNode(NodeType* node);
+    NodeType* fingerSearch(NodeType* finger, const Key& key, NodeType*& parent, bool& isLeft) const;
+    void applyByFinger(const std::vector<BatchOp<Key, Value> >& ops);
+    void applyByMerge(const std::vector<BatchOp<Key, Value> >& ops);
+    static NodeType* linkSorted(NodeType* const* nodes, size_t n);
+
+    // The join-based operations work on detached subtrees: roots whose
+    // parent is NULL but which are not root_. Heights are passed along with
+    // them so that joins never have to measure
+    struct Subtree
+    {
+        NodeType* root;
+        int height;
+    };
+    static int subtreeHeight(const NodeType* node);
+    static int childHeight(const NodeType* node, int height, bool right);
+    static void linkChildren(NodeType* node, NodeType* left, NodeType* right);
+    Subtree joinNodes(Subtree left, NodeType* middle, Subtree right);
+    Subtree joinPair(Subtree left, Subtree right);
+    NodeType* detachMin(Subtree& tree);
+    void splitNodes(Subtree tree, const Key& key, Subtree& less, NodeType*& found, Subtree& greater);
+    NodeType* copySubtree(const NodeType* source);
+    Subtree unionNodes(Subtree mine, const NodeType* theirs, int theirHeight, int forks);
+    Subtree intersectNodes(Subtree mine, const NodeType* theirs, int theirHeight, int forks);
+    Subtree differenceNodes(Subtree mine, const NodeType* theirs, int theirHeight, int forks);
+    static int forkDepth();
+    template<class Left, class Right>
+    static void forkJoin(Left left, Right right, bool parallel);
+    void checkAllocator(const AVLTree& other, const char* operation) const;
+
+    // The set operations only fork where the other tree's subtree is at
+    // least this tall (a few thousand nodes)
+    static const int ParallelHeight = 12;
+
+    // apply_sorted_batch() merges the batch into the tree in one pass once
+    // it has at least MergeBatchMin ops and the tree is at most about
+    // MergeBatchRatio nodes per op
+    static const size_t MergeBatchMin = 1024;
+    static const size_t MergeBatchRatio = 2;
+
+    AVLNodeAllocator avlAlloc_;
+};
+
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+AVLTree<Key, Value, Compare, Alloc, NodeType>::AVLTree(const Compare& comp, const Alloc& alloc) :
+    BinarySearchTree<Key, Value, Compare, Alloc>(comp, alloc),
+    avlAlloc_(alloc)
+{
+
+}
+
+/*
+ * Builds the tree from a range sorted by strictly increasing key.
+ * See assign().
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+template<class ForwardIt>
+AVLTree<Key, Value, Compare, Alloc, NodeType>::AVLTree(
+    ForwardIt first, ForwardIt last, const Compare& comp, const Alloc& alloc) :
+    BinarySearchTree<Key, Value, Compare, Alloc>(comp, alloc),
+    avlAlloc_(alloc)
+{
+    assign(first, last);
+}
+
+/*
+ * Clears here rather than in ~BinarySearchTree so the nodes are freed
+ * as AVLNodes through this tree's allocator.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+AVLTree<Key, Value, Compare, Alloc, NodeType>::~AVLTree()
+{
+    this->clear();
+}
+
+/*
+ * Replaces the contents with the key/value pairs in [first, last), which
+ * must be sorted by strictly increasing key (throws std::invalid_argument
+ * otherwise, leaving the tree unchanged). The tree is built directly in
+ * O(n) with no descents or rotations: one pass checks the order and
+ * counts, then the old contents are cleared and a second pass creates the
+ * nodes in order. If creating a node throws, the tree is left empty.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+template<class ForwardIt>
+void AVLTree<Key, Value, Compare, Alloc, NodeType>::assign(ForwardIt first, ForwardIt last)
+{
+    size_t n = 0;
+    for(ForwardIt prev = first, it = first; it != last; prev = it++, ++n) {
+        if(it != first && !this->comp_(prev->first, it->first)) {
+            throw std::invalid_argument("AVLTree::assign: range is not sorted by unique key");
         }
     }
 
-    // Update child pointers
-    node->setLeft(child ? (child->setParent(node), child) : nullptr);
-
-    parent->setRight(node);
-    node->setParent(parent);
+    // Cleared only once the range is known good. Building the new nodes
+    // first would not help: with an allocator that releases in bulk,
+    // clear() frees the whole pool, new nodes included
+    this->clear();
+    ForwardIt it = first;
+    this->setRoot(buildSorted(it, n));
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::rotateLeft(AVLNode<Key, Value>* node) {
-    AVLNode<Key, Value>* parent = node->getRight();
-    AVLNode<Key, Value>* child = parent->getLeft();
+/*
+ * Links a new leaf, then retraces towards the root. insert, emplace and
+ * try_emplace all come through here (see BinarySearchTree::insertItem).
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void AVLTree<Key, Value, Compare, Alloc, NodeType>::linkNode(
+    Node<Key, Value>* slot, bool isLeft, Node<Key, Value>* node) {
+
+    this->noteLinked(slot, isLeft, node);
+    NodeType* parent = static_cast<NodeType*>(slot);
+    NodeType* child = static_cast<NodeType*>(node);
+    child->setParent(parent);
+
+    // If root empty, new node is the root
+    if (!parent) {
+        this->root_ = child;
+        return;
+    }
 
-    // Adjust parent pointers
-    if (!node->getParent()) {
-        parent->setParent(nullptr);
-        this->root_ = parent;
-    } 
+    if (isLeft) {
+        parent->setLeft(child);
+        NodeType::adjustAncestors(parent, 1);
+        parent->updateBalance(-1);
+    }
     else {
-        parent->setParent(node->getParent());
-        if (node->getParent()) {
-            if (node->getParent()->getLeft() == node) {
-                node->getParent()->setLeft(parent);
-            } 
-            else {
-                if (node->getParent()->getRight() == node) {
-                    node->getParent()->setRight(parent);
-                }
-            }
-        }
+        parent->setRight(child);
+        NodeType::adjustAncestors(parent, 1);
+        parent->updateBalance(1);
     }
 
-    // Update child pointers
-    node->setRight(child ? (child->setParent(node), child) : nullptr);
+    // Balance if neccessary
+    if (parent->getBalance() != 0) {
+        insertHelper(parent, child);
+    }
+}
 
-    parent->setLeft(node);
-    node->setParent(parent);
+/*
+ * Copies the items into an immutable FrozenMap for read-only use; later
+ * changes to the tree don't affect it. O(n).
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+FrozenMap<Key, Value, Compare> AVLTree<Key, Value, Compare, Alloc, NodeType>::freeze() const
+{
+    return FrozenMap<Key, Value, Compare>(this->begin(), this->end(), this->comp_);
+}
+
+/*
+ * Writes the tree to path as a FrozenMap image (see frozen.h), straight
+ * from the nodes. Keys and values must be trivially copyable. durable is
+ * as for FrozenMap::save.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void AVLTree<Key, Value, Compare, Alloc, NodeType>::save(const std::string& path, bool durable) const
+{
+    FrozenMap<Key, Value, Compare>::save(this->begin(), this->end(), path, durable);
+}
+
+/*
+ * Maps an image written by save(). Restarting from it costs a few system
+ * calls rather than n inserts; the result is a read-only FrozenMap that
+ * searches the mapped file in place.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+FrozenMap<Key, Value, Compare> AVLTree<Key, Value, Compare, Alloc, NodeType>::load_mapped(
+    const std::string& path, const Compare& comp)
+{
+    return FrozenMap<Key, Value, Compare>::load_mapped(path, comp);
+}
+
+/*
+ * Checks every AVL invariant in one O(n) pass: keys strictly increase in
+ * order, each child points back at its parent (and the root has none), the
+ * cached extremes are the actual ones, and every stored balance equals the
+ * actual right minus left height and lies in [-1, 1]. Returns false at the
+ * first violation.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+bool AVLTree<Key, Value, Compare, Alloc, NodeType>::validate() const
+{
+    if ((this->root_ && this->root_->getParent()) || !this->extremesValid()) {
+        return false;
+    }
+
+    const Node<Key, Value>* prev = nullptr;
+    return this->walkHeights(
+        [this, &prev](const Node<Key, Value>* node) {
+            bool ordered = !prev || this->comp_(prev->getKey(), node->getKey());
+            prev = node;
+            return ordered;
+        },
+        [](const Node<Key, Value>* node, int leftHeight, int rightHeight) {
+            const NodeType* avlNode = static_cast<const NodeType*>(node);
+            if ((node->getLeft() && node->getLeft()->getParent() != node) ||
+                (node->getRight() && node->getRight()->getParent() != node)) {
+                return false;
+            }
+            int difference = rightHeight - leftHeight;
+            return difference >= -1 && difference <= 1 && avlNode->getBalance() == difference;
+        });
+}
+
+/*
+ * Recall: The writeup specifies that if a node has 2 children you
+ * should swap with the predecessor and then remove.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void AVLTree<Key, Value, Compare, Alloc, NodeType>::remove(const Key& key) {
+    if (!this->root_){
+        return;
+    }
+
+    NodeType* node = static_cast<NodeType*>(BinarySearchTree<Key, Value, Compare, Alloc>::internalFind(key));
+    if (node) {
+        removeNode(node);
+    }
+}
+
+/*
+ * Unlinks and frees node, then retraces towards the root.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void AVLTree<Key, Value, Compare, Alloc, NodeType>::removeNode(NodeType* node) {
+    this->noteUnlinking(node);
+    int difference = 0;
+    NodeType* parent = node->getParent();
+
+    // Swap node with predecessor if it has two children
+    if (node->getLeft() && node->getRight()) {
+        nodeSwap(static_cast<NodeType*>(BinarySearchTree<Key, Value, Compare, Alloc>::predecessor(node)), node);
+        parent = node->getParent();
+    }
+
+    // Calculate difference ni heights between parent and node
+    if (parent) {
+        difference = (parent->getLeft() != node) ? -1 : 1;
+    }
+
+    // Case 1: Node has no children
+    if (!node->getLeft() && !node->getRight()) {
+        if (this->root_ == node) {
+            destroyNode(node);
+            node = nullptr;
+            this->root_ = nullptr;
+            return;
+        } 
+        else {
+            // Update if needed removal to null
+            if (node == parent->getLeft()){
+                parent->setLeft(nullptr);
+            }
+            else{
+                parent->setRight(nullptr);
+            }
+            destroyNode(node);
+            node = nullptr;
+        }
+    } 
+
+    // Case 2: Node has only right children
+    else if (!node->getLeft() && node->getRight()) {
+        if (this->root_ == node) {
+            this->root_ = node->getRight();
+            this->root_->setParent(nullptr);
+        }
+        if (node && parent) {
+            // Set parent's left child to node's right
+            if (parent->getLeft() == node){
+                parent->setLeft(node->getRight());
+            }
+            // Set parent's right child to node's right
+            else{
+                parent->setRight(node->getRight());
+            }
+            node->getRight()->setParent(parent);
+        }
+        destroyNode(node);
+        node = nullptr;
+    } 
+
+    // Case 3: Node has only left children
+    else if (node->getLeft() && !node->getRight()) {
+        if (this->root_ == node) {
+            this->root_ = this->root_->getLeft();
+            this->root_->setParent(nullptr);
+        }
+        if (node && parent) {
+            // Set parent's left child to node's left
+            if (parent->getLeft() == node){
+                parent->setLeft(node->getLeft());
+            }
+            // Set parent's right child to node's left
+            else{
+                parent->setRight(node->getLeft());
+            }
+            node->getLeft()->setParent(parent);
+        }
+        destroyNode(node);
+        node = nullptr;
+    }
+    NodeType::adjustAncestors(parent, -1);
+    removeHelper(parent, difference);
+}
+
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void AVLTree<Key, Value, Compare, Alloc, NodeType>::nodeSwap(NodeType* n1, NodeType* n2) {
+    BinarySearchTree<Key, Value, Compare, Alloc>::nodeSwap(n1, n2);
+    int8_t tempB = n1->getBalance();
+    n1->setBalance(n2->getBalance());
+    n2->setBalance(tempB);
+    n1->swapAugmentation(n2);
+}
+
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+NodeType* AVLTree<Key, Value, Compare, Alloc, NodeType>::createNode(
+    const Key& key, const Value& value, NodeType* parent)
+{
+    return allocateNode<NodeType>(avlAlloc_, key, value, parent);
+}
+
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+Node<Key, Value>* AVLTree<Key, Value, Compare, Alloc, NodeType>::createNode(
+    const ItemBuilder<Key, Value>& builder, Node<Key, Value>* parent)
+{
+    return allocateNode<NodeType>(avlAlloc_, builder, static_cast<NodeType*>(parent));
+}
+
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void AVLTree<Key, Value, Compare, Alloc, NodeType>::destroyNode(Node<Key, Value>* node)
+{
+    deallocateNode(avlAlloc_, static_cast<NodeType*>(node));
+}
+
+/*
+ * Same as BinarySearchTree::releaseNodes, but against the AVLNode allocator.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void AVLTree<Key, Value, Compare, Alloc, NodeType>::releaseNodes()
+{
+    typedef AllocatorRelease<AVLNodeAllocator> Release;
+    bool exclusive = Release::exclusive(avlAlloc_);
+    if(!exclusive || !std::is_trivially_destructible<std::pair<const Key, Value> >::value) {
+        this->clearHelp(this->root_);
+    }
+    if(exclusive) {
+        Release::release(avlAlloc_);
+    }
+}
+
+/*
+ * Builds a subtree from the next n items of it, consuming them in order.
+ * The left half gets (n - 1) / 2 items and the right the rest, so the
+ * right side is never shorter and a subtree of n nodes has height
+ * sortedHeight(n); that gives each node's balance without measuring.
+ * On an exception, whatever was built for this subtree is freed.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+template<class ForwardIt>
+NodeType* AVLTree<Key, Value, Compare, Alloc, NodeType>::buildSorted(ForwardIt& it, size_t n)
+{
+    if (n == 0) {
+        return nullptr;
+    }
+
+    size_t leftCount = (n - 1) / 2;
+    size_t rightCount = n - 1 - leftCount;
+
+    NodeType* left = buildSorted(it, leftCount);
+    NodeType* node = nullptr;
+    try {
+        node = createNode(it->first, it->second, nullptr);
+    }
+    catch (...) {
+        this->clearHelp(left);
+        throw;
+    }
+    ++it;
+
+    node->setLeft(left);
+    if (left) {
+        left->setParent(node);
+    }
+    node->setBalance(static_cast<int8_t>(sortedHeight(rightCount) - sortedHeight(leftCount)));
+
+    try {
+        NodeType* right = buildSorted(it, rightCount);
+        node->setRight(right);
+        if (right) {
+            right->setParent(node);
+        }
+    }
+    catch (...) {
+        this->clearHelp(node);
+        throw;
+    }
+    node->pullUp();
+    return node;
+}
+
+/*
+ * Height of the subtree buildSorted() makes from n items: the bit length of n.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+int AVLTree<Key, Value, Compare, Alloc, NodeType>::sortedHeight(size_t n)
+{
+    int height = 0;
+    while (n) {
+        ++height;
+        n >>= 1;
+    }
+    return height;
+}
+
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void AVLTree<Key, Value, Compare, Alloc, NodeType>::insertHelper(NodeType* parent, NodeType* node) {
+    avlInsertRetrace(this->root_, parent, node);
+}
+
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void AVLTree<Key, Value, Compare, Alloc, NodeType>::removeHelper(NodeType* node, int diff) {
+    avlRemoveRetrace(this->root_, node, diff);
+}
+
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void AVLTree<Key, Value, Compare, Alloc, NodeType>::rotateRight(NodeType* node) {
+    avlRotateRight(this->root_, node);
+}
+
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void AVLTree<Key, Value, Compare, Alloc, NodeType>::rotateLeft(NodeType* node) {
+    avlRotateLeft(this->root_, node);
+}
+
+
+/*
+ * Moves every item with a key >= key into right, discarding what right
+ * held before; this tree keeps the rest. O(log n): the tree is cut along
+ * the search path for key and the pieces on each side joined back up.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void AVLTree<Key, Value, Compare, Alloc, NodeType>::split(const Key& key, AVLTree& right)
+{
+    if (&right == this) {
+        throw std::invalid_argument("AVLTree::split: right must be another tree");
+    }
+    checkAllocator(right, "split");
+    right.clear();
+
+    NodeType* root = static_cast<NodeType*>(this->root_);
+    Subtree whole = { root, subtreeHeight(root) };
+    Subtree less;
+    NodeType* found;
+    Subtree greater;
+    splitNodes(whole, key, less, found, greater);
+    this->setRoot(less.root);
+    if (found) {
+        Subtree empty = { nullptr, 0 };
+        greater = joinNodes(empty, found, greater);
+    }
+    right.setRoot(greater.root);
+}
+
+/*
+ * Replaces the contents with left's items, then middle, then right's,
+ * leaving left and right empty. Every key in left must be less than
+ * middle's and every key in right greater (throws std::invalid_argument
+ * otherwise, changing nothing). left or right may be this tree itself.
+ * O(|height(left) - height(right)| + 1).
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void AVLTree<Key, Value, Compare, Alloc, NodeType>::join(
+    AVLTree& left, const std::pair<const Key, Value>& middle, AVLTree& right)
+{
+    checkAllocator(left, "join");
+    checkAllocator(right, "join");
+    if (&left == &right) {
+        throw std::invalid_argument("AVLTree::join: left and right must be different trees");
+    }
+    const Node<Key, Value>* largest = left.getLargestNode();
+    const Node<Key, Value>* smallest = right.getSmallestNode();
+    if ((largest && !this->comp_(largest->getKey(), middle.first)) ||
+        (smallest && !this->comp_(middle.first, smallest->getKey()))) {
+        throw std::invalid_argument("AVLTree::join: keys are not ordered left < middle < right");
+    }
+
+    NodeType* node = createNode(middle.first, middle.second, nullptr);
+    if (this != &left && this != &right) {
+        this->clear();
+    }
+    NodeType* leftRoot = static_cast<NodeType*>(left.root_);
+    NodeType* rightRoot = static_cast<NodeType*>(right.root_);
+    Subtree leftTree = { leftRoot, subtreeHeight(leftRoot) };
+    Subtree rightTree = { rightRoot, subtreeHeight(rightRoot) };
+    left.setRoot(nullptr);
+    right.setRoot(nullptr);
+    this->setRoot(joinNodes(leftTree, node, rightTree).root);
+}
+
+/*
+ * join() without a middle item: right's smallest node is unlinked and
+ * used as the middle. Every key in left must be less than every key in
+ * right. O(log n).
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void AVLTree<Key, Value, Compare, Alloc, NodeType>::join(AVLTree& left, AVLTree& right)
+{
+    checkAllocator(left, "join");
+    checkAllocator(right, "join");
+    if (&left == &right) {
+        throw std::invalid_argument("AVLTree::join: left and right must be different trees");
+    }
+    const Node<Key, Value>* largest = left.getLargestNode();
+    const Node<Key, Value>* smallest = right.getSmallestNode();
+    if (largest && smallest && !this->comp_(largest->getKey(), smallest->getKey())) {
+        throw std::invalid_argument("AVLTree::join: keys are not ordered left < right");
+    }
+
+    if (this != &left && this != &right) {
+        this->clear();
+    }
+    NodeType* leftRoot = static_cast<NodeType*>(left.root_);
+    NodeType* rightRoot = static_cast<NodeType*>(right.root_);
+    Subtree leftTree = { leftRoot, subtreeHeight(leftRoot) };
+    Subtree rightTree = { rightRoot, subtreeHeight(rightRoot) };
+    left.setRoot(nullptr);
+    right.setRoot(nullptr);
+    this->setRoot(joinPair(leftTree, rightTree).root);
+}
+
+/*
+ * Adds other's items whose keys are not already here; for keys in both,
+ * this tree's value is kept. The recursion exposes other's root, splits
+ * this tree at its key, recurses on the two sides and joins the results,
+ * which costs O(m log(n / m + 1)) for trees of sizes m <= n. The two
+ * recursive calls touch disjoint nodes, so near the top they run in
+ * parallel when the allocator is stateless (and so safe to share). If
+ * copying an item throws, this tree is left empty.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void AVLTree<Key, Value, Compare, Alloc, NodeType>::union_with(const AVLTree& other)
+{
+    if (&other == this) {
+        return;
+    }
+    const NodeType* theirs = static_cast<const NodeType*>(other.root_);
+    NodeType* root = static_cast<NodeType*>(this->root_);
+    Subtree mine = { root, subtreeHeight(root) };
+    this->setRoot(nullptr);
+    this->setRoot(unionNodes(mine, theirs, subtreeHeight(theirs), forkDepth()).root);
+}
+
+/*
+ * Keeps only the items whose keys are also in other. Same recursion and
+ * cost as union_with().
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void AVLTree<Key, Value, Compare, Alloc, NodeType>::intersect_with(const AVLTree& other)
+{
+    if (&other == this) {
+        return;
+    }
+    const NodeType* theirs = static_cast<const NodeType*>(other.root_);
+    NodeType* root = static_cast<NodeType*>(this->root_);
+    Subtree mine = { root, subtreeHeight(root) };
+    this->setRoot(nullptr);
+    this->setRoot(intersectNodes(mine, theirs, subtreeHeight(theirs), forkDepth()).root);
+}
+
+/*
+ * Removes the items whose keys are in other. Same recursion and cost as
+ * union_with().
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void AVLTree<Key, Value, Compare, Alloc, NodeType>::difference_with(const AVLTree& other)
+{
+    if (&other == this) {
+        this->clear();
+        return;
+    }
+    const NodeType* theirs = static_cast<const NodeType*>(other.root_);
+    NodeType* root = static_cast<NodeType*>(this->root_);
+    Subtree mine = { root, subtreeHeight(root) };
+    this->setRoot(nullptr);
+    this->setRoot(differenceNodes(mine, theirs, subtreeHeight(theirs), forkDepth()).root);
+}
+
+/*
+ * Height of a subtree in O(log n), following the taller child down.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+int AVLTree<Key, Value, Compare, Alloc, NodeType>::subtreeHeight(const NodeType* node)
+{
+    int height = 0;
+    while (node) {
+        ++height;
+        node = (node->getBalance() < 0) ? node->getLeft() : node->getRight();
+    }
+    return height;
+}
+
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+int AVLTree<Key, Value, Compare, Alloc, NodeType>::childHeight(const NodeType* node, int height, bool right)
+{
+    bool shorter = right ? node->getBalance() < 0 : node->getBalance() > 0;
+    return height - (shorter ? 2 : 1);
+}
+
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void AVLTree<Key, Value, Compare, Alloc, NodeType>::linkChildren(
+    NodeType* node, NodeType* left, NodeType* right)
+{
+    node->setLeft(left);
+    if (left) {
+        left->setParent(node);
+    }
+    node->setRight(right);
+    if (right) {
+        right->setParent(node);
+    }
+}
+
+/*
+ * Joins two detached subtrees and a single detached node whose key lies
+ * between them. If one side is more than one level taller, middle takes
+ * over the first node on its inner spine that is at most one level taller
+ * than the other side, with that node and the other side as children. The
+ * subtree there grew by exactly one level, as it would after an insert, so
+ * insertHelper() retraces from it with the usual rotations; the whole grew
+ * only if that reached an evenly balanced root and tipped it.
+ * O(height difference + 1).
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+typename AVLTree<Key, Value, Compare, Alloc, NodeType>::Subtree AVLTree<Key, Value, Compare, Alloc, NodeType>::joinNodes(
+    Subtree left, NodeType* middle, Subtree right)
+{
+    middle->setParent(nullptr);
+    if (left.height <= right.height + 1 && right.height <= left.height + 1) {
+        linkChildren(middle, left.root, right.root);
+        middle->setBalance(static_cast<int8_t>(right.height - left.height));
+        middle->pullUp();
+        Subtree joined = { middle, std::max(left.height, right.height) + 1 };
+        return joined;
+    }
+
+    Subtree taller = left.height > right.height ? left : right;
+    NodeType* parent = nullptr;
+    NodeType* spine = taller.root;
+    int height = taller.height;
+    if (left.height > right.height) {
+        while (height > right.height + 1) {
+            height -= (spine->getBalance() < 0) ? 2 : 1;
+            parent = spine;
+            spine = spine->getRight();
+        }
+        linkChildren(middle, spine, right.root);
+        middle->setBalance(static_cast<int8_t>(right.height - height));
+        parent->setRight(middle);
+    }
+    else {
+        while (height > left.height + 1) {
+            height -= (spine->getBalance() > 0) ? 2 : 1;
+            parent = spine;
+            spine = spine->getLeft();
+        }
+        linkChildren(middle, left.root, spine);
+        middle->setBalance(static_cast<int8_t>(height - left.height));
+        parent->setLeft(middle);
+    }
+    middle->setParent(parent);
+
+    // Refresh augmentation up the spine before any rotation relies on it
+    for (NodeType* node = middle; node; node = node->getParent()) {
+        node->pullUp();
+    }
+    int8_t balance = taller.root->getBalance();
+    insertHelper(middle, spine);
+
+    Subtree joined = taller;
+    if (taller.root->getParent()) {
+        joined.root = taller.root->getParent();
+    }
+    else if (balance == 0 && taller.root->getBalance() != 0) {
+        ++joined.height;
+    }
+    return joined;
+}
+
+/*
+ * joinNodes() without a middle node: right's smallest node becomes it.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+typename AVLTree<Key, Value, Compare, Alloc, NodeType>::Subtree AVLTree<Key, Value, Compare, Alloc, NodeType>::joinPair(Subtree left, Subtree right)
+{
+    if (!left.root) {
+        return right;
+    }
+    if (!right.root) {
+        return left;
+    }
+    NodeType* middle = detachMin(right);
+    return joinNodes(left, middle, right);
+}
+
+/*
+ * Unlinks the smallest node of a non-empty detached subtree, rebalancing
+ * as remove() does, and returns it detached; tree is updated to what is
+ * left. The height dropped if the retrace evened out the root, or rotated
+ * it and left the new root even.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+NodeType* AVLTree<Key, Value, Compare, Alloc, NodeType>::detachMin(Subtree& tree)
+{
+    NodeType* min = tree.root;
+    while (min->getLeft()) {
+        min = min->getLeft();
+    }
+    NodeType* parent = min->getParent();
+    NodeType* child = min->getRight();
+    if (child) {
+        child->setParent(parent);
+    }
+
+    if (!parent) {
+        tree.root = child;
+        --tree.height;
+    }
+    else {
+        NodeType* root = tree.root;
+        int8_t balance = root->getBalance();
+        parent->setLeft(child);
+        NodeType::adjustAncestors(parent, -1);
+        removeHelper(parent, 1);
+        if (root->getParent()) {
+            tree.root = root->getParent();
+            if (tree.root->getBalance() == 0) {
+                --tree.height;
+            }
+        }
+        else if (balance != 0 && root->getBalance() == 0) {
+            --tree.height;
+        }
+    }
+
+    min->setParent(nullptr);
+    min->setRight(nullptr);
+    min->setBalance(0);
+    min->pullUp();
+    return min;
+}
+
+/*
+ * Splits a detached subtree into the keys less than key, the node holding
+ * key (or NULL), and the keys greater, all detached. Each level takes the
+ * root off, recurses into the side key lies in and joins the root and its
+ * other subtree onto what comes back; the joins' costs telescope, so the
+ * whole split is O(log n).
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void AVLTree<Key, Value, Compare, Alloc, NodeType>::splitNodes(
+    Subtree tree, const Key& key, Subtree& less, NodeType*& found, Subtree& greater)
+{
+    NodeType* root = tree.root;
+    if (!root) {
+        less = greater = tree;
+        found = nullptr;
+        return;
+    }
+
+    Subtree left = { root->getLeft(), childHeight(root, tree.height, false) };
+    Subtree right = { root->getRight(), childHeight(root, tree.height, true) };
+    if (left.root) {
+        left.root->setParent(nullptr);
+    }
+    if (right.root) {
+        right.root->setParent(nullptr);
+    }
+    root->setLeft(nullptr);
+    root->setRight(nullptr);
+
+    if (this->comp_(key, root->getKey())) {
+        Subtree rest;
+        splitNodes(left, key, less, found, rest);
+        greater = joinNodes(rest, root, right);
+    }
+    else if (this->comp_(root->getKey(), key)) {
+        Subtree rest;
+        splitNodes(right, key, rest, found, greater);
+        less = joinNodes(left, root, rest);
+    }
+    else {
+        less = left;
+        greater = right;
+        root->setBalance(0);
+        root->pullUp();
+        found = root;
+    }
+}
+
+/*
+ * Copies a subtree of another tree node for node, keeping its shape.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+NodeType* AVLTree<Key, Value, Compare, Alloc, NodeType>::copySubtree(const NodeType* source)
+{
+    if (!source) {
+        return nullptr;
+    }
+    NodeType* node = createNode(source->getKey(), source->getValue(), nullptr);
+    try {
+        linkChildren(node, copySubtree(source->getLeft()), nullptr);
+        linkChildren(node, node->getLeft(), copySubtree(source->getRight()));
+    }
+    catch (...) {
+        this->clearHelp(node);
+        throw;
+    }
+    node->setBalance(source->getBalance());
+    node->pullUp();
+    return node;
+}
+
+/*
+ * The recursions below take ownership of mine, a detached subtree of this
+ * tree, and read theirs, a subtree of the other tree whose height is
+ * theirHeight. On an exception they free everything they own.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+typename AVLTree<Key, Value, Compare, Alloc, NodeType>::Subtree AVLTree<Key, Value, Compare, Alloc, NodeType>::unionNodes(
+    Subtree mine, const NodeType* theirs, int theirHeight, int forks)
+{
+    if (!theirs) {
+        return mine;
+    }
+    if (!mine.root) {
+        Subtree copy = { copySubtree(theirs), theirHeight };
+        return copy;
+    }
+    Subtree less;
+    NodeType* middle;
+    Subtree greater;
+    splitNodes(mine, theirs->getKey(), less, middle, greater);
+
+    Subtree left = { nullptr, 0 };
+    Subtree right = { nullptr, 0 };
+    try {
+        if (!middle) {
+            middle = createNode(theirs->getKey(), theirs->getValue(), nullptr);
+        }
+        int leftHeight = childHeight(theirs, theirHeight, false);
+        int rightHeight = childHeight(theirs, theirHeight, true);
+        forkJoin(
+            [&]() {
+                Subtree part = less;
+                less.root = nullptr;
+                left = unionNodes(part, theirs->getLeft(), leftHeight, forks - 1);
+            },
+            [&]() {
+                Subtree part = greater;
+                greater.root = nullptr;
+                right = unionNodes(part, theirs->getRight(), rightHeight, forks - 1);
+            },
+            forks > 0 && theirHeight >= ParallelHeight);
+    }
+    catch (...) {
+        this->clearHelp(less.root);
+        this->clearHelp(greater.root);
+        this->clearHelp(left.root);
+        this->clearHelp(right.root);
+        this->clearHelp(middle);
+        throw;
+    }
+    return joinNodes(left, middle, right);
+}
+
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+typename AVLTree<Key, Value, Compare, Alloc, NodeType>::Subtree AVLTree<Key, Value, Compare, Alloc, NodeType>::intersectNodes(
+    Subtree mine, const NodeType* theirs, int theirHeight, int forks)
+{
+    if (!theirs) {
+        this->clearHelp(mine.root);
+        mine.root = nullptr;
+        mine.height = 0;
+        return mine;
+    }
+    if (!mine.root) {
+        return mine;
+    }
+    Subtree less;
+    NodeType* middle;
+    Subtree greater;
+    splitNodes(mine, theirs->getKey(), less, middle, greater);
+
+    Subtree left = { nullptr, 0 };
+    Subtree right = { nullptr, 0 };
+    try {
+        int leftHeight = childHeight(theirs, theirHeight, false);
+        int rightHeight = childHeight(theirs, theirHeight, true);
+        forkJoin(
+            [&]() {
+                Subtree part = less;
+                less.root = nullptr;
+                left = intersectNodes(part, theirs->getLeft(), leftHeight, forks - 1);
+            },
+            [&]() {
+                Subtree part = greater;
+                greater.root = nullptr;
+                right = intersectNodes(part, theirs->getRight(), rightHeight, forks - 1);
+            },
+            forks > 0 && theirHeight >= ParallelHeight);
+    }
+    catch (...) {
+        this->clearHelp(less.root);
+        this->clearHelp(greater.root);
+        this->clearHelp(left.root);
+        this->clearHelp(right.root);
+        this->clearHelp(middle);
+        throw;
+    }
+    return middle ? joinNodes(left, middle, right) : joinPair(left, right);
+}
+
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+typename AVLTree<Key, Value, Compare, Alloc, NodeType>::Subtree AVLTree<Key, Value, Compare, Alloc, NodeType>::differenceNodes(
+    Subtree mine, const NodeType* theirs, int theirHeight, int forks)
+{
+    if (!mine.root || !theirs) {
+        return mine;
+    }
+    Subtree less;
+    NodeType* middle;
+    Subtree greater;
+    splitNodes(mine, theirs->getKey(), less, middle, greater);
+    if (middle) {
+        destroyNode(middle);
+    }
+
+    Subtree left = { nullptr, 0 };
+    Subtree right = { nullptr, 0 };
+    try {
+        int leftHeight = childHeight(theirs, theirHeight, false);
+        int rightHeight = childHeight(theirs, theirHeight, true);
+        forkJoin(
+            [&]() {
+                Subtree part = less;
+                less.root = nullptr;
+                left = differenceNodes(part, theirs->getLeft(), leftHeight, forks - 1);
+            },
+            [&]() {
+                Subtree part = greater;
+                greater.root = nullptr;
+                right = differenceNodes(part, theirs->getRight(), rightHeight, forks - 1);
+            },
+            forks > 0 && theirHeight >= ParallelHeight);
+    }
+    catch (...) {
+        this->clearHelp(less.root);
+        this->clearHelp(greater.root);
+        this->clearHelp(left.root);
+        this->clearHelp(right.root);
+        throw;
+    }
+    return joinPair(left, right);
+}
+
+/*
+ * How many levels of the set operations may fork: enough for one task
+ * per hardware thread, or none if the node allocator has state that
+ * concurrent tasks would share.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+int AVLTree<Key, Value, Compare, Alloc, NodeType>::forkDepth()
+{
+    if (!std::allocator_traits<AVLNodeAllocator>::is_always_equal::value) {
+        return 0;
+    }
+    return sortedHeight(std::thread::hardware_concurrency());
+}
+
+/*
+ * Runs left and right, in parallel if asked: left on a new thread while
+ * the caller runs right. Waits for both before passing on an exception.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+template<class Left, class Right>
+void AVLTree<Key, Value, Compare, Alloc, NodeType>::forkJoin(Left left, Right right, bool parallel)
+{
+    if (!parallel) {
+        left();
+        right();
+        return;
+    }
+    std::future<void> pending = std::async(std::launch::async, left);
+    try {
+        right();
+    }
+    catch (...) {
+        pending.wait();
+        throw;
+    }
+    pending.get();
+}
+
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void AVLTree<Key, Value, Compare, Alloc, NodeType>::checkAllocator(
+    const AVLTree& other, const char* operation) const
+{
+    if (!(avlAlloc_ == other.avlAlloc_)) {
+        throw std::invalid_argument(std::string("AVLTree::") + operation +
+                                    ": trees must have equal allocators");
+    }
+}
+
+/*
+ * Applies a batch of upserts and deletes sorted by key (throws
+ * std::invalid_argument, changing nothing, if it is not; several entries
+ * for one key apply in order). Small batches are applied one by one, but
+ * each search starts from the node the previous one ended at and climbs
+ * only as far as the next key needs, so nearby keys share the upper
+ * levels instead of each descending from the root. Once the batch is
+ * about as large as the tree, one in-order pass merges it with the
+ * existing nodes and relinks them into a balanced tree without copying
+ * items: O(n + m) rather than O(m log n). (Sooner, the pass over every
+ * node costs more in cache misses than the descents it saves.)
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void AVLTree<Key, Value, Compare, Alloc, NodeType>::apply_sorted_batch(
+    const std::vector<BatchOp<Key, Value> >& ops)
+{
+    for (size_t i = 1; i < ops.size(); ++i) {
+        if (this->comp_(ops[i].item.first, ops[i - 1].item.first)) {
+            throw std::invalid_argument("AVLTree::apply_sorted_batch: batch is not sorted by key");
+        }
+    }
+
+    // Estimate the size as 2^height, which for the shapes inserts produce
+    // is within 2x of it; counting would be O(n)
+    int height = subtreeHeight(static_cast<NodeType*>(this->root_));
+    bool merge = ops.size() >= MergeBatchMin &&
+                 (height < 8 * static_cast<int>(sizeof(size_t)) - 1 &&
+                  (size_t(1) << height) <= ops.size() * MergeBatchRatio);
+    if (merge) {
+        applyByMerge(ops);
+    }
+    else {
+        applyByFinger(ops);
+    }
+}
+
+/*
+ * Finds key starting from finger, a node whose key is not greater, or
+ * from the root if finger is NULL. The climb stops at the first ancestor
+ * reached from its left whose key is greater than key, since key then lies
+ * within the subtree climbed out of. Returns the node holding key, or NULL
+ * with parent and isLeft set to where it would be linked.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+NodeType* AVLTree<Key, Value, Compare, Alloc, NodeType>::fingerSearch(
+    NodeType* finger, const Key& key, NodeType*& parent, bool& isLeft) const
+{
+    NodeType* node = finger;
+    if (!node) {
+        node = static_cast<NodeType*>(this->root_);
+    }
+    while (node && node->getParent()) {
+        NodeType* up = node->getParent();
+        if (up->getLeft() == node && this->comp_(key, up->getKey())) {
+            break;
+        }
+        node = up;
+    }
+
+    parent = nullptr;
+    isLeft = false;
+    while (node) {
+        if (this->comp_(key, node->getKey())) {
+            parent = node;
+            isLeft = true;
+            node = node->getLeft();
+        }
+        else if (this->comp_(node->getKey(), key)) {
+            parent = node;
+            isLeft = false;
+            node = node->getRight();
+        }
+        else {
+            return node;
+        }
+    }
+    return nullptr;
+}
+
+/*
+ * Applies ops one at a time through fingerSearch(). The finger is always a
+ * node whose key is at most the next op's: the node just upserted, or for
+ * a delete the removed node's predecessor, which removal keeps alive.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void AVLTree<Key, Value, Compare, Alloc, NodeType>::applyByFinger(
+    const std::vector<BatchOp<Key, Value> >& ops)
+{
+    NodeType* finger = nullptr;
+    for (size_t i = 0; i < ops.size(); ++i) {
+        const std::pair<Key, Value>& item = ops[i].item;
+        NodeType* parent;
+        bool isLeft;
+        NodeType* node = fingerSearch(finger, item.first, parent, isLeft);
+
+        if (ops[i].erase) {
+            if (node) {
+                finger = static_cast<NodeType*>(
+                    BinarySearchTree<Key, Value, Compare, Alloc>::predecessor(node));
+                removeNode(node);
+            }
+        }
+        else if (node) {
+            node->setValue(item.second);
+            finger = node;
+        }
+        else {
+            node = createNode(item.first, item.second, parent);
+            linkNode(parent, isLeft, node);
+            finger = node;
+        }
+    }
+}
+
+/*
+ * Merges ops into the existing nodes in one in-order pass, then relinks
+ * the surviving and new nodes with linkSorted(). The tree itself is only
+ * changed once every new node exists, so if creating one throws it is
+ * left as it was apart from values already assigned.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void AVLTree<Key, Value, Compare, Alloc, NodeType>::applyByMerge(
+    const std::vector<BatchOp<Key, Value> >& ops)
+{
+    std::vector<NodeType*> nodes;
+    for (Node<Key, Value>* node = this->getSmallestNode(); node;
+         node = BinarySearchTree<Key, Value, Compare, Alloc>::successor(node)) {
+        nodes.push_back(static_cast<NodeType*>(node));
+    }
+
+    std::vector<NodeType*> merged;
+    std::vector<NodeType*> created;
+    std::vector<NodeType*> dropped;
+    merged.reserve(nodes.size() + ops.size());
+    created.reserve(ops.size());
+    try {
+        size_t next = 0;
+        for (size_t i = 0; i < ops.size(); ++i) {
+            const std::pair<Key, Value>& item = ops[i].item;
+            while (next < nodes.size() && this->comp_(nodes[next]->getKey(), item.first)) {
+                merged.push_back(nodes[next++]);
+            }
+
+            // The node for this key, if any: left by an earlier op on the
+            // same key, or still to come from the tree
+            NodeType* node = nullptr;
+            if (!merged.empty() && !this->comp_(merged.back()->getKey(), item.first)) {
+                node = merged.back();
+                merged.pop_back();
+            }
+            else if (next < nodes.size() && !this->comp_(item.first, nodes[next]->getKey())) {
+                node = nodes[next++];
+            }
+
+            if (ops[i].erase) {
+                if (node) {
+                    dropped.push_back(node);
+                }
+                continue;
+            }
+            if (node) {
+                node->setValue(item.second);
+            }
+            else {
+                node = createNode(item.first, item.second, nullptr);
+                created.push_back(node);
+            }
+            merged.push_back(node);
+        }
+        merged.insert(merged.end(), nodes.begin() + next, nodes.end());
+    }
+    catch (...) {
+        for (size_t i = 0; i < created.size(); ++i) {
+            destroyNode(created[i]);
+        }
+        throw;
+    }
+
+    this->setRoot(linkSorted(merged.data(), merged.size()));
+    for (size_t i = 0; i < dropped.size(); ++i) {
+        destroyNode(dropped[i]);
+    }
+}
+
+/*
+ * Links n existing nodes, in key order, into a subtree shaped as
+ * buildSorted() would make it and returns its root.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+NodeType* AVLTree<Key, Value, Compare, Alloc, NodeType>::linkSorted(NodeType* const* nodes, size_t n)
+{
+    if (n == 0) {
+        return nullptr;
+    }
+
+    size_t leftCount = (n - 1) / 2;
+    size_t rightCount = n - 1 - leftCount;
+    NodeType* node = nodes[leftCount];
+    node->setParent(nullptr);
+    linkChildren(node, linkSorted(nodes, leftCount), linkSorted(nodes + leftCount + 1, rightCount));
+    node->setBalance(static_cast<int8_t>(sortedHeight(rightCount) - sortedHeight(leftCount)));
+    node->pullUp();
+    return node;
 }
 
 
@@ -0,0 +1,1419 @@
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <string>
+#include <sstream>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include "bst.h"
+#include "avlbst.h"
+#include "slab_alloc.h"
+#include "btree.h"
+#include "concurrent_avl.h"
+#include "persistent_avl.h"
+#include "compact_avl.h"
+#include "intrusive_avl.h"
+#include "wal.h"
+#include "rbbst.h"
+#include "wavlbst.h"
+
+using namespace std;
+
+// Simple wall-clock timer reporting nanoseconds per operation
+class Timer
+{
+public:
+    Timer() : start_(chrono::steady_clock::now()) { }
+    double nsPer(size_t ops) const
+    {
+        chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start_;
+        return elapsed.count() / (ops ? ops : 1);
+    }
+private:
+    chrono::steady_clock::time_point start_;
+};
+
+void report(const string& engine, const string& op, double ns, const string& unit = "ns/op")
+{
+    cout << left << setw(12) << engine << setw(14) << op
+         << right << fixed << setprecision(1) << setw(10) << ns << " " << unit << endl;
+}
+
+// Keeps the optimizer from discarding lookup results
+static volatile uint64_t sink;
+
+vector<uint64_t> randomKeys(size_t n, uint64_t seed)
+{
+    mt19937_64 rng(seed);
+    vector<uint64_t> keys(n);
+    for(size_t i = 0; i < n; ++i) {
+        keys[i] = rng();
+    }
+    return keys;
+}
+
+// Builds the tree from shuffled keys, then times n successful random lookups
+template<typename Tree>
+void benchLookup(const string& engine, Tree& tree, const vector<uint64_t>& keys,
+                 const vector<uint64_t>& probes)
+{
+    Timer build;
+    for(size_t i = 0; i < keys.size(); ++i) {
+        tree.insert(std::make_pair(keys[i], keys[i]));
+    }
+    report(engine, "insert", build.nsPer(keys.size()));
+
+    uint64_t sum = 0;
+    Timer lookup;
+    for(size_t i = 0; i < probes.size(); ++i) {
+        sum += tree.find(probes[i])->second;
+    }
+    report(engine, "find", lookup.nsPer(probes.size()));
+
+    Timer scan;
+    for(typename Tree::iterator it = tree.begin(); it != tree.end(); ++it) {
+        sum += it->first;
+    }
+    report(engine, "iterate", scan.nsPer(keys.size()));
+    sink = sum;
+}
+
+void lookupScenario(size_t n)
+{
+    vector<uint64_t> keys = randomKeys(n, 1);
+    vector<uint64_t> probes(keys);
+    shuffle(probes.begin(), probes.end(), mt19937_64(2));
+
+    {
+        BinarySearchTree<uint64_t, uint64_t> bst;
+        benchLookup("bst", bst, keys, probes);
+    }
+    {
+        AVLTree<uint64_t, uint64_t> avl;
+        benchLookup("avl", avl, keys, probes);
+    }
+    {
+        map<uint64_t, uint64_t> stdmap;
+        benchLookup("std::map", stdmap, keys, probes);
+    }
+}
+
+// Times n inserts followed by clear() for one allocator choice
+template<typename Tree>
+void benchAllocator(const string& engine, const vector<uint64_t>& keys)
+{
+    Tree tree;
+    Timer build;
+    for(size_t i = 0; i < keys.size(); ++i) {
+        tree.insert(std::make_pair(keys[i], keys[i]));
+    }
+    report(engine, "insert", build.nsPer(keys.size()));
+
+    Timer teardown;
+    tree.clear();
+    report(engine, "clear", teardown.nsPer(keys.size()));
+}
+
+void allocScenario(size_t n)
+{
+    typedef std::pair<const uint64_t, uint64_t> Item;
+    vector<uint64_t> keys = randomKeys(n, 1);
+
+    benchAllocator<BinarySearchTree<uint64_t, uint64_t> >("bst", keys);
+    benchAllocator<BinarySearchTree<uint64_t, uint64_t, std::less<uint64_t>, SlabAllocator<Item> > >("bst+slab", keys);
+    benchAllocator<AVLTree<uint64_t, uint64_t> >("avl", keys);
+    benchAllocator<AVLTree<uint64_t, uint64_t, std::less<uint64_t>, SlabAllocator<Item> > >("avl+slab", keys);
+}
+
+// Rebuilding from a sorted dump: n inserts versus one assign()
+void bulkScenario(size_t n)
+{
+    vector<std::pair<uint64_t, uint64_t> > dump(n);
+    for(size_t i = 0; i < n; ++i) {
+        dump[i] = std::make_pair(i * 2, i);
+    }
+
+    {
+        AVLTree<uint64_t, uint64_t> avl;
+        Timer build;
+        for(size_t i = 0; i < n; ++i) {
+            avl.insert(dump[i]);
+        }
+        report("avl", "insert", build.nsPer(n));
+    }
+    {
+        AVLTree<uint64_t, uint64_t> avl;
+        Timer build;
+        avl.assign(dump.begin(), dump.end());
+        report("avl", "assign", build.nsPer(n));
+    }
+}
+
+// Counts key comparisons so descents can be compared independently of timing
+static size_t comparisons;
+
+struct CountingLess
+{
+    template<typename T>
+    bool operator()(const T& a, const T& b) const
+    {
+        ++comparisons;
+        return a < b;
+    }
+};
+
+// Long keys sharing a prefix, where each comparison costs a real memcmp
+vector<string> stringKeys(size_t n)
+{
+    vector<uint64_t> raw = randomKeys(n, 1);
+    vector<string> keys(n);
+    for(size_t i = 0; i < n; ++i) {
+        keys[i] = "customer/region/account/" + to_string(raw[i]);
+    }
+    return keys;
+}
+
+template<typename Tree>
+void benchCompare(const string& engine, const vector<string>& keys, const vector<string>& probes)
+{
+    Tree tree;
+    comparisons = 0;
+    Timer build;
+    for(size_t i = 0; i < keys.size(); ++i) {
+        tree.insert(std::make_pair(keys[i], i));
+    }
+    report(engine, "insert", build.nsPer(keys.size()));
+    report(engine, "insert cmp", double(comparisons) / keys.size(), "cmp/op");
+
+    uint64_t sum = 0;
+    comparisons = 0;
+    Timer lookup;
+    for(size_t i = 0; i < probes.size(); ++i) {
+        sum += tree.find(probes[i])->second;
+    }
+    report(engine, "find", lookup.nsPer(probes.size()));
+    report(engine, "find cmp", double(comparisons) / probes.size(), "cmp/op");
+    sink = sum;
+}
+
+// String keys with a counting comparator, reporting comparisons per operation
+void compareScenario(size_t n)
+{
+    vector<string> keys = stringKeys(n);
+    vector<string> probes(keys);
+    shuffle(probes.begin(), probes.end(), mt19937_64(2));
+
+    benchCompare<AVLTree<string, uint64_t, CountingLess> >("avl", keys, probes);
+    benchCompare<map<string, uint64_t, CountingLess> >("std::map", keys, probes);
+}
+
+// A string payload that counts how often it is copied and moved
+static size_t copies, moves;
+
+struct Counted
+{
+    string text;
+
+    explicit Counted(const string& s) : text(s) { }
+    Counted(const Counted& other) : text(other.text) { ++copies; }
+    Counted(Counted&& other) : text(std::move(other.text)) { ++moves; }
+    Counted& operator=(const Counted& other) { text = other.text; ++copies; return *this; }
+    Counted& operator=(Counted&& other) { text = std::move(other.text); ++moves; return *this; }
+    bool operator<(const Counted& rhs) const { return text < rhs.text; }
+};
+
+// Needed by the trees' print()
+ostream& operator<<(ostream& out, const Counted& c)
+{
+    return out << c.text;
+}
+
+// Runs insertFn for every key into a fresh tree and reports time plus
+// copies and moves of key and value per insert, including whatever the
+// caller does to build the argument
+template<typename Tree, typename InsertFn>
+void benchMoves(const string& engine, const string& op, const vector<string>& keys, InsertFn insertFn)
+{
+    Counted payload(string(200, 'v'));
+    Tree tree;
+    copies = moves = 0;
+    Timer build;
+    for(size_t i = 0; i < keys.size(); ++i) {
+        insertFn(tree, keys[i], payload);
+    }
+    double ns = build.nsPer(keys.size());
+    report(engine, op, ns);
+    report(engine, op, double(copies) / keys.size(), "copies/op");
+    report(engine, op, double(moves) / keys.size(), "moves/op");
+}
+
+// Large string keys and values, inserted through each insert flavor
+void moveScenario(size_t n)
+{
+    vector<string> keys = stringKeys(n);
+    typedef AVLTree<Counted, Counted> Tree;
+    typedef map<Counted, Counted> Map;
+
+    benchMoves<Tree>("avl", "insert(&)", keys, [](Tree& t, const string& k, const Counted& v) {
+        const std::pair<const Counted, Counted> item(Counted(k), v);
+        t.insert(item);
+    });
+    benchMoves<Tree>("avl", "insert(&&)", keys, [](Tree& t, const string& k, const Counted& v) {
+        t.insert(std::make_pair(Counted(k), Counted(v.text)));
+    });
+    benchMoves<Tree>("avl", "emplace", keys, [](Tree& t, const string& k, const Counted& v) {
+        t.emplace(std::piecewise_construct, std::forward_as_tuple(k), std::forward_as_tuple(v.text));
+    });
+    benchMoves<Tree>("avl", "try_emplace", keys, [](Tree& t, const string& k, const Counted& v) {
+        t.try_emplace(Counted(k), v.text);
+    });
+    benchMoves<Map>("std::map", "emplace", keys, [](Map& m, const string& k, const Counted& v) {
+        m.emplace(std::piecewise_construct, std::forward_as_tuple(k), std::forward_as_tuple(v.text));
+    });
+    benchMoves<Map>("std::map", "try_emplace", keys, [](Map& m, const string& k, const Counted& v) {
+        m.try_emplace(Counted(k), v.text);
+    });
+}
+
+// Exposes O(1) appends so a degenerate tree of any size can be built
+// without the O(n^2) cost of inserting sorted keys one descent at a time
+class ChainTree : public BinarySearchTree<uint64_t, uint64_t>
+{
+public:
+    ChainTree() : end_(nullptr) { }
+
+    // Links key as the new largest (right chain) or smallest (left chain) key
+    void extend(uint64_t key, bool rightward)
+    {
+        Node<uint64_t, uint64_t>* node = createNode(forwardItem<uint64_t, uint64_t>(key, key), end_);
+        linkNode(end_, !rightward, node);
+        end_ = node;
+    }
+
+private:
+    Node<uint64_t, uint64_t>* end_;
+};
+
+// Builds linked-list shaped trees of depth n and times their teardown,
+// which used to recurse once per level and overflow the stack
+void teardownScenario(size_t n)
+{
+    {
+        ChainTree chain;
+        for(size_t i = 0; i < n; ++i) {
+            chain.extend(i, true);
+        }
+        Timer teardown;
+        chain.clear();
+        report("bst", "clear right", teardown.nsPer(n));
+    }
+    {
+        Timer teardown;
+        {
+            ChainTree chain;
+            for(size_t i = 0; i < n; ++i) {
+                chain.extend(n - i, false);
+            }
+            teardown = Timer();
+        }
+        report("bst", "~ left", teardown.nsPer(n));
+    }
+    {
+        AVLTree<uint64_t, uint64_t> avl;
+        vector<uint64_t> keys = randomKeys(n, 1);
+        for(size_t i = 0; i < n; ++i) {
+            avl.insert(std::make_pair(keys[i], keys[i]));
+        }
+        Timer teardown;
+        avl.clear();
+        report("avl", "clear", teardown.nsPer(n));
+    }
+}
+
+// Times the health checks on a random AVL tree and on a degenerate chain
+void checkScenario(size_t n)
+{
+    {
+        AVLTree<uint64_t, uint64_t> avl;
+        vector<uint64_t> keys = randomKeys(n, 1);
+        for(size_t i = 0; i < n; ++i) {
+            avl.insert(std::make_pair(keys[i], keys[i]));
+        }
+        Timer balanced;
+        bool ok = avl.isBalanced();
+        report("avl", "isBalanced", balanced.nsPer(n));
+        Timer validate;
+        ok = avl.validate() && ok;
+        report("avl", "validate", validate.nsPer(n));
+        sink = ok;
+    }
+    {
+        ChainTree chain;
+        for(size_t i = 0; i < n; ++i) {
+            chain.extend(i, true);
+        }
+        Timer balanced;
+        sink = chain.isBalanced();
+        report("bst", "isBalanced", balanced.nsPer(n));
+    }
+}
+
+// The trees call it remove(), std::map calls it erase()
+template<typename Tree>
+void eraseKey(Tree& tree, uint64_t key)
+{
+    tree.remove(key);
+}
+
+void eraseKey(map<uint64_t, uint64_t>& tree, uint64_t key)
+{
+    tree.erase(key);
+}
+
+// Lookup benchmark plus removing every key in random order
+template<typename Tree>
+void benchEngine(const string& engine, const vector<uint64_t>& keys, const vector<uint64_t>& probes)
+{
+    Tree tree;
+    benchLookup(engine, tree, keys, probes);
+    Timer teardown;
+    for(size_t i = 0; i < probes.size(); ++i) {
+        eraseKey(tree, probes[i]);
+    }
+    report(engine, "remove", teardown.nsPer(probes.size()));
+}
+
+// The B-tree engine side by side with the AVL tree and std::map
+void btreeScenario(size_t n)
+{
+    vector<uint64_t> keys = randomKeys(n, 1);
+    vector<uint64_t> probes(keys);
+    shuffle(probes.begin(), probes.end(), mt19937_64(2));
+
+    benchEngine<AVLTree<uint64_t, uint64_t> >("avl", keys, probes);
+    benchEngine<BTreeMap<uint64_t, uint64_t> >("btree", keys, probes);
+    benchEngine<map<uint64_t, uint64_t> >("std::map", keys, probes);
+}
+
+// Read-only tier: the AVL tree against its frozen Eytzinger snapshot
+void frozenScenario(size_t n)
+{
+    vector<uint64_t> keys = randomKeys(n, 1);
+    vector<uint64_t> probes(keys);
+    shuffle(probes.begin(), probes.end(), mt19937_64(2));
+
+    AVLTree<uint64_t, uint64_t> avl;
+    benchLookup("avl", avl, keys, probes);
+
+    Timer freeze;
+    FrozenMap<uint64_t, uint64_t> frozen = avl.freeze();
+    report("frozen", "freeze", freeze.nsPer(n));
+
+    uint64_t sum = 0;
+    Timer lookup;
+    for(size_t i = 0; i < probes.size(); ++i) {
+        sum += frozen.find(probes[i])->second;
+    }
+    report("frozen", "find", lookup.nsPer(probes.size()));
+
+    Timer scan;
+    for(FrozenMap<uint64_t, uint64_t>::const_iterator it = frozen.begin(); it != frozen.end(); ++it) {
+        sum += it->first;
+    }
+    report("frozen", "iterate", scan.nsPer(n));
+    sink = sum;
+}
+
+// Lookups in batches, as a request handler would issue them: find() in a
+// loop versus one find_many() per batch
+void batchScenario(size_t n)
+{
+    const size_t batch = 256;
+    vector<uint64_t> keys = randomKeys(n, 1);
+    vector<uint64_t> probes(keys);
+    shuffle(probes.begin(), probes.end(), mt19937_64(2));
+
+    AVLTree<uint64_t, uint64_t> avl;
+    for(size_t i = 0; i < n; ++i) {
+        avl.insert(std::make_pair(keys[i], keys[i]));
+    }
+
+    uint64_t sum = 0;
+    Timer single;
+    for(size_t i = 0; i < probes.size(); ++i) {
+        sum += avl.find(probes[i])->second;
+    }
+    report("avl", "find", single.nsPer(probes.size()));
+
+    vector<uint64_t> batchKeys;
+    vector<AVLTree<uint64_t, uint64_t>::iterator> found;
+    Timer many;
+    for(size_t i = 0; i < probes.size(); i += batch) {
+        batchKeys.assign(probes.begin() + i, probes.begin() + min(i + batch, probes.size()));
+        avl.find_many(batchKeys, found);
+        for(size_t j = 0; j < found.size(); ++j) {
+            sum += found[j]->second;
+        }
+    }
+    report("avl", "find_many", many.nsPer(probes.size()));
+    sink = sum;
+}
+
+// The AVL tree behind one global lock, as the baseline for concurrent reads
+class LockedAVL
+{
+public:
+    void insert(const pair<const uint64_t, uint64_t>& item)
+    {
+        lock_guard<mutex> lock(lock_);
+        tree_.insert(item);
+    }
+    void remove(uint64_t key)
+    {
+        lock_guard<mutex> lock(lock_);
+        tree_.remove(key);
+    }
+    bool find(uint64_t key, uint64_t& value)
+    {
+        lock_guard<mutex> lock(lock_);
+        AVLTree<uint64_t, uint64_t>::iterator it = tree_.find(key);
+        if(it == tree_.end()) {
+            return false;
+        }
+        value = it->second;
+        return true;
+    }
+private:
+    mutex lock_;
+    AVLTree<uint64_t, uint64_t> tree_;
+};
+
+// Runs readers threads doing random finds for a fixed time while one
+// writer keeps inserting and removing other keys; reports total reads/s
+template<typename Map>
+void benchReaders(const string& engine, Map& map, const vector<uint64_t>& keys,
+                  const vector<uint64_t>& churn, size_t readers)
+{
+    atomic<bool> stop(false);
+    atomic<uint64_t> reads(0);
+    atomic<uint64_t> writes(0);
+
+    vector<thread> threads;
+    for(size_t r = 0; r < readers; ++r) {
+        threads.push_back(thread([&, r]() {
+            mt19937_64 rng(r + 1);
+            uint64_t done = 0, sum = 0, value;
+            while(!stop.load(memory_order_relaxed)) {
+                for(int i = 0; i < 64; ++i) {
+                    if(map.find(keys[rng() % keys.size()], value)) {
+                        sum += value;
+                    }
+                }
+                done += 64;
+            }
+            reads += done;
+            sink = sum;
+        }));
+    }
+    threads.push_back(thread([&]() {
+        uint64_t done = 0;
+        while(!stop.load(memory_order_relaxed)) {
+            for(size_t i = 0; i < churn.size() && !stop.load(memory_order_relaxed); ++i, ++done) {
+                map.insert(make_pair(churn[i], churn[i]));
+            }
+            for(size_t i = 0; i < churn.size() && !stop.load(memory_order_relaxed); ++i, ++done) {
+                map.remove(churn[i]);
+            }
+        }
+        writes += done;
+    }));
+
+    Timer timer;
+    this_thread::sleep_for(chrono::milliseconds(250));
+    stop = true;
+    for(size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+    double seconds = timer.nsPer(1) / 1e9;
+    report(engine, to_string(readers) + " readers", reads / seconds / 1e6, "Mreads/s");
+    report(engine, "  writer", writes / seconds / 1e6, "Mwrites/s");
+}
+
+// Read throughput from 1 to 64 reader threads next to a single writer:
+// lock-free readers against a mutex around the sequential tree
+void readersScenario(size_t n)
+{
+    vector<uint64_t> keys = randomKeys(n, 1);
+    vector<uint64_t> churn = randomKeys(min<size_t>(n, 100000), 3);
+
+    ConcurrentAVLTree<uint64_t, uint64_t> concurrent;
+    LockedAVL locked;
+    for(size_t i = 0; i < n; ++i) {
+        concurrent.insert(make_pair(keys[i], keys[i]));
+        locked.insert(make_pair(keys[i], keys[i]));
+    }
+    cout << "hardware threads: " << thread::hardware_concurrency() << endl;
+
+    for(size_t readers = 1; readers <= 64; readers *= 2) {
+        benchReaders("concurrent", concurrent, keys, churn, readers);
+        benchReaders("locked", locked, keys, churn, readers);
+    }
+}
+
+// Runs threads that each pick find, insert or remove at random in the given
+// percentages over the keys for a fixed time; reports total ops/s
+template<typename Map>
+void benchMixed(const string& engine, Map& map, const vector<uint64_t>& keys,
+                size_t threads, unsigned findPercent, unsigned insertPercent)
+{
+    atomic<bool> stop(false);
+    atomic<uint64_t> ops(0);
+
+    vector<thread> workers;
+    for(size_t t = 0; t < threads; ++t) {
+        workers.push_back(thread([&, t]() {
+            mt19937_64 rng(t + 1);
+            uint64_t done = 0, sum = 0, value;
+            while(!stop.load(memory_order_relaxed)) {
+                for(int i = 0; i < 64; ++i) {
+                    uint64_t draw = rng();
+                    uint64_t key = keys[(draw >> 8) % keys.size()];
+                    unsigned pick = draw % 100;
+                    if(pick < findPercent) {
+                        if(map.find(key, value)) {
+                            sum += value;
+                        }
+                    }
+                    else if(pick < findPercent + insertPercent) {
+                        map.insert(make_pair(key, key));
+                    }
+                    else {
+                        map.remove(key);
+                    }
+                }
+                done += 64;
+            }
+            ops += done;
+            sink = sum;
+        }));
+    }
+
+    Timer timer;
+    this_thread::sleep_for(chrono::milliseconds(250));
+    stop = true;
+    for(size_t i = 0; i < workers.size(); ++i) {
+        workers[i].join();
+    }
+    double seconds = timer.nsPer(1) / 1e9;
+    report(engine, to_string(threads) + " threads", ops / seconds / 1e6, "Mops/s");
+}
+
+// Mixed reads and writes from 1 to 64 threads, all of them writing: the
+// fine-grained tree against a mutex around the sequential tree, for a
+// read-mostly and a write-heavy mix over half-full key space
+void mixedScenario(size_t n)
+{
+    vector<uint64_t> keys = randomKeys(n, 1);
+    const unsigned mixes[][2] = { {90, 5}, {50, 25} };
+
+    cout << "hardware threads: " << thread::hardware_concurrency() << endl;
+    for(size_t m = 0; m < 2; ++m) {
+        cout << mixes[m][0] << "% find, " << mixes[m][1] << "% insert, "
+             << 100 - mixes[m][0] - mixes[m][1] << "% remove" << endl;
+        ConcurrentAVLTree<uint64_t, uint64_t> concurrent;
+        LockedAVL locked;
+        for(size_t i = 0; i < n; i += 2) {
+            concurrent.insert(make_pair(keys[i], keys[i]));
+            locked.insert(make_pair(keys[i], keys[i]));
+        }
+        for(size_t threads = 1; threads <= 64; threads *= 2) {
+            benchMixed("concurrent", concurrent, keys, threads, mixes[m][0], mixes[m][1]);
+            benchMixed("locked", locked, keys, threads, mixes[m][0], mixes[m][1]);
+        }
+    }
+}
+
+// Writes to a persistent tree: alone, where nodes are updated in place, and
+// with a snapshot taken before every write, so each write copies its path
+void snapshotScenario(size_t n)
+{
+    vector<uint64_t> keys = randomKeys(n, 1);
+
+    Timer avlInsert;
+    AVLTree<uint64_t, uint64_t> avl;
+    for(size_t i = 0; i < n; ++i) {
+        avl.insert(make_pair(keys[i], keys[i]));
+    }
+    report("avl", "insert", avlInsert.nsPer(n));
+
+    Timer alone;
+    PersistentAVLTree<uint64_t, uint64_t> tree;
+    for(size_t i = 0; i < n; ++i) {
+        tree.insert(make_pair(keys[i], keys[i]));
+    }
+    report("persistent", "insert", alone.nsPer(n));
+
+    Timer snapshots;
+    PersistentAVLTree<uint64_t, uint64_t> versioned;
+    PersistentAVLTree<uint64_t, uint64_t> previous;
+    for(size_t i = 0; i < n; ++i) {
+        previous = versioned.snapshot();
+        versioned.insert(make_pair(keys[i], keys[i]));
+    }
+    report("persistent", "snap+insert", snapshots.nsPer(n));
+
+    uint64_t sum = 0;
+    Timer lookup;
+    for(size_t i = 0; i < n; ++i) {
+        sum += versioned[keys[i]];
+    }
+    report("persistent", "find", lookup.nsPer(n));
+    sink = sum + previous.size();
+}
+
+// Set operations between a tree of n keys and one of m = n / ratio keys,
+// join-based against applying the smaller tree to the larger key by key.
+// Each starts from a fresh copy of the larger tree, made outside the timer.
+// The join-based versions fork near the top when there are cores to use
+void setopsScenario(size_t n)
+{
+    vector<uint64_t> keys = randomKeys(n, 1);
+    AVLTree<uint64_t, uint64_t> big;
+    for(size_t i = 0; i < n; ++i) {
+        big.insert(make_pair(keys[i], keys[i]));
+    }
+
+    const size_t ratios[] = { 1, 100 };
+    for(size_t r = 0; r < sizeof(ratios) / sizeof(ratios[0]); ++r) {
+        size_t m = n / ratios[r];
+        // Half of the small tree's keys are in the big tree
+        vector<uint64_t> others = randomKeys(m, 2);
+        for(size_t i = 0; i < m; i += 2) {
+            others[i] = keys[i];
+        }
+        AVLTree<uint64_t, uint64_t> small;
+        for(size_t i = 0; i < m; ++i) {
+            small.insert(make_pair(others[i], others[i]));
+        }
+        string suffix = "/" + to_string(ratios[r]);
+        AVLTree<uint64_t, uint64_t> target;
+
+        target.union_with(big);
+        Timer unionJoin;
+        target.union_with(small);
+        report("join", "union" + suffix, unionJoin.nsPer(m));
+
+        target.clear();
+        target.union_with(big);
+        Timer unionKeys;
+        for(size_t i = 0; i < m; ++i) {
+            target.insert(make_pair(others[i], others[i]));
+        }
+        report("per-key", "union" + suffix, unionKeys.nsPer(m));
+
+        target.clear();
+        target.union_with(big);
+        Timer intersectJoin;
+        target.intersect_with(small);
+        report("join", "intersect" + suffix, intersectJoin.nsPer(m));
+
+        // Key by key, the intersection is built up from the hits; in place,
+        // the larger tree's other nodes are freed, which shows at ratio 100
+        target.clear();
+        Timer intersectKeys;
+        for(size_t i = 0; i < m; ++i) {
+            if(big.find(others[i]) != big.end()) {
+                target.insert(make_pair(others[i], others[i]));
+            }
+        }
+        report("per-key", "intersect" + suffix, intersectKeys.nsPer(m));
+
+        target.clear();
+        target.union_with(big);
+        Timer differenceJoin;
+        target.difference_with(small);
+        report("join", "difference" + suffix, differenceJoin.nsPer(m));
+
+        target.clear();
+        target.union_with(big);
+        Timer differenceKeys;
+        for(size_t i = 0; i < m; ++i) {
+            target.remove(others[i]);
+        }
+        report("per-key", "difference" + suffix, differenceKeys.nsPer(m));
+        target.clear();
+    }
+
+    // Cutting the big tree in two and putting it back together
+    AVLTree<uint64_t, uint64_t> upper;
+    const size_t cuts = 1000;
+    Timer split;
+    for(size_t i = 0; i < cuts; ++i) {
+        big.split(keys[i], upper);
+        big.join(big, upper);
+    }
+    report("join", "split+join", split.nsPer(cuts));
+    sink = big.validate();
+}
+
+// Sorted batches of upserts (two thirds) and deletes applied to a tree of
+// n keys, through apply_sorted_batch() against one insert/remove per op.
+// Both trees get the same batches, so they stay the same size
+void ingestScenario(size_t n)
+{
+    vector<uint64_t> keys = randomKeys(n, 1);
+    AVLTree<uint64_t, uint64_t> perKey;
+    AVLTree<uint64_t, uint64_t> batched;
+    for(size_t i = 0; i < n; ++i) {
+        perKey.insert(make_pair(keys[i], keys[i]));
+        batched.insert(make_pair(keys[i], keys[i]));
+    }
+
+    mt19937_64 rng(2);
+    for(size_t size = 100; size <= 1000000; size *= 10) {
+        // Deletes hit existing keys; upserts are half new, half updates
+        vector<BatchOp<uint64_t, uint64_t> > ops(size);
+        for(size_t i = 0; i < size; ++i) {
+            uint64_t key = (i % 2) ? keys[rng() % n] : rng();
+            ops[i].item = make_pair(key, key);
+            ops[i].erase = (i % 3 == 0);
+        }
+        sort(ops.begin(), ops.end(),
+             [](const BatchOp<uint64_t, uint64_t>& a, const BatchOp<uint64_t, uint64_t>& b) {
+                 return a.item.first < b.item.first;
+             });
+        string batch = "batch/" + to_string(size);
+
+        Timer single;
+        for(size_t i = 0; i < size; ++i) {
+            if(ops[i].erase) {
+                perKey.remove(ops[i].item.first);
+            }
+            else {
+                perKey.insert(ops[i].item);
+            }
+        }
+        report("per-key", batch, single.nsPer(size));
+
+        Timer applied;
+        batched.apply_sorted_batch(ops);
+        report("apply", batch, applied.nsPer(size));
+    }
+    sink = batched.validate();
+}
+
+// Appending increasing keys, as timestamps arrive: a plain insert descends
+// from the root every time, a hinted one starts at end()
+void appendScenario(size_t n)
+{
+    Timer plain;
+    AVLTree<uint64_t, uint64_t> descended;
+    for(size_t i = 0; i < n; ++i) {
+        descended.insert(make_pair(uint64_t(i), uint64_t(i)));
+    }
+    report("avl", "insert", plain.nsPer(n));
+
+    Timer hinted;
+    AVLTree<uint64_t, uint64_t> appended;
+    for(size_t i = 0; i < n; ++i) {
+        appended.insert(appended.end(), make_pair(uint64_t(i), uint64_t(i)));
+    }
+    report("avl", "insert(end)", hinted.nsPer(n));
+
+    // Hinting at the node just inserted, as a stream of appends would
+    Timer chained;
+    AVLTree<uint64_t, uint64_t> extended;
+    AVLTree<uint64_t, uint64_t>::iterator last = extended.end();
+    for(size_t i = 0; i < n; ++i) {
+        last = extended.insert(last, make_pair(uint64_t(i), uint64_t(i)));
+    }
+    report("avl", "insert(last)", chained.nsPer(n));
+
+    Timer stdHinted;
+    map<uint64_t, uint64_t> stdMap;
+    for(size_t i = 0; i < n; ++i) {
+        stdMap.insert(stdMap.end(), make_pair(uint64_t(i), uint64_t(i)));
+    }
+    report("std::map", "insert(end)", stdHinted.nsPer(n));
+
+    // Keys that only compare slowly make the saved comparisons show
+    vector<string> keys(min(n, size_t(1000000)));
+    for(size_t i = 0; i < keys.size(); ++i) {
+        ostringstream key;
+        key << "2024-01-01T00:00:00." << setw(9) << setfill('0') << i;
+        keys[i] = key.str();
+    }
+    Timer plainStrings;
+    AVLTree<string, uint64_t> descendedStrings;
+    for(size_t i = 0; i < keys.size(); ++i) {
+        descendedStrings.insert(make_pair(keys[i], uint64_t(i)));
+    }
+    report("avl", "insert/str", plainStrings.nsPer(keys.size()));
+
+    Timer hintedStrings;
+    AVLTree<string, uint64_t> appendedStrings;
+    for(size_t i = 0; i < keys.size(); ++i) {
+        appendedStrings.insert(appendedStrings.end(), make_pair(keys[i], uint64_t(i)));
+    }
+    report("avl", "insert(end)/str", hintedStrings.nsPer(keys.size()));
+    sink = appended.validate() + extended.validate() + appendedStrings.validate();
+}
+
+// Bytes and calls handed out by CountingAllocator, across every rebinding
+struct AllocationCount
+{
+    static size_t bytes, calls;
+};
+size_t AllocationCount::bytes, AllocationCount::calls;
+
+template<typename T>
+struct CountingAllocator
+{
+    typedef T value_type;
+
+    CountingAllocator() { }
+    template<typename U>
+    CountingAllocator(const CountingAllocator<U>&) { }
+
+    T* allocate(size_t count)
+    {
+        AllocationCount::bytes += count * sizeof(T);
+        ++AllocationCount::calls;
+        return std::allocator<T>().allocate(count);
+    }
+    void deallocate(T* p, size_t count)
+    {
+        std::allocator<T>().deallocate(p, count);
+    }
+};
+
+template<typename T, typename U>
+bool operator==(const CountingAllocator<T>&, const CountingAllocator<U>&) { return true; }
+template<typename T, typename U>
+bool operator!=(const CountingAllocator<T>&, const CountingAllocator<U>&) { return false; }
+
+// Fills the tree and reports what the allocator handed out per item. The
+// figures leave out malloc's own header and rounding, which cost the
+// node-per-allocation trees another 8 to 16 bytes a node.
+template<typename Tree>
+void benchMemory(const string& engine, const vector<uint64_t>& keys)
+{
+    AllocationCount::bytes = AllocationCount::calls = 0;
+    Tree tree;
+    for(size_t i = 0; i < keys.size(); ++i) {
+        tree.insert(std::make_pair(keys[i], keys[i]));
+    }
+    report(engine, "bytes", double(AllocationCount::bytes) / keys.size(), "bytes/item");
+    report(engine, "allocs", double(AllocationCount::calls) / keys.size(), "allocs/item");
+}
+
+// Memory per item for each engine, then lookups in the AVL tree against
+// its compact, index-linked counterpart
+void memoryScenario(size_t n)
+{
+    typedef CountingAllocator<std::pair<const uint64_t, uint64_t> > Counting;
+    vector<uint64_t> keys = randomKeys(n, 1);
+    vector<uint64_t> probes(keys);
+    shuffle(probes.begin(), probes.end(), mt19937_64(2));
+
+    benchMemory<AVLTree<uint64_t, uint64_t, std::less<uint64_t>, Counting> >("avl", keys);
+    benchMemory<BTreeMap<uint64_t, uint64_t, std::less<uint64_t>, Counting> >("btree", keys);
+    benchMemory<CompactAVLTree<uint64_t, uint64_t, std::less<uint64_t>, Counting> >("compact", keys);
+    benchMemory<map<uint64_t, uint64_t, std::less<uint64_t>, Counting> >("std::map", keys);
+
+    benchEngine<AVLTree<uint64_t, uint64_t> >("avl", keys, probes);
+    benchEngine<CompactAVLTree<uint64_t, uint64_t> >("compact", keys, probes);
+}
+
+// An object that already lives in the caller's pool, as connections and
+// orders do, with a 64-byte payload riding along
+struct PooledOrder : IntrusiveAVLHook<>
+{
+    uint64_t id;
+    uint64_t fields[8];
+};
+
+struct PooledOrderId
+{
+    const uint64_t& operator()(const PooledOrder& order) const { return order.id; }
+};
+
+// AVLTree's print() needs to be able to stream a stored value
+ostream& operator<<(ostream& out, const PooledOrder& order)
+{
+    return out << order.id;
+}
+
+// Indexing pooled objects: AVLTree either copies each object into a node
+// of its own or holds a pointer to it there, while the intrusive tree
+// links the objects themselves
+void intrusiveScenario(size_t n)
+{
+    vector<uint64_t> keys = randomKeys(n, 1);
+    vector<uint64_t> probes(keys);
+    shuffle(probes.begin(), probes.end(), mt19937_64(2));
+    vector<PooledOrder> pool(n);
+    for(size_t i = 0; i < n; ++i) {
+        pool[i].id = keys[i];
+        pool[i].fields[0] = i;
+    }
+    uint64_t sum = 0;
+
+    {
+        AVLTree<uint64_t, PooledOrder> copied;
+        Timer build;
+        for(size_t i = 0; i < n; ++i) {
+            copied.insert(make_pair(pool[i].id, pool[i]));
+        }
+        report("avl/copy", "insert", build.nsPer(n));
+        Timer lookup;
+        for(size_t i = 0; i < n; ++i) {
+            sum += copied.find(probes[i])->second.fields[0];
+        }
+        report("avl/copy", "find", lookup.nsPer(n));
+        Timer teardown;
+        for(size_t i = 0; i < n; ++i) {
+            copied.remove(probes[i]);
+        }
+        report("avl/copy", "remove", teardown.nsPer(n));
+    }
+    {
+        AVLTree<uint64_t, PooledOrder*> indexed;
+        Timer build;
+        for(size_t i = 0; i < n; ++i) {
+            indexed.insert(make_pair(pool[i].id, &pool[i]));
+        }
+        report("avl/ptr", "insert", build.nsPer(n));
+        Timer lookup;
+        for(size_t i = 0; i < n; ++i) {
+            sum += indexed.find(probes[i])->second->fields[0];
+        }
+        report("avl/ptr", "find", lookup.nsPer(n));
+        Timer teardown;
+        for(size_t i = 0; i < n; ++i) {
+            indexed.remove(probes[i]);
+        }
+        report("avl/ptr", "remove", teardown.nsPer(n));
+    }
+    {
+        IntrusiveAVLTree<PooledOrder, uint64_t, PooledOrderId> linked;
+        Timer build;
+        for(size_t i = 0; i < n; ++i) {
+            linked.insert(pool[i]);
+        }
+        report("intrusive", "insert", build.nsPer(n));
+        Timer lookup;
+        for(size_t i = 0; i < n; ++i) {
+            sum += linked.find(probes[i])->fields[0];
+        }
+        report("intrusive", "find", lookup.nsPer(n));
+        Timer teardown;
+        for(size_t i = 0; i < n; ++i) {
+            linked.remove(probes[i]);
+        }
+        report("intrusive", "remove", teardown.nsPer(n));
+        Timer relink;
+        for(size_t i = 0; i < n; ++i) {
+            linked.insert(pool[i]);
+        }
+        for(size_t i = 0; i < n; ++i) {
+            linked.unlink(pool[n - 1 - i]);
+        }
+        report("intrusive", "link+unlink", relink.nsPer(n));
+    }
+    sink = sum;
+}
+
+// A value of Bytes bytes, as with the 200-byte records some maps hold
+template<size_t Bytes>
+struct Payload
+{
+    uint64_t words[Bytes / sizeof(uint64_t)];
+};
+
+// Times random successful lookups that read the first word of the value
+template<typename Tree>
+void benchValueLookup(const string& engine, const string& op, const vector<uint64_t>& keys,
+                      const vector<uint64_t>& probes)
+{
+    typedef typename std::remove_reference<decltype(Tree().begin()->second)>::type ValueType;
+    Tree tree;
+    ValueType value = ValueType();
+    for(size_t i = 0; i < keys.size(); ++i) {
+        value.words[0] = keys[i];
+        tree.insert(std::make_pair(keys[i], value));
+    }
+    uint64_t sum = 0;
+    Timer lookup;
+    for(size_t i = 0; i < probes.size(); ++i) {
+        sum += tree.find(probes[i])->second.words[0];
+    }
+    report(engine, op, lookup.nsPer(probes.size()));
+    sink = sum;
+}
+
+template<size_t Bytes>
+void benchValueSize(const vector<uint64_t>& keys, const vector<uint64_t>& probes)
+{
+    typedef std::pair<const uint64_t, Payload<Bytes> > Item;
+    string op = "find/" + to_string(Bytes) + "B";
+    benchValueLookup<CompactAVLTree<uint64_t, Payload<Bytes>, std::less<uint64_t>,
+                                    std::allocator<Item>, InlineValues> >("inline", op, keys, probes);
+    benchValueLookup<CompactAVLTree<uint64_t, Payload<Bytes>, std::less<uint64_t>,
+                                    std::allocator<Item>, SeparateValues> >("separate", op, keys, probes);
+}
+
+// Lookup cost against value size, with values in the nodes and in an
+// arena beside them; n is capped so the largest values still fit in memory
+void valuesScenario(size_t n)
+{
+    n = min(n, size_t(1000000));
+    vector<uint64_t> keys = randomKeys(n, 1);
+    vector<uint64_t> probes(keys);
+    shuffle(probes.begin(), probes.end(), mt19937_64(2));
+
+    benchValueSize<8>(keys, probes);
+    benchValueSize<64>(keys, probes);
+    benchValueSize<200>(keys, probes);
+    benchValueSize<512>(keys, probes);
+}
+
+// Restarting from disk: re-inserting every key, as from a text dump,
+// against mapping a saved image. The image was just written, so its pages
+// are still in the page cache; the first lookups only pay for mapping
+// them in
+void imageScenario(size_t n)
+{
+    const string path = "bst-bench.img";
+    vector<uint64_t> keys = randomKeys(n, 1);
+    vector<uint64_t> probes(keys);
+    shuffle(probes.begin(), probes.end(), mt19937_64(2));
+
+    Timer rebuild;
+    AVLTree<uint64_t, uint64_t> avl;
+    for(size_t i = 0; i < n; ++i) {
+        avl.insert(make_pair(keys[i], keys[i]));
+    }
+    double rebuilt = rebuild.nsPer(1);
+    report("avl", "insert all", rebuilt / 1e6, "ms");
+
+    Timer save;
+    avl.save(path);
+    report("avl", "save", save.nsPer(1) / 1e6, "ms");
+
+    Timer load;
+    FrozenMap<uint64_t, uint64_t> mapped = AVLTree<uint64_t, uint64_t>::load_mapped(path);
+    report("mapped", "load_mapped", load.nsPer(1) / 1e6, "ms");
+
+    uint64_t sum = 0;
+    Timer first;
+    for(size_t i = 0; i < probes.size(); ++i) {
+        sum += mapped.find(probes[i])->second;
+    }
+    report("mapped", "find (1st)", first.nsPer(probes.size()));
+
+    Timer lookup;
+    for(size_t i = 0; i < probes.size(); ++i) {
+        sum += mapped.find(probes[i])->second;
+    }
+    report("mapped", "find", lookup.nsPer(probes.size()));
+
+    Timer scan;
+    for(FrozenMap<uint64_t, uint64_t>::const_iterator it = mapped.begin(); it != mapped.end(); ++it) {
+        sum += it->first;
+    }
+    report("mapped", "iterate", scan.nsPer(n));
+    sink = sum;
+    remove(path.c_str());
+}
+
+// Inserting m keys through a LoggedAVLTree under one sync policy and group
+// size, against the same keys in a plain AVLTree. fsync dominates small
+// groups, so callers cap m for those
+void benchLogged(const string& engine, const vector<uint64_t>& keys, size_t m, const LogOptions& options)
+{
+    const string logPath = "bst-bench.wal", snapshotPath = "bst-bench.img";
+    remove(logPath.c_str());
+    Timer insert;
+    {
+        LoggedAVLTree<uint64_t, uint64_t> logged(snapshotPath, logPath, options);
+        for(size_t i = 0; i < m; ++i) {
+            logged.insert(make_pair(keys[i], keys[i]));
+        }
+        logged.commit();
+        sink = logged.tree().begin()->first;
+    }
+    report(engine, "insert", insert.nsPer(m));
+    remove(logPath.c_str());
+}
+
+// The cost of logging each mutation before applying it, then of recovery:
+// replaying the log with one apply_sorted_batch against inserting its
+// records one at a time
+void walScenario(size_t n)
+{
+    const string logPath = "bst-bench.wal", snapshotPath = "bst-bench.img";
+    vector<uint64_t> keys = randomKeys(n, 1);
+    remove(snapshotPath.c_str());
+
+    Timer plain;
+    {
+        AVLTree<uint64_t, uint64_t> avl;
+        for(size_t i = 0; i < n; ++i) {
+            avl.insert(make_pair(keys[i], keys[i]));
+        }
+        sink = avl.begin()->first;
+    }
+    report("avl", "insert", plain.nsPer(n));
+
+    LogOptions options;
+    options.sync = LogSync::Never;
+    options.groupRecords = 1024;
+    benchLogged("never/1024", keys, n, options);
+
+    options.sync = LogSync::EveryCommit;
+    options.groupRecords = 1;
+    benchLogged("sync/1", keys, min<size_t>(n, 2000), options);
+    options.groupRecords = 64;
+    benchLogged("sync/64", keys, min<size_t>(n, 128000), options);
+    options.groupRecords = 1024;
+    benchLogged("sync/1024", keys, n, options);
+
+    options.sync = LogSync::Interval;
+    options.groupRecords = 64;
+    benchLogged("interval/64", keys, n, options);
+
+    // Leave a log of n inserts behind to recover from
+    options.sync = LogSync::Never;
+    options.groupRecords = 1024;
+    {
+        LoggedAVLTree<uint64_t, uint64_t> logged(snapshotPath, logPath, options);
+        for(size_t i = 0; i < n; ++i) {
+            logged.insert(make_pair(keys[i], keys[i]));
+        }
+    }
+
+    Timer replay;
+    {
+        WriteAheadLog<uint64_t, uint64_t> log(logPath, options);
+        vector<BatchOp<uint64_t, uint64_t> > ops = log.take_recovered();
+        AVLTree<uint64_t, uint64_t> avl;
+        for(size_t i = 0; i < ops.size(); ++i) {
+            avl.insert(ops[i].item);
+        }
+        sink = avl.begin()->first;
+    }
+    report("recover", "per record", replay.nsPer(1) / 1e6, "ms");
+
+    Timer bulk;
+    {
+        LoggedAVLTree<uint64_t, uint64_t> logged(snapshotPath, logPath, options);
+        sink = logged.tree().begin()->first;
+    }
+    report("recover", "bulk", bulk.nsPer(1) / 1e6, "ms");
+
+    remove(logPath.c_str());
+    remove(snapshotPath.c_str());
+}
+
+// Counts rotations through the augmentation hook: on the insert and remove
+// paths of AVLTree, RBTree and WAVLTree, pullUp is only called by a
+// rotation, twice per rotation
+static size_t pullUps;
+
+template<typename Base>
+struct RotationCounting : Base
+{
+    typedef uint64_t K;
+
+    RotationCounting(const K& key, const K& value, RotationCounting* parent) : Base(key, value, parent) { }
+    RotationCounting(const ItemBuilder<K, K>& builder, RotationCounting* parent) : Base(builder, parent) { }
+
+    RotationCounting* getParent() const { return static_cast<RotationCounting*>(Base::getParent()); }
+    RotationCounting* getLeft() const { return static_cast<RotationCounting*>(Base::getLeft()); }
+    RotationCounting* getRight() const { return static_cast<RotationCounting*>(Base::getRight()); }
+
+    void pullUp() { ++pullUps; }
+    void swapAugmentation(RotationCounting*) { }
+    static void adjustAncestors(RotationCounting*, int) { }
+};
+
+template<template<class, class, class, class, class> class Tree, template<class, class> class NodeType>
+struct Instrumented
+{
+    typedef Tree<uint64_t, uint64_t, CountingLess, allocator<pair<const uint64_t, uint64_t> >,
+                 RotationCounting<NodeType<uint64_t, uint64_t> > > type;
+};
+
+struct MixOp
+{
+    uint64_t key;
+    int op;     // 0 find, 1 insert, 2 remove
+};
+
+// n operations over a universe of keys: findPct percent finds and
+// insertPct percent inserts, the rest removes, each on a random key
+vector<MixOp> mixOps(const vector<uint64_t>& keys, size_t n, unsigned findPct, unsigned insertPct)
+{
+    mt19937_64 rng(3);
+    vector<MixOp> ops(n);
+    for(size_t i = 0; i < n; ++i) {
+        unsigned roll = rng() % 100;
+        ops[i].key = keys[rng() % keys.size()];
+        ops[i].op = roll < findPct ? 0 : roll < findPct + insertPct ? 1 : 2;
+    }
+    return ops;
+}
+
+template<typename Tree>
+void runMix(Tree& tree, const vector<MixOp>& ops)
+{
+    uint64_t found = 0;
+    for(size_t i = 0; i < ops.size(); ++i) {
+        if(ops[i].op == 0) {
+            found += tree.find(ops[i].key) != tree.end();
+        }
+        else if(ops[i].op == 1) {
+            tree.insert(make_pair(ops[i].key, ops[i].key));
+        }
+        else {
+            tree.remove(ops[i].key);
+        }
+    }
+    sink = found;
+}
+
+// Times the mix on the plain tree, then replays it on the instrumented one
+// for rotations and comparisons per operation
+template<typename Tree, typename Counted>
+void benchMix(const string& engine, const vector<uint64_t>& prefill, const vector<MixOp>& ops)
+{
+    {
+        Tree tree;
+        for(size_t i = 0; i < prefill.size(); ++i) {
+            tree.insert(make_pair(prefill[i], prefill[i]));
+        }
+        Timer timer;
+        runMix(tree, ops);
+        report(engine, "throughput", 1e6 / timer.nsPer(ops.size()), "kops/s");
+    }
+
+    Counted tree;
+    for(size_t i = 0; i < prefill.size(); ++i) {
+        tree.insert(make_pair(prefill[i], prefill[i]));
+    }
+    pullUps = 0;
+    comparisons = 0;
+    runMix(tree, ops);
+    report(engine, "rotations", 1000.0 * pullUps / 2 / ops.size(), "per 1k ops");
+    report(engine, "comparisons", double(comparisons) / ops.size(), "cmp/op");
+}
+
+// AVL against the red-black and weak AVL trees, whose updates do O(1)
+// rotations, under an insert-heavy, a delete-heavy and a read-heavy mix of
+// n operations over n keys. The delete-heavy mix starts full, the others
+// half full
+void rebalanceScenario(size_t n)
+{
+    vector<uint64_t> keys = randomKeys(n, 1);
+    vector<uint64_t> half(keys.begin(), keys.begin() + n / 2);
+    const unsigned mixes[][2] = { {10, 70}, {10, 20}, {90, 5} };
+    const char* names[] = { "insert-heavy", "delete-heavy", "read-heavy" };
+
+    for(size_t m = 0; m < 3; ++m) {
+        cout << names[m] << ": " << mixes[m][0] << "% find, " << mixes[m][1] << "% insert, "
+             << 100 - mixes[m][0] - mixes[m][1] << "% remove" << endl;
+        const vector<uint64_t>& prefill = m == 1 ? keys : half;
+        vector<MixOp> ops = mixOps(keys, n, mixes[m][0], mixes[m][1]);
+        benchMix<AVLTree<uint64_t, uint64_t>, Instrumented<AVLTree, AVLNode>::type>("avl", prefill, ops);
+        benchMix<RBTree<uint64_t, uint64_t>, Instrumented<RBTree, RBNode>::type>("rb", prefill, ops);
+        benchMix<WAVLTree<uint64_t, uint64_t>, Instrumented<WAVLTree, WAVLNode>::type>("wavl", prefill, ops);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    string scenario = argc > 1 ? argv[1] : "lookup";
+    size_t n = argc > 2 ? strtoull(argv[2], NULL, 10) : 10000000;
+
+    cout << "scenario " << scenario << ", n = " << n << endl;
+    if(scenario == "lookup") {
+        lookupScenario(n);
+    }
+    else if(scenario == "alloc") {
+        allocScenario(n);
+    }
+    else if(scenario == "bulk") {
+        bulkScenario(n);
+    }
+    else if(scenario == "compare") {
+        compareScenario(n);
+    }
+    else if(scenario == "move") {
+        moveScenario(n);
+    }
+    else if(scenario == "teardown") {
+        teardownScenario(n);
+    }
+    else if(scenario == "check") {
+        checkScenario(n);
+    }
+    else if(scenario == "btree") {
+        btreeScenario(n);
+    }
+    else if(scenario == "frozen") {
+        frozenScenario(n);
+    }
+    else if(scenario == "batch") {
+        batchScenario(n);
+    }
+    else if(scenario == "readers") {
+        readersScenario(n);
+    }
+    else if(scenario == "mixed") {
+        mixedScenario(n);
+    }
+    else if(scenario == "snapshot") {
+        snapshotScenario(n);
+    }
+    else if(scenario == "setops") {
+        setopsScenario(n);
+    }
+    else if(scenario == "ingest") {
+        ingestScenario(n);
+    }
+    else if(scenario == "append") {
+        appendScenario(n);
+    }
+    else if(scenario == "memory") {
+        memoryScenario(n);
+    }
+    else if(scenario == "intrusive") {
+        intrusiveScenario(n);
+    }
+    else if(scenario == "values") {
+        valuesScenario(n);
+    }
+    else if(scenario == "image") {
+        imageScenario(n);
+    }
+    else if(scenario == "wal") {
+        walScenario(n);
+    }
+    else if(scenario == "rebalance") {
+        rebalanceScenario(n);
+    }
+    else {
+        cerr << "Unknown scenario: " << scenario << endl;
+        return 1;
+    }
+    return 0;
+}
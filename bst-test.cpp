@@ -1,7 +1,22 @@
 #include <iostream>
 #include <map>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <stdexcept>
 #include "bst.h"
 #include "avlbst.h"
+#include "slab_alloc.h"
+#include "osavlbst.h"
+#include "btree.h"
+#include "concurrent_avl.h"
+#include "persistent_avl.h"
+#include "compact_avl.h"
+#include "intrusive_avl.h"
+#include "wal.h"
+#include "rbbst.h"
+#include "wavlbst.h"
 
 using namespace std;
 
@@ -26,6 +41,15 @@ int main(int argc, char *argv[])
     cout << "Erasing b" << endl;
     bt.remove('b');
 
+    bt.insert(std::make_pair('d',4));
+    bt.insert(std::make_pair('f',6));
+    BinarySearchTree<char,int>::Range span = bt.range('b','f');
+    cout << "Keys in [b, f):";
+    for(BinarySearchTree<char,int>::iterator it = span.begin(); it != span.end(); ++it) {
+        cout << " " << it->first;
+    }
+    cout << endl;
+
     // AVL Tree Tests
     AVLTree<char,int> at;
     at.insert(std::make_pair('a',1));
@@ -44,5 +68,259 @@ int main(int argc, char *argv[])
     cout << "Erasing b" << endl;
     at.remove('b');
 
+    at.insert(std::make_pair('c',3));
+    at.insert(std::make_pair('d',4));
+    cout << "AVLTree in reverse:";
+    for(AVLTree<char,int>::reverse_iterator it = at.rbegin(); it != at.rend(); ++it) {
+        cout << " " << it->first;
+    }
+    cout << endl;
+    cout << "AVLTree valid: " << at.validate() << endl;
+    vector<char> wanted;
+    wanted.push_back('c');
+    wanted.push_back('z');
+    vector<AVLTree<char,int>::iterator> hits;
+    at.find_many(wanted, hits);
+    cout << "find_many c, z: " << (hits[0] != at.end()) << " " << (hits[1] != at.end()) << endl;
+    FrozenMap<char,int> frozen = at.freeze();
+    cout << "Frozen copy:";
+    for(FrozenMap<char,int>::const_iterator it = frozen.begin(); it != frozen.end(); ++it) {
+        cout << " " << it->first;
+    }
+    cout << ", d -> " << frozen['d'] << endl;
+
+    // AVL Tree backed by the slab allocator
+    AVLTree<char,int,std::less<char>,SlabAllocator<std::pair<const char,int> > > st;
+    for(char c = 'a'; c <= 'e'; ++c) {
+        st.insert(std::make_pair(c, c - 'a'));
+    }
+    st.remove('c');
+    cout << "\nSlab AVLTree contents:" << endl;
+    for(AVLTree<char,int,std::less<char>,SlabAllocator<std::pair<const char,int> > >::iterator it = st.begin(); it != st.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    st.clear();
+    cout << "Cleared, empty = " << st.empty() << endl;
+
+    // Built in O(n) from a sorted range; an unsorted range is rejected
+    vector<std::pair<int,int> > sortedItems;
+    for(int i = 0; i < 7; ++i) {
+        sortedItems.push_back(std::make_pair(i * 2, i));
+    }
+    AVLTree<int,int> loaded(sortedItems.begin(), sortedItems.end());
+    cout << "\nBulk-loaded:";
+    for(AVLTree<int,int>::iterator it = loaded.begin(); it != loaded.end(); ++it) {
+        cout << " " << it->first;
+    }
+    cout << ", valid: " << loaded.validate() << endl;
+    vector<std::pair<int,int> > unsortedItems;
+    unsortedItems.push_back(std::make_pair(5, 0));
+    unsortedItems.push_back(std::make_pair(1, 0));
+    try {
+        loaded.assign(unsortedItems.begin(), unsortedItems.end());
+        cout << "Unsorted assign accepted" << endl;
+    }
+    catch(std::invalid_argument&) {
+        cout << "Unsorted assign rejected, still " << loaded.begin()->first << ".."
+             << loaded.rbegin()->first << ", valid: " << loaded.validate() << endl;
+    }
+
+    // Order-statistic AVL Tree
+    OrderStatisticAVLTree<int,int> ot;
+    for(int i = 1; i <= 10; ++i) {
+        ot.insert(std::make_pair(i * 10, i));
+    }
+    cout << "\nMedian key: " << ot.select(ot.size() / 2)->first << endl;
+    cout << "Rank of 35: " << ot.rank(35) << endl;
+    cout << "Keys in [20, 60): " << ot.count(20, 60) << endl;
+
+    // Transparent comparator: look up string keys without building a string
+    AVLTree<string,int,std::less<> > names;
+    names.insert(std::make_pair(string("carol"), 3));
+    names.insert(std::make_pair(string("alice"), 1));
+    names.insert(std::make_pair(string("bob"), 2));
+    std::string_view who("bob");
+    cout << "\nbob -> " << names.find(who)->second << endl;
+
+    // Moving inserts, and building items in place only when the key is new
+    AVLTree<string,string> colors;
+    colors.insert(std::make_pair(string("apple"), string("red")));
+    colors.emplace(std::piecewise_construct, std::forward_as_tuple("pear"), std::forward_as_tuple(3, 'g'));
+    string green("green");
+    bool added = colors.try_emplace(string("apple"), std::move(green)).second;
+    cout << "apple -> " << colors["apple"] << ", pear -> " << colors["pear"]
+         << ", try_emplace added: " << added << ", left alone: " << green << endl;
+
+    // B-tree engine with the same interface
+    BTreeMap<int,int> bm;
+    for(int i = 0; i < 100; ++i) {
+        bm.insert(std::make_pair(i * 3 % 100, i));
+    }
+    bm.remove(42);
+    cout << "\nBTreeMap size: " << bm.size() << ", bm[7] = " << bm[7]
+         << ", has 42: " << (bm.find(42) != bm.end()) << endl;
+
+    // Concurrent tree: lock-free readers, writes one at a time
+    ConcurrentAVLTree<int,string> ct;
+    ct.insert(std::make_pair(2, string("two")));
+    ct.insert(std::make_pair(1, string("one")));
+    ct.insert(std::make_pair(3, string("three")));
+    ct.remove(2);
+    cout << "\nConcurrent size: " << ct.size() << ", ct[3] = " << ct[3] << ", scan:";
+    ct.scan(0, 10, [](int key, const string& value) { cout << " " << key << "=" << value; });
+    cout << endl;
+
+    // Persistent tree: a snapshot keeps its view while the tree moves on
+    PersistentAVLTree<int,int> pt;
+    for(int i = 1; i <= 5; ++i) {
+        pt.insert(std::make_pair(i, i * i));
+    }
+    PersistentAVLTree<int,int> before = pt.snapshot();
+    pt.remove(3);
+    pt.insert(std::make_pair(6, 36));
+    cout << "\nSnapshot:";
+    for(PersistentAVLTree<int,int>::const_iterator it = before.begin(); it != before.end(); ++it) {
+        cout << " " << it->first << "=" << it->second;
+    }
+    cout << "\nCurrent: ";
+    for(PersistentAVLTree<int,int>::const_iterator it = pt.begin(); it != pt.end(); ++it) {
+        cout << " " << it->first << "=" << it->second;
+    }
+    cout << endl;
+
+    // Split, join and set operations on AVL trees
+    AVLTree<int,int> evens, threes, high;
+    for(int i = 0; i < 20; ++i) {
+        evens.insert(std::make_pair(i * 2, i));
+        threes.insert(std::make_pair(i * 3, i));
+    }
+    evens.split(20, high);
+    cout << "\nSplit at 20:";
+    for(AVLTree<int,int>::iterator it = high.begin(); it != high.end(); ++it) {
+        cout << " " << it->first;
+    }
+    evens.join(evens, std::make_pair(19, 0), high);
+    evens.intersect_with(threes);
+    cout << "\nMultiples of 6 below 40:";
+    for(AVLTree<int,int>::iterator it = evens.begin(); it != evens.end(); ++it) {
+        cout << " " << it->first;
+    }
+    threes.difference_with(evens);
+    cout << "\n6 gone from threes: " << (threes.find(6) == threes.end())
+         << ", valid: " << threes.validate() << endl;
+
+    // A sorted batch of upserts and deletes applied in one pass
+    std::vector<BatchOp<int,int> > ops;
+    ops.push_back(BatchOp<int,int>{ std::make_pair(0, -1), false });
+    ops.push_back(BatchOp<int,int>{ std::make_pair(6, 0), true });
+    ops.push_back(BatchOp<int,int>{ std::make_pair(7, 49), false });
+    threes.apply_sorted_batch(ops);
+    cout << "After batch:";
+    for(AVLTree<int,int>::iterator it = threes.begin(); it != threes.end() && it->first < 20; ++it) {
+        cout << " " << it->first << "=" << it->second;
+    }
+    cout << endl;
+
+    // Appending in key order with end() as the hint skips the search
+    AVLTree<int,int> log;
+    for(int i = 0; i < 8; ++i) {
+        log.insert(log.end(), std::make_pair(i * 10, i));
+    }
+    AVLTree<int,int>::iterator hinted = log.insert(log.find(40), std::make_pair(35, -1));
+    cout << "Hinted insert: " << hinted->first << "=" << hinted->second
+         << ", valid: " << log.validate() << endl;
+
+    // Index-linked nodes from a pool; removal reuses the freed slots
+    CompactAVLTree<int,int> compact;
+    for(int i = 0; i < 100; ++i) {
+        compact.insert(std::make_pair((i * 37) % 100, i));
+    }
+    for(int i = 0; i < 100; i += 2) {
+        compact.remove(i);
+    }
+    compact.insert(std::make_pair(4, 4));
+    cout << "Compact tree: " << compact.size() << " items in " << compact.capacity()
+         << " slots, first " << compact.begin()->first << ", last " << (--compact.end())->first
+         << ", valid: " << compact.validate() << endl;
+
+    // Objects the caller owns, linked in place by id
+    struct Session : IntrusiveAVLHook<>
+    {
+        int id;
+        string user;
+    };
+    struct SessionId
+    {
+        const int& operator()(const Session& session) const { return session.id; }
+    };
+    Session sessions[] = { { {}, 42, "ann" }, { {}, 7, "bob" }, { {}, 19, "cy" } };
+    IntrusiveAVLTree<Session, int, SessionId> byId;
+    for(Session& session : sessions) {
+        byId.insert(session);
+    }
+    byId.unlink(sessions[0]);
+    cout << "Intrusive:";
+    for(IntrusiveAVLTree<Session, int, SessionId>::iterator it = byId.begin(); it != byId.end(); ++it) {
+        cout << " " << it->id << "=" << it->user;
+    }
+    cout << ", 42 linked: " << sessions[0].is_linked() << ", valid: " << byId.validate() << endl;
+
+    // Values kept beside the nodes; items still read as first and second
+    typedef CompactAVLTree<int, string, std::less<int>, std::allocator<std::pair<const int, string> >,
+                           SeparateValues> ColdTree;
+    ColdTree cold;
+    cold.insert(std::make_pair(2, string("two")));
+    cold.insert(std::make_pair(1, string("one")));
+    cold.find(2)->second += "!";
+    cout << "Separate values:";
+    for(ColdTree::iterator it = cold.begin(); it != cold.end(); ++it) {
+        cout << " " << it->first << "=" << it->second;
+    }
+    cout << ", valid: " << cold.validate() << endl;
+
+    // A saved image mapped back in, searched on the mapped pages
+    AVLTree<int,int> saved;
+    for(int i = 0; i < 10; ++i) {
+        saved.insert(std::make_pair(i * i, i));
+    }
+    saved.save("bst-test.img");
+    FrozenMap<int,int> mapped = AVLTree<int,int>::load_mapped("bst-test.img");
+    remove("bst-test.img");
+    cout << "Mapped image: " << mapped.size() << " items, 49 -> " << mapped[49]
+         << ", first >= 50: " << mapped.lower_bound(50)->first << endl;
+
+    // Mutations logged before they apply, recovered after a reopen
+    remove("bst-test.wal");
+    {
+        LoggedAVLTree<int,int> durable("bst-test.snap", "bst-test.wal");
+        durable.insert(std::make_pair(1, 10));
+        durable.insert(std::make_pair(2, 20));
+        durable.checkpoint();
+        durable.insert(std::make_pair(3, 30));
+        durable.remove(1);
+    }
+    LoggedAVLTree<int,int> reopened("bst-test.snap", "bst-test.wal");
+    remove("bst-test.snap");
+    remove("bst-test.wal");
+    cout << "Recovered " << reopened.recovered() << " log records:";
+    for(AVLTree<int,int>::const_iterator it = reopened.tree().begin(); it != reopened.tree().end(); ++it) {
+        cout << " " << it->first << "=" << it->second;
+    }
+    cout << endl;
+
+    // The same updates on the red-black and weak AVL engines
+    RBTree<int,int> redBlack;
+    WAVLTree<int,int> weak;
+    for(int i = 0; i < 64; ++i) {
+        redBlack.insert(std::make_pair(i, i));
+        weak.insert(std::make_pair(i, i));
+    }
+    for(int i = 0; i < 64; i += 3) {
+        redBlack.remove(i);
+        weak.remove(i);
+    }
+    cout << "Red-black: first " << redBlack.begin()->first << ", valid: " << redBlack.validate()
+         << "; weak AVL: first " << weak.begin()->first << ", valid: " << weak.validate() << endl;
+
     return 0;
 }
@@ -5,20 +5,86 @@
 #include <exception>
 #include <cstdlib>
 #include <utility>
+#include <functional>
+#include <stdexcept>
+#include <memory>
+#include <type_traits>
+#include <iterator>
+#include <tuple>
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include "slab_alloc.h"
+
+/**
+* Builds the item for a new node. Node constructors initialize their item
+* directly from build(), and since C++17 a prvalue initializes its target in
+* place, so the pair is constructed exactly once inside the node even though
+* the tree only reaches the node type through a virtual createNode().
+*/
+template <typename Key, typename Value>
+class ItemBuilder
+{
+public:
+    virtual std::pair<const Key, Value> build() const = 0;
+
+protected:
+    ~ItemBuilder() { }
+};
+
+/**
+* An ItemBuilder that perfectly forwards its arguments to the pair's
+* constructor. It only holds references, so it must not outlive them;
+* use it as a temporary through forwardItem().
+*/
+template <typename Key, typename Value, typename... Args>
+class ForwardingItemBuilder : public ItemBuilder<Key, Value>
+{
+public:
+    explicit ForwardingItemBuilder(Args&&... args);
+    virtual std::pair<const Key, Value> build() const;
+
+private:
+    std::tuple<Args&&...> args_;
+};
+
+template <typename Key, typename Value, typename... Args>
+ForwardingItemBuilder<Key, Value, Args...>::ForwardingItemBuilder(Args&&... args) :
+    args_(std::forward<Args>(args)...)
+{
+
+}
+
+template <typename Key, typename Value, typename... Args>
+std::pair<const Key, Value> ForwardingItemBuilder<Key, Value, Args...>::build() const
+{
+    return std::make_from_tuple<std::pair<const Key, Value> >(std::move(args_));
+}
+
+template <typename Key, typename Value, typename... Args>
+ForwardingItemBuilder<Key, Value, Args...> forwardItem(Args&&... args)
+{
+    return ForwardingItemBuilder<Key, Value, Args...>(std::forward<Args>(args)...);
+}
 
 /**
  * A templated class for a Node in a search tree.
- * The getters for parent/left/right are virtual so
- * that they can be overridden for future kinds of
- * search trees, such as Red Black trees, Splay trees,
- * and AVL trees.
+ * The getters for parent/left/right are deliberately
+ * non-virtual so that every hop of a descent is an inlined
+ * load instead of an indirect call, and nodes carry no vtable.
+ * Derived node types for other kinds of search trees, such
+ * as AVL trees, hide them with getters that static_cast to
+ * their own type. Because the destructor is not virtual, a
+ * node must always be deleted through its most-derived type;
+ * see BinarySearchTree::destroyNode().
  */
 template <typename Key, typename Value>
 class Node
 {
 public:
     Node(const Key& key, const Value& value, Node<Key, Value>* parent);
-    virtual ~Node();
+    Node(const ItemBuilder<Key, Value>& builder, Node<Key, Value>* parent);
+    ~Node();
 
     const std::pair<const Key, Value>& getItem() const;
     std::pair<const Key, Value>& getItem();
@@ -26,14 +92,15 @@ public:
     const Value& getValue() const;
     Value& getValue();
 
-    virtual Node<Key, Value>* getParent() const;
-    virtual Node<Key, Value>* getLeft() const;
-    virtual Node<Key, Value>* getRight() const;
+    Node<Key, Value>* getParent() const;
+    Node<Key, Value>* getLeft() const;
+    Node<Key, Value>* getRight() const;
 
     void setParent(Node<Key, Value>* parent);
     void setLeft(Node<Key, Value>* left);
     void setRight(Node<Key, Value>* right);
     void setValue(const Value &value);
+    void setValue(Value&& value);
 
 protected:
     std::pair<const Key, Value> item_;
@@ -61,6 +128,19 @@ Node<Key, Value>::Node(const Key& key, const Value& value, Node<Key, Value>* par
 
 }
 
+/**
+* Constructs the item in place from builder.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>::Node(const ItemBuilder<Key, Value>& builder, Node<Key, Value>* parent) :
+    item_(builder.build()),
+    parent_(parent),
+    left_(NULL),
+    right_(NULL)
+{
+
+}
+
 /**
 * Destructor, which does not need to do anything since the pointers inside of a node
 * are only used as references to existing nodes. The nodes pointed to by parent/left/right
@@ -118,7 +198,7 @@ Value& Node<Key, Value>::getValue()
 }
 
 /**
-* An implementation of the virtual function for retreiving the parent.
+* A getter for the parent.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getParent() const
@@ -127,7 +207,7 @@ Node<Key, Value>* Node<Key, Value>::getParent() const
 }
 
 /**
-* An implementation of the virtual function for retreiving the left child.
+* A getter for the left child.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getLeft() const
@@ -136,7 +216,7 @@ Node<Key, Value>* Node<Key, Value>::getLeft() const
 }
 
 /**
-* An implementation of the virtual function for retreiving the right child.
+* A getter for the right child.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getRight() const
@@ -180,20 +260,108 @@ void Node<Key, Value>::setValue(const Value& value)
     item_.second = value;
 }
 
+/**
+* A setter that moves the new value into the node.
+*/
+template<typename Key, typename Value>
+void Node<Key, Value>::setValue(Value&& value)
+{
+    item_.second = std::move(value);
+}
+
 /*
   ---------------------------------------
   End implementations for the Node class.
   ---------------------------------------
 */
 
+/**
+* Allocates and constructs a node of type NodeType from a node allocator.
+* Shared by every tree so they all go through their allocator the same way.
+*/
+template<typename NodeType, typename NodeAlloc, typename... Args>
+NodeType* allocateNode(NodeAlloc& alloc, Args&&... args)
+{
+    typedef std::allocator_traits<NodeAlloc> Traits;
+    NodeType* node = Traits::allocate(alloc, 1);
+    try {
+        Traits::construct(alloc, node, std::forward<Args>(args)...);
+    }
+    catch(...) {
+        Traits::deallocate(alloc, node, 1);
+        throw;
+    }
+    return node;
+}
+
+/**
+* Destroys and frees a node obtained from allocateNode().
+*/
+template<typename NodeType, typename NodeAlloc>
+void deallocateNode(NodeAlloc& alloc, NodeType* node)
+{
+    typedef std::allocator_traits<NodeAlloc> Traits;
+    Traits::destroy(alloc, node);
+    Traits::deallocate(alloc, node, 1);
+}
+
+/**
+* A half-open [first, last) span of a tree, as returned by range(), usable
+* directly in a range-based for loop.
+*/
+template<typename Iterator>
+class IteratorRange
+{
+public:
+    IteratorRange(const Iterator& first, const Iterator& last);
+
+    Iterator begin() const;
+    Iterator end() const;
+    bool empty() const;
+
+private:
+    Iterator first_;
+    Iterator last_;
+};
+
+template<typename Iterator>
+IteratorRange<Iterator>::IteratorRange(const Iterator& first, const Iterator& last) :
+    first_(first),
+    last_(last)
+{
+
+}
+
+template<typename Iterator>
+Iterator IteratorRange<Iterator>::begin() const
+{
+    return first_;
+}
+
+template<typename Iterator>
+Iterator IteratorRange<Iterator>::end() const
+{
+    return last_;
+}
+
+template<typename Iterator>
+bool IteratorRange<Iterator>::empty() const
+{
+    return first_ == last_;
+}
+
 /**
 * A templated unbalanced binary search tree.
+* Alloc is rebound to the node type, so any standard allocator works;
+* SlabAllocator (slab_alloc.h) additionally lets clear() free in bulk.
 */
-template <typename Key, typename Value>
+template <typename Key, typename Value,
+          typename Compare = std::less<Key>,
+          typename Alloc = std::allocator<std::pair<const Key, Value> > >
 class BinarySearchTree
 {
 public:
-    BinarySearchTree(); //TODO
+    explicit BinarySearchTree(const Compare& comp = Compare(), const Alloc& alloc = Alloc()); //TODO
     virtual ~BinarySearchTree(); //TODO
     virtual void insert(const std::pair<const Key, Value>& keyValuePair); //TODO
     virtual void remove(const Key& key); //TODO
@@ -201,16 +369,26 @@ public:
     bool isBalanced() const; //TODO
     void print() const;
     bool empty() const;
+    Compare key_comp() const;
 
-    template<typename PPKey, typename PPValue>
-    friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue> & tree);
+    template<typename PPKey, typename PPValue, typename PPCompare, typename PPAlloc>
+    friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue, PPCompare, PPAlloc> & tree);
 public:
+    class const_iterator;
+
     /**
     * An internal iterator class for traversing the contents of the BST.
+    * It is bidirectional: decrementing end() yields the largest item.
     */
     class iterator  // TODO
     {
     public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::pair<const Key, Value>* pointer;
+        typedef std::pair<const Key, Value>& reference;
+
         iterator();
 
         std::pair<const Key,Value>& operator*() const;
@@ -220,25 +398,134 @@ public:
         bool operator!=(const iterator& rhs) const;
 
         iterator& operator++();
+        iterator operator++(int);
+        iterator& operator--();
+        iterator operator--(int);
+
+    protected:
+        friend class BinarySearchTree<Key, Value, Compare, Alloc>;
+        friend class const_iterator;
+        iterator(Node<Key,Value>* ptr, const BinarySearchTree<Key, Value, Compare, Alloc>* tree);
+        Node<Key, Value> *current_;
+        const BinarySearchTree<Key, Value, Compare, Alloc>* tree_;  // for decrementing end()
+    };
+
+    /**
+    * The read-only counterpart of iterator, handed out by const trees.
+    * An iterator converts to a const_iterator but not the other way around.
+    */
+    class const_iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const std::pair<const Key, Value>* pointer;
+        typedef const std::pair<const Key, Value>& reference;
+
+        const_iterator();
+        const_iterator(const iterator& it);
+
+        const std::pair<const Key,Value>& operator*() const;
+        const std::pair<const Key,Value>* operator->() const;
+
+        bool operator==(const const_iterator& rhs) const;
+        bool operator!=(const const_iterator& rhs) const;
+
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        const_iterator& operator--();
+        const_iterator operator--(int);
 
     protected:
-        friend class BinarySearchTree<Key, Value>;
-        iterator(Node<Key,Value>* ptr);
+        friend class BinarySearchTree<Key, Value, Compare, Alloc>;
+        const_iterator(Node<Key,Value>* ptr, const BinarySearchTree<Key, Value, Compare, Alloc>* tree);
         Node<Key, Value> *current_;
+        const BinarySearchTree<Key, Value, Compare, Alloc>* tree_;
     };
 
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+    typedef IteratorRange<iterator> Range;
+    typedef IteratorRange<const_iterator> ConstRange;
+
 public:
-    iterator begin() const;
-    iterator end() const;
-    iterator find(const Key& key) const;
+    iterator begin();
+    const_iterator begin() const;
+    iterator end();
+    const_iterator end() const;
+    const_iterator cbegin() const;
+    const_iterator cend() const;
+    reverse_iterator rbegin();
+    const_reverse_iterator rbegin() const;
+    reverse_iterator rend();
+    const_reverse_iterator rend() const;
+    iterator find(const Key& key);
+    const_iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key);
+    const_iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key);
+    const_iterator upper_bound(const Key& key) const;
+    std::pair<iterator, iterator> equal_range(const Key& key);
+    std::pair<const_iterator, const_iterator> equal_range(const Key& key) const;
+    Range range(const Key& lo, const Key& hi);
+    ConstRange range(const Key& lo, const Key& hi) const;
+    void find_many(const std::vector<Key>& keys, std::vector<iterator>& out);
+    void find_many(const std::vector<Key>& keys, std::vector<const_iterator>& out) const;
+
+    // Heterogeneous lookup, enabled when Compare defines is_transparent
+    // (e.g. std::less<>), such as searching a std::string tree by string_view.
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator find(const K& key);
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    const_iterator find(const K& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator lower_bound(const K& key);
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    const_iterator lower_bound(const K& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator upper_bound(const K& key);
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    const_iterator upper_bound(const K& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    std::pair<iterator, iterator> equal_range(const K& key);
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    std::pair<const_iterator, const_iterator> equal_range(const K& key) const;
+
+    // Insertion without extra copies. insert(P&&) overwrites an existing
+    // value like insert(const pair&); emplace and try_emplace leave it alone
+    // and report whether they inserted, as std::map does. try_emplace only
+    // constructs anything when the key is absent.
+    template<typename P, typename = typename std::enable_if<
+        std::is_constructible<std::pair<const Key, Value>, P&&>::value>::type>
+    void insert(P&& keyValuePair);
+    template<typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args);
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args);
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args);
+    iterator insert(const_iterator hint, const std::pair<const Key, Value>& keyValuePair);
     Value& operator[](const Key& key);
     Value const & operator[](const Key& key) const;
 
 protected:
     // Mandatory helper functions
-    Node<Key, Value>* internalFind(const Key& k) const; // TODO
+    template<typename K> Node<Key, Value>* internalFind(const K& k) const; // TODO
+    void internalFindMany(const Key* keys, size_t n, Node<Key, Value>** out) const;
+    template<typename K> Node<Key, Value>* internalLowerBound(const K& k) const;
+    template<typename K> Node<Key, Value>* internalUpperBound(const K& k) const;
+    Node<Key, Value>* insertPosition(const Key& key, Node<Key, Value>*& parent, bool& isLeft) const;
+    Node<Key, Value>* hintPosition(Node<Key, Value>* hint, const Key& key,
+                                   Node<Key, Value>*& parent, bool& isLeft) const;
+    iterator makeIterator(Node<Key, Value>* node);
+    const_iterator makeIterator(Node<Key, Value>* node) const;
+    template<typename K>
+    std::pair<Node<Key, Value>*, Node<Key, Value>*> internalEqualRange(const K& k) const;
     Node<Key, Value> *getSmallestNode() const;  // TODO
+    Node<Key, Value>* getLargestNode() const;
     static Node<Key, Value>* predecessor(Node<Key, Value>* current); // TODO
+    static Node<Key, Value>* successor(Node<Key, Value>* current);
     // Note:  static means these functions don't have a "this" pointer
     //        and instead just use the input argument.
 
@@ -247,13 +534,28 @@ protected:
     virtual void nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2) ;
 
     // Add helper functions here
+    typedef typename std::allocator_traits<Alloc>::template rebind_alloc<Node<Key, Value> > NodeAllocator;
+    std::pair<Node<Key, Value>*, bool> insertItem(const Key& key, const ItemBuilder<Key, Value>& builder);
+    virtual Node<Key, Value>* createNode(const ItemBuilder<Key, Value>& builder, Node<Key, Value>* parent);
+    virtual void linkNode(Node<Key, Value>* parent, bool isLeft, Node<Key, Value>* node);
+    virtual void destroyNode(Node<Key, Value>* node);
+    virtual void releaseNodes();
+    void noteLinked(Node<Key, Value>* parent, bool isLeft, Node<Key, Value>* node);
+    void noteUnlinking(Node<Key, Value>* node);
+    void setRoot(Node<Key, Value>* root);
+    bool extremesValid() const;
     void clearHelp (Node<Key, Value>* node);
-    bool isBalancedHelp (Node<Key, Value>* node) const;
-    int height(Node<Key, Value>* node) const;
+    template<typename InOrder, typename PostOrder>
+    bool walkHeights(InOrder inOrder, PostOrder postOrder) const;
 
 protected:
     Node<Key, Value>* root_;
-    // You should not need other data members
+    // The smallest and largest nodes, as std::map's header keeps them, so
+    // begin(), --end() and hints at either end need no descent
+    Node<Key, Value>* leftmost_;
+    Node<Key, Value>* rightmost_;
+    Compare comp_;
+    NodeAllocator nodeAlloc_;
 };
 
 /*
@@ -263,31 +565,35 @@ Begin implementations for the BinarySearchTree::iterator class.
 */
 
 /**
-* Explicit constructor that initializes an iterator with a given node pointer.
+* Explicit constructor that initializes an iterator with a given node pointer
+* and the tree it walks.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator(Node<Key,Value> *ptr)
+template<class Key, class Value, class Compare, class Alloc>
+BinarySearchTree<Key, Value, Compare, Alloc>::iterator::iterator(
+    Node<Key,Value> *ptr, const BinarySearchTree<Key, Value, Compare, Alloc>* tree)
 {
     // TODO : DONE
     current_ = ptr;
+    tree_ = tree;
 }
 
 /**
 * A default constructor that initializes the iterator to NULL.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator() 
+template<class Key, class Value, class Compare, class Alloc>
+BinarySearchTree<Key, Value, Compare, Alloc>::iterator::iterator() 
 {
     // TODO : DONE
     current_ = nullptr;
+    tree_ = nullptr;
 }
 
 /**
 * Provides access to the item.
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare, class Alloc>
 std::pair<const Key,Value> &
-BinarySearchTree<Key, Value>::iterator::operator*() const
+BinarySearchTree<Key, Value, Compare, Alloc>::iterator::operator*() const
 {
     return current_->getItem();
 }
@@ -295,9 +601,9 @@ BinarySearchTree<Key, Value>::iterator::operator*() const
 /**
 * Provides access to the address of the item.
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare, class Alloc>
 std::pair<const Key,Value> *
-BinarySearchTree<Key, Value>::iterator::operator->() const
+BinarySearchTree<Key, Value, Compare, Alloc>::iterator::operator->() const
 {
     return &(current_->getItem());
 }
@@ -306,10 +612,10 @@ BinarySearchTree<Key, Value>::iterator::operator->() const
 * Checks if 'this' iterator's internals have the same value
 * as 'rhs'
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare, class Alloc>
 bool
-BinarySearchTree<Key, Value>::iterator::operator==(
-    const BinarySearchTree<Key, Value>::iterator& rhs) const
+BinarySearchTree<Key, Value, Compare, Alloc>::iterator::operator==(
+    const BinarySearchTree<Key, Value, Compare, Alloc>::iterator& rhs) const
 {
     // TODO : DONE
     return (current_ == rhs.current_);
@@ -319,10 +625,10 @@ BinarySearchTree<Key, Value>::iterator::operator==(
 * Checks if 'this' iterator's internals have a different value
 * as 'rhs'
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare, class Alloc>
 bool
-BinarySearchTree<Key, Value>::iterator::operator!=(
-    const BinarySearchTree<Key, Value>::iterator& rhs) const
+BinarySearchTree<Key, Value, Compare, Alloc>::iterator::operator!=(
+    const BinarySearchTree<Key, Value, Compare, Alloc>::iterator& rhs) const
 {
     // TODO : DONE
     return (current_ != rhs.current_);
@@ -332,33 +638,45 @@ BinarySearchTree<Key, Value>::iterator::operator!=(
 /**
 * Advances the iterator's location using an in-order sequencing
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator&
-BinarySearchTree<Key, Value>::iterator::operator++()
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator&
+BinarySearchTree<Key, Value, Compare, Alloc>::iterator::operator++()
 {
     // TODO : DONE
+    current_ = successor(current_);
+    return *this;
+}
 
-    // If there is right subtree, find left most node
-    if (current_ -> getRight()){
-        current_ = current_ -> getRight();
-        while (current_ -> getLeft()){
-            current_ = current_ -> getLeft();
-        }
-    }
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::iterator::operator++(int)
+{
+    iterator old(*this);
+    ++(*this);
+    return old;
+}
 
-    // Otherwise move until finding node which is left child of parent
-    else{
-        Node<Key, Value>* parent = current_ -> getParent();
-        while (parent != nullptr && current_ == parent -> getRight()){
-            current_ = parent;
-            parent = parent -> getParent();
-        }
-        // Reached end of tree if parent is null
-        current_ = parent;
-    }
+/**
+* Moves the iterator back one item in order. From end() it moves
+* to the largest item.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator&
+BinarySearchTree<Key, Value, Compare, Alloc>::iterator::operator--()
+{
+    current_ = current_ ? predecessor(current_) : tree_->getLargestNode();
     return *this;
 }
 
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::iterator::operator--(int)
+{
+    iterator old(*this);
+    --(*this);
+    return old;
+}
+
 
 /*
 -------------------------------------------------------------
@@ -366,6 +684,110 @@ End implementations for the BinarySearchTree::iterator class.
 -------------------------------------------------------------
 */
 
+/*
+--------------------------------------------------------------------
+Begin implementations for the BinarySearchTree::const_iterator class.
+--------------------------------------------------------------------
+*/
+
+template<class Key, class Value, class Compare, class Alloc>
+BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator::const_iterator(
+    Node<Key,Value> *ptr, const BinarySearchTree<Key, Value, Compare, Alloc>* tree) :
+    current_(ptr),
+    tree_(tree)
+{
+
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator::const_iterator() :
+    current_(nullptr),
+    tree_(nullptr)
+{
+
+}
+
+/**
+* Implicit conversion from a mutable iterator.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator::const_iterator(const iterator& it) :
+    current_(it.current_),
+    tree_(it.tree_)
+{
+
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+const std::pair<const Key,Value> &
+BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator::operator*() const
+{
+    return current_->getItem();
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+const std::pair<const Key,Value> *
+BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator::operator->() const
+{
+    return &(current_->getItem());
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+bool
+BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator::operator==(
+    const BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator& rhs) const
+{
+    return (current_ == rhs.current_);
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+bool
+BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator::operator!=(
+    const BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator& rhs) const
+{
+    return (current_ != rhs.current_);
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator&
+BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator::operator++()
+{
+    current_ = successor(current_);
+    return *this;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator::operator++(int)
+{
+    const_iterator old(*this);
+    ++(*this);
+    return old;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator&
+BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator::operator--()
+{
+    current_ = current_ ? predecessor(current_) : tree_->getLargestNode();
+    return *this;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator::operator--(int)
+{
+    const_iterator old(*this);
+    --(*this);
+    return old;
+}
+
+/*
+------------------------------------------------------------------
+End implementations for the BinarySearchTree::const_iterator class.
+------------------------------------------------------------------
+*/
+
 /*
 -----------------------------------------------------
 Begin implementations for the BinarySearchTree class.
@@ -375,15 +797,19 @@ Begin implementations for the BinarySearchTree class.
 /**
 * Default constructor for a BinarySearchTree, which sets the root to NULL.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::BinarySearchTree() 
+template<class Key, class Value, class Compare, class Alloc>
+BinarySearchTree<Key, Value, Compare, Alloc>::BinarySearchTree(const Compare& comp, const Alloc& alloc) :
+    leftmost_(nullptr),
+    rightmost_(nullptr),
+    comp_(comp),
+    nodeAlloc_(alloc)
 {
     // TODO : DONE
     root_ = nullptr;
 }
 
-template<typename Key, typename Value>
-BinarySearchTree<Key, Value>::~BinarySearchTree()
+template<typename Key, typename Value, typename Compare, typename Alloc>
+BinarySearchTree<Key, Value, Compare, Alloc>::~BinarySearchTree()
 {
     // TODO : DONE
     clear();
@@ -392,14 +818,23 @@ BinarySearchTree<Key, Value>::~BinarySearchTree()
 /**
  * Returns true if tree is empty
 */
-template<class Key, class Value>
-bool BinarySearchTree<Key, Value>::empty() const
+template<class Key, class Value, class Compare, class Alloc>
+bool BinarySearchTree<Key, Value, Compare, Alloc>::empty() const
 {
     return root_ == nullptr;
 }
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::print() const
+/**
+ * Returns a copy of the comparator that orders the keys
+*/
+template<class Key, class Value, class Compare, class Alloc>
+Compare BinarySearchTree<Key, Value, Compare, Alloc>::key_comp() const
+{
+    return comp_;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::print() const
 {
     printRoot(root_);
     std::cout << "\n";
@@ -408,51 +843,269 @@ void BinarySearchTree<Key, Value>::print() const
 /**
 * Returns an iterator to the "smallest" item in the tree
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::begin() const
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::begin()
+{
+    return makeIterator(getSmallestNode());
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::begin() const
 {
-    BinarySearchTree<Key, Value>::iterator begin(getSmallestNode());
-    return begin;
+    return makeIterator(getSmallestNode());
 }
 
 /**
 * Returns an iterator whose value means INVALID
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::end() const
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::end()
+{
+    return makeIterator(NULL);
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::end() const
+{
+    return makeIterator(NULL);
+}
+
+/**
+* Read-only begin()/end(), even on a non-const tree
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::cbegin() const
+{
+    return begin();
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::cend() const
+{
+    return end();
+}
+
+/**
+* Reverse iteration, largest key first. rbegin() is built on end(),
+* which decrements to the largest item.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::reverse_iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::rbegin()
+{
+    return reverse_iterator(end());
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::const_reverse_iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::rbegin() const
 {
-    BinarySearchTree<Key, Value>::iterator end(NULL);
-    return end;
+    return const_reverse_iterator(end());
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::reverse_iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::rend()
+{
+    return reverse_iterator(begin());
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::const_reverse_iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::rend() const
+{
+    return const_reverse_iterator(begin());
 }
 
 /**
 * Returns an iterator to the item with the given key, k
 * or the end iterator if k does not exist in the tree
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::find(const Key & k) const
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::find(const Key & k)
+{
+    return makeIterator(internalFind(k));
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::find(const Key & k) const
+{
+    return makeIterator(internalFind(k));
+}
+
+/**
+* Returns an iterator to the first item whose key is not less than k,
+* or the end iterator if there is none
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::lower_bound(const Key & k)
+{
+    return makeIterator(internalLowerBound(k));
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::lower_bound(const Key & k) const
+{
+    return makeIterator(internalLowerBound(k));
+}
+
+/**
+* Returns an iterator to the first item whose key is greater than k,
+* or the end iterator if there is none
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::upper_bound(const Key & k)
+{
+    return makeIterator(internalUpperBound(k));
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::upper_bound(const Key & k) const
+{
+    return makeIterator(internalUpperBound(k));
+}
+
+/**
+* Returns the [lower_bound(k), upper_bound(k)) pair in one descent
+*/
+template<class Key, class Value, class Compare, class Alloc>
+std::pair<typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator,
+          typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator>
+BinarySearchTree<Key, Value, Compare, Alloc>::equal_range(const Key & k)
+{
+    std::pair<Node<Key, Value>*, Node<Key, Value>*> bounds = internalEqualRange(k);
+    return std::make_pair(makeIterator(bounds.first), makeIterator(bounds.second));
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+std::pair<typename BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator,
+          typename BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator>
+BinarySearchTree<Key, Value, Compare, Alloc>::equal_range(const Key & k) const
+{
+    std::pair<Node<Key, Value>*, Node<Key, Value>*> bounds = internalEqualRange(k);
+    return std::make_pair(makeIterator(bounds.first), makeIterator(bounds.second));
+}
+
+/**
+* Returns the items with keys in [lo, hi) in order. Costs two descents
+* up front, then O(1) amortized per item visited.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::Range
+BinarySearchTree<Key, Value, Compare, Alloc>::range(const Key& lo, const Key& hi)
+{
+    if (!comp_(lo, hi)) {
+        return Range(end(), end());
+    }
+    return Range(lower_bound(lo), lower_bound(hi));
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::ConstRange
+BinarySearchTree<Key, Value, Compare, Alloc>::range(const Key& lo, const Key& hi) const
+{
+    if (!comp_(lo, hi)) {
+        return ConstRange(end(), end());
+    }
+    return ConstRange(lower_bound(lo), lower_bound(hi));
+}
+
+/**
+* Heterogeneous versions of the lookups above, for transparent comparators
+*/
+template<class Key, class Value, class Compare, class Alloc>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::find(const K& k)
+{
+    return makeIterator(internalFind(k));
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::find(const K& k) const
+{
+    return makeIterator(internalFind(k));
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::lower_bound(const K& k)
+{
+    return makeIterator(internalLowerBound(k));
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::lower_bound(const K& k) const
+{
+    return makeIterator(internalLowerBound(k));
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::upper_bound(const K& k)
+{
+    return makeIterator(internalUpperBound(k));
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::upper_bound(const K& k) const
 {
-    Node<Key, Value> *curr = internalFind(k);
-    BinarySearchTree<Key, Value>::iterator it(curr);
-    return it;
+    return makeIterator(internalUpperBound(k));
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+template<typename K, typename C, typename>
+std::pair<typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator,
+          typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator>
+BinarySearchTree<Key, Value, Compare, Alloc>::equal_range(const K& k)
+{
+    std::pair<Node<Key, Value>*, Node<Key, Value>*> bounds = internalEqualRange(k);
+    return std::make_pair(makeIterator(bounds.first), makeIterator(bounds.second));
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+template<typename K, typename C, typename>
+std::pair<typename BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator,
+          typename BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator>
+BinarySearchTree<Key, Value, Compare, Alloc>::equal_range(const K& k) const
+{
+    std::pair<Node<Key, Value>*, Node<Key, Value>*> bounds = internalEqualRange(k);
+    return std::make_pair(makeIterator(bounds.first), makeIterator(bounds.second));
 }
 
 /**
  * @precondition The key exists in the map
  * Returns the value associated with the key
  */
-template<class Key, class Value>
-Value& BinarySearchTree<Key, Value>::operator[](const Key& key)
+template<class Key, class Value, class Compare, class Alloc>
+Value& BinarySearchTree<Key, Value, Compare, Alloc>::operator[](const Key& key)
 {
     Node<Key, Value> *curr = internalFind(key);
     if(curr == NULL) throw std::out_of_range("Invalid key");
     return curr->getValue();
 }
-template<class Key, class Value>
-Value const & BinarySearchTree<Key, Value>::operator[](const Key& key) const
+template<class Key, class Value, class Compare, class Alloc>
+Value const & BinarySearchTree<Key, Value, Compare, Alloc>::operator[](const Key& key) const
 {
     Node<Key, Value> *curr = internalFind(key);
     if(curr == NULL) throw std::out_of_range("Invalid key");
@@ -461,70 +1114,133 @@ Value const & BinarySearchTree<Key, Value>::operator[](const Key& key) const
 
 /**
 * An insert method to insert into a Binary Search Tree.
-* The tree will not remain balanced when inserting.
+* The tree will not remain balanced when inserting, unless a
+* derived tree rebalances in linkNode().
 * Recall: If key is already in the tree, you should 
 * overwrite the current value with the updated value.
 */
-template<class Key, class Value>
-void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &keyValuePair)
+template<class Key, class Value, class Compare, class Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::insert(const std::pair<const Key, Value> &keyValuePair)
 {
     // TODO : DONE
 
-    // Extract key and value from input
-    Key newKey = keyValuePair.first;
-    Value newVal = keyValuePair.second;
-
-    // If tree is empty, create root node
-    if (root_ == nullptr){
-        root_ = new Node<Key, Value>(newKey, newVal, nullptr);
-        return;
+    // Copy the pair into a new node, or overwrite the value if key exists
+    std::pair<Node<Key, Value>*, bool> result =
+        insertItem(keyValuePair.first, forwardItem<Key, Value>(keyValuePair));
+    if (!result.second) {
+        result.first->setValue(keyValuePair.second);
     }
+}
 
-    // Traverse to find appropriate position for insertion
-    Node<Key, Value>* current = root_;
-    Node<Key, Value>* parent = nullptr;
-
-    while (current != nullptr){
-        parent = current;
+/**
+* Same as insert(const pair&), but moves from keyValuePair when it is an
+* rvalue (e.g. std::make_pair(std::string(...), value)) and accepts any
+* pair the item is constructible from.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+template<typename P, typename>
+void BinarySearchTree<Key, Value, Compare, Alloc>::insert(P&& keyValuePair)
+{
+    // The key is only read while searching, before the builder moves from it
+    std::pair<Node<Key, Value>*, bool> result =
+        insertItem(keyValuePair.first, forwardItem<Key, Value>(std::forward<P>(keyValuePair)));
+    if (!result.second) {
+        result.first->setValue(std::forward<P>(keyValuePair).second);
+    }
+}
 
-        // Move to left if less than current node key
-        if (newKey < current -> getKey()){
-            current = current -> getLeft();
-        }
+/**
+* Constructs the item from args inside a new node, then inserts it unless
+* its key is already present, in which case the new node is discarded.
+* Returns the item with that key and whether it was inserted.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator, bool>
+BinarySearchTree<Key, Value, Compare, Alloc>::emplace(Args&&... args)
+{
+    // The key isn't known until the item exists, so build the node first
+    Node<Key, Value>* node = createNode(forwardItem<Key, Value>(std::forward<Args>(args)...), nullptr);
+
+    Node<Key, Value>* parent;
+    bool isLeft;
+    Node<Key, Value>* existing;
+    try {
+        existing = insertPosition(node->getKey(), parent, isLeft);
+    }
+    catch (...) {
+        destroyNode(node);
+        throw;
+    }
 
-        // Move to right if greater than current node key
-        else if (newKey > current -> getKey()){
-            current = current -> getRight();
-        }
-        
-        // If key already exists, update value and return
-        else{
-            current -> setValue(newVal);
-            return;
-        }
+    if (existing) {
+        destroyNode(node);
+        return std::make_pair(makeIterator(existing), false);
     }
+    linkNode(parent, isLeft, node);
+    return std::make_pair(makeIterator(node), true);
+}
+
+/**
+* Inserts key with a value constructed from args if key is absent; otherwise
+* nothing is constructed and neither key nor args are moved from.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator, bool>
+BinarySearchTree<Key, Value, Compare, Alloc>::try_emplace(const Key& key, Args&&... args)
+{
+    std::pair<Node<Key, Value>*, bool> result = insertItem(key,
+        forwardItem<Key, Value>(std::piecewise_construct, std::forward_as_tuple(key),
+                                std::forward_as_tuple(std::forward<Args>(args)...)));
+    return std::make_pair(makeIterator(result.first), result.second);
+}
 
-    // Create node with new key value and link to parent
-    Node<Key, Value>* newNode = new Node<Key, Value>(newKey, newVal, parent);
+template<class Key, class Value, class Compare, class Alloc>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator, bool>
+BinarySearchTree<Key, Value, Compare, Alloc>::try_emplace(Key&& key, Args&&... args)
+{
+    std::pair<Node<Key, Value>*, bool> result = insertItem(key,
+        forwardItem<Key, Value>(std::piecewise_construct, std::forward_as_tuple(std::move(key)),
+                                std::forward_as_tuple(std::forward<Args>(args)...)));
+    return std::make_pair(makeIterator(result.first), result.second);
+}
 
-    // Insert new node in accordance with parent relationship
-    if (newKey < parent -> getKey()){
-        parent -> setLeft(newNode);
-    }
-    else{
-        parent -> setRight(newNode);
+/**
+* Same as insert(const pair&), but tries the position next to hint first,
+* as std::map does: key may go just before hint or just after it. When it
+* does, that takes two or three comparisons instead of a descent, so
+* appending with end() as the hint (or prepending with begin()) skips the
+* search and the new leaf is linked, and retraced by a balanced tree, from
+* there. A wrong hint only costs those comparisons before the usual
+* search. Returns the item with the key.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::insert(
+    const_iterator hint, const std::pair<const Key, Value>& keyValuePair)
+{
+    Node<Key, Value>* parent;
+    bool isLeft;
+    Node<Key, Value>* node = hintPosition(hint.current_, keyValuePair.first, parent, isLeft);
+    if (node) {
+        node->setValue(keyValuePair.second);
+        return makeIterator(node);
     }
 
+    node = createNode(forwardItem<Key, Value>(keyValuePair), parent);
+    linkNode(parent, isLeft, node);
+    return makeIterator(node);
 }
 
-
 /**
 * A remove method to remove a specific key from a Binary Search Tree.
 * Recall: The writeup specifies that if a node has 2 children you
 * should swap with the predecessor and then remove.
 */
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::remove(const Key& key)
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::remove(const Key& key)
 {
     // Find the node to remove
     Node<Key, Value>* removeNode = internalFind(key);
@@ -533,6 +1249,7 @@ void BinarySearchTree<Key, Value>::remove(const Key& key)
     if (!removeNode) {
         return;
     }
+    noteUnlinking(removeNode);
 
     // Iterate until removal is completed
     while (true) {
@@ -602,15 +1319,15 @@ void BinarySearchTree<Key, Value>::remove(const Key& key)
             }
 
             // Delete the removed node
-            delete removeNode;
+            destroyNode(removeNode);
             return; 
         }
     }
 }
 
-template<class Key, class Value>
+template<class Key, class Value, class Compare, class Alloc>
 Node<Key, Value>*
-BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* current)
+BinarySearchTree<Key, Value, Compare, Alloc>::predecessor(Node<Key, Value>* current)
 {
     // TODO : DONE
 
@@ -645,132 +1362,646 @@ BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* current)
     
 }
 
+/**
+* Returns the next node in order, or NULL after the largest node.
+* The mirror image of predecessor(); both iterators advance with it.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+Node<Key, Value>*
+BinarySearchTree<Key, Value, Compare, Alloc>::successor(Node<Key, Value>* current)
+{
+    // If there is right subtree, find left most node
+    if (current -> getRight()){
+        current = current -> getRight();
+        while (current -> getLeft()){
+            current = current -> getLeft();
+        }
+        return current;
+    }
+
+    // Otherwise move until finding node which is left child of parent
+    Node<Key, Value>* parent = current -> getParent();
+    while (parent != nullptr && current == parent -> getRight()){
+        current = parent;
+        parent = parent -> getParent();
+    }
+    // Reached end of tree if parent is null
+    return parent;
+}
+
 
 /**
 * A method to remove all contents of the tree and
 * reset the values in the tree for use again.
 */
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::clear()
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::clear()
 {
     // TODO : DONE
-    clearHelp(root_);
+    releaseNodes();
     root_ = nullptr;
+    leftmost_ = nullptr;
+    rightmost_ = nullptr;
 }
 
 
 /**
-* A helper function to find the smallest node in the tree.
+* A helper function to find the smallest node in the tree. O(1): it is
+* cached in leftmost_.
 */
-template<typename Key, typename Value>
+template<typename Key, typename Value, typename Compare, typename Alloc>
 Node<Key, Value>*
-BinarySearchTree<Key, Value>::getSmallestNode() const
+BinarySearchTree<Key, Value, Compare, Alloc>::getSmallestNode() const
 {
     // TODO : DONE
+    return leftmost_;
+}
 
-    // Start from root and traverse to leftmost node
-    Node<Key, Value>* current = root_;
-    while (current && current->getLeft()){
-        current = current -> getLeft();
-    }
-
-    return current;
-
+/**
+* A helper function to find the largest node in the tree, which is
+* where decrementing end() lands. O(1): it is cached in rightmost_.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+Node<Key, Value>*
+BinarySearchTree<Key, Value, Compare, Alloc>::getLargestNode() const
+{
+    return rightmost_;
 }
 
 /**
 * Helper function to find a node with given key, k and
 * return a pointer to it or NULL if no item with that key
-* exists
+* exists. Like every descent here it does one key comparison
+* per level: the lower bound is the only node that can hold k,
+* and a single extra comparison tells whether it does.
 */
-template<typename Key, typename Value>
-Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) const
+template<typename Key, typename Value, typename Compare, typename Alloc>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare, Alloc>::internalFind(const K& key) const
 {
     // TODO : DONE
+    Node<Key, Value>* bound = internalLowerBound(key);
+    if (bound && !comp_(key, bound->getKey())) {
+        return bound;
+    }
+
+    // If key not found, return null
+    return nullptr;
+}
+
+/**
+* Looks up n keys at once, storing each key's node (or NULL) in out. A
+* single find() stalls on a cache miss at every level; here a group of
+* descents advances in lockstep, one level per descent per round, and each
+* prefetches its next node, so by the time a descent comes around again its
+* node has usually arrived and the misses of the whole group overlap. A
+* finished descent immediately takes on the next key (AMAC style), so the
+* group stays full until the keys run out.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::internalFindMany(
+    const Key* keys, size_t n, Node<Key, Value>** out) const
+{
+    // Enough descents in flight to cover a memory access with useful work
+    const size_t GroupSize = 16;
+
+    struct Descent
+    {
+        Node<Key, Value>* current;
+        Node<Key, Value>* bound;
+        size_t index;
+    };
+    Descent group[GroupSize];
+
+    size_t next = 0;
+    size_t active = 0;
+    while (active < GroupSize && next < n) {
+        group[active++] = Descent{root_, nullptr, next++};
+    }
+
+    while (active > 0) {
+        for (size_t i = 0; i < active; ) {
+            Descent& d = group[i];
+            const Key& key = keys[d.index];
+
+            if (d.current) {
+                // Same one-comparison step as internalLowerBound
+                if (!comp_(d.current->getKey(), key)) {
+                    d.bound = d.current;
+                    d.current = d.current->getLeft();
+                }
+                else {
+                    d.current = d.current->getRight();
+                }
+#if defined(__GNUC__)
+                if (d.current) {
+                    __builtin_prefetch(d.current);
+                }
+#endif
+                ++i;
+                continue;
+            }
 
-    // Start at root
+            // This descent is done: record it, then reuse its slot for the
+            // next key, or retire the slot by moving the last one into it
+            out[d.index] = (d.bound && !comp_(key, d.bound->getKey())) ? d.bound : nullptr;
+            if (next < n) {
+                d = Descent{root_, nullptr, next++};
+            }
+            else {
+                d = group[--active];
+            }
+        }
+    }
+}
+
+/**
+* Looks up every key in keys, filling out with the same iterators find()
+* would return, in the same order. Much faster than calling find() in a
+* loop when the tree doesn't fit in cache; see internalFindMany.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::find_many(
+    const std::vector<Key>& keys, std::vector<iterator>& out)
+{
+    std::vector<Node<Key, Value>*> nodes(keys.size());
+    internalFindMany(keys.data(), keys.size(), nodes.data());
+    out.resize(keys.size());
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        out[i] = makeIterator(nodes[i]);
+    }
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::find_many(
+    const std::vector<Key>& keys, std::vector<const_iterator>& out) const
+{
+    std::vector<Node<Key, Value>*> nodes(keys.size());
+    internalFindMany(keys.data(), keys.size(), nodes.data());
+    out.resize(keys.size());
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        out[i] = makeIterator(nodes[i]);
+    }
+}
+
+/**
+* Wraps a node of this tree in an iterator. Derived trees that find
+* nodes themselves use this too, since the node constructors of the
+* iterators are only visible here.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::makeIterator(Node<Key, Value>* node)
+{
+    return iterator(node, this);
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+typename BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator
+BinarySearchTree<Key, Value, Compare, Alloc>::makeIterator(Node<Key, Value>* node) const
+{
+    return const_iterator(node, this);
+}
+
+/**
+* Helper function for equal_range() finding both bounds in one descent.
+* Keys are unique, so if the lower bound holds k the upper bound is its
+* successor, and otherwise both bounds are the same node.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+template<typename K>
+std::pair<Node<Key, Value>*, Node<Key, Value>*>
+BinarySearchTree<Key, Value, Compare, Alloc>::internalEqualRange(const K& k) const
+{
+    Node<Key, Value>* bound = internalLowerBound(k);
+    if (bound && !comp_(k, bound->getKey())) {
+        return std::make_pair(bound, successor(bound));
+    }
+    return std::make_pair(bound, bound);
+}
+
+/**
+* Helper function returning the node with the smallest key not less
+* than k, or NULL if every key is less than k
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare, Alloc>::internalLowerBound(const K& key) const
+{
     Node<Key, Value>* current = root_;
+    Node<Key, Value>* bound = nullptr;
 
-    // Traverse tree until finding node with key
-    while (current){
+    // Every node we go left from is the best candidate so far
+    while (current) {
+        if (comp_(current->getKey(), key)) {
+            current = current->getRight();
+        }
+        else {
+            bound = current;
+            current = current->getLeft();
+        }
+    }
+    return bound;
+}
+
+/**
+* Helper function returning the node with the smallest key greater
+* than k, or NULL if no key is greater than k
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare, Alloc>::internalUpperBound(const K& key) const
+{
+    Node<Key, Value>* current = root_;
+    Node<Key, Value>* bound = nullptr;
 
-        // If found key, return
-        if (key == current -> getKey()){
-            return current;
+    while (current) {
+        if (comp_(key, current->getKey())) {
+            bound = current;
+            current = current->getLeft();
         }
-        // If key smaller, move to left
-        else if (key < current -> getKey()){
-            current = current -> getLeft();
+        else {
+            current = current->getRight();
+        }
+    }
+    return bound;
+}
+
+/**
+* Helper function for insertion: descends to key with one comparison per
+* level and returns its node if present. Otherwise returns NULL with
+* parent and isLeft describing where a new leaf for key belongs (parent
+* is NULL for an empty tree).
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare, Alloc>::insertPosition(
+    const Key& key, Node<Key, Value>*& parent, bool& isLeft) const
+{
+    Node<Key, Value>* current = root_;
+    Node<Key, Value>* bound = nullptr;
+    parent = nullptr;
+    isLeft = false;
+
+    while (current) {
+        parent = current;
+        isLeft = !comp_(current->getKey(), key);
+        if (isLeft) {
+            bound = current;
+            current = current->getLeft();
         }
-        // If key greatert, move to right
-        else{
-            current = current -> getRight();
+        else {
+            current = current->getRight();
         }
     }
 
-    // If key not found, return null
+    if (bound && !comp_(key, bound->getKey())) {
+        return bound;
+    }
     return nullptr;
 }
 
+/**
+* insertPosition() for a hinted insert: if key belongs between hint's
+* neighbour and hint (end() standing for one past the largest node), or
+* between hint and its other neighbour, the position is found from there;
+* otherwise it falls back to a full descent. The neighbour is found by
+* walking links, so only its key is compared. The extreme nodes are
+* cached, so hints at end(), begin() or the last node (as when appending)
+* find theirs, or learn there is none, in O(1).
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare, Alloc>::hintPosition(
+    Node<Key, Value>* hint, const Key& key, Node<Key, Value>*& parent, bool& isLeft) const
+{
+    if (!hint || comp_(key, hint->getKey())) {
+        // Before hint: after its predecessor, as the right child of the
+        // predecessor if it lies below hint, else as hint's left child
+        Node<Key, Value>* before;
+        if (!hint) {
+            before = getLargestNode();
+        }
+        else if (hint->getLeft()) {
+            before = hint->getLeft();
+            while (before->getRight()) {
+                before = before->getRight();
+            }
+        }
+        else if (hint == leftmost_) {
+            before = nullptr;
+        }
+        else {
+            before = predecessor(hint);
+        }
+
+        if (!before || comp_(before->getKey(), key)) {
+            if (hint && !hint->getLeft()) {
+                parent = hint;
+                isLeft = true;
+            }
+            else {
+                parent = before;
+                isLeft = false;
+            }
+            return nullptr;
+        }
+    }
+    else if (comp_(hint->getKey(), key)) {
+        // After hint: the mirror image
+        Node<Key, Value>* after;
+        if (hint->getRight()) {
+            after = hint->getRight();
+            while (after->getLeft()) {
+                after = after->getLeft();
+            }
+        }
+        else if (hint == rightmost_) {
+            after = nullptr;
+        }
+        else {
+            after = successor(hint);
+        }
+
+        if (!after || comp_(key, after->getKey())) {
+            if (!hint->getRight()) {
+                parent = hint;
+                isLeft = false;
+            }
+            else {
+                parent = after;
+                isLeft = true;
+            }
+            return nullptr;
+        }
+    }
+    else {
+        return hint;
+    }
+    return insertPosition(key, parent, isLeft);
+}
+
 /**
  * Return true iff the BST is balanced.
  */
-template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::isBalanced() const
+template<typename Key, typename Value, typename Compare, typename Alloc>
+bool BinarySearchTree<Key, Value, Compare, Alloc>::isBalanced() const
 {
     // TODO : DONE
-    return isBalancedHelp(root_);
+    return walkHeights(
+        [](const Node<Key, Value>*) { return true; },
+        [](const Node<Key, Value>*, int leftHeight, int rightHeight) {
+            return std::abs(leftHeight - rightHeight) <= 1;
+        });
 }
 
 // Added helper functions
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::clearHelp(Node<Key, Value>* node)
+/**
+* Frees the subtree rooted at node in O(n) time and O(1) space, so even a
+* degenerate tree of depth n (e.g. built from sorted input) can't overflow
+* the stack. Walks down to a leaf, frees it, unhooks it from its parent and
+* continues from the parent; the parent pointers replace the call stack.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::clearHelp(Node<Key, Value>* node)
 {
-    if (node == nullptr) {
-        return;
+    Node<Key, Value>* top = node;
+
+    while (node) {
+        if (node->getLeft()) {
+            node = node->getLeft();
+        }
+        else if (node->getRight()) {
+            node = node->getRight();
+        }
+        else {
+            // A leaf: detach it, unless it is the subtree root whose
+            // parent lies outside the subtree, then free it
+            Node<Key, Value>* parent = (node == top) ? nullptr : node->getParent();
+            if (parent) {
+                if (parent->getLeft() == node) {
+                    parent->setLeft(nullptr);
+                }
+                else {
+                    parent->setRight(nullptr);
+                }
+            }
+            destroyNode(node);
+            node = parent;
+        }
+    }
+}
+
+/**
+* Helper function shared by the insert family: returns the node holding key
+* and false if there is one. Otherwise creates a node from builder, links it
+* in and returns it with true. builder is only invoked in the second case.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+std::pair<Node<Key, Value>*, bool> BinarySearchTree<Key, Value, Compare, Alloc>::insertItem(
+    const Key& key, const ItemBuilder<Key, Value>& builder)
+{
+    Node<Key, Value>* parent;
+    bool isLeft;
+    Node<Key, Value>* existing = insertPosition(key, parent, isLeft);
+    if (existing) {
+        return std::make_pair(existing, false);
     }
 
-    // Recursively clear left and right subtrees
-    clearHelp(node->getLeft());
-    clearHelp(node->getRight());
+    Node<Key, Value>* node = createNode(builder, parent);
+    linkNode(parent, isLeft, node);
+    return std::make_pair(node, true);
+}
 
-    // Delete the current node
-    delete node;
+/**
+* Allocates a new node from the tree's node allocator, constructing its item
+* in place. Trees with their own node type override this and linkNode.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare, Alloc>::createNode(
+    const ItemBuilder<Key, Value>& builder, Node<Key, Value>* parent)
+{
+    return allocateNode<Node<Key, Value> >(nodeAlloc_, builder, parent);
 }
 
-template<typename Key, typename Value>
-int BinarySearchTree<Key, Value>::height(Node<Key, Value>* node) const {
-    if (node == nullptr) {
-        return 0;
-    } 
+/**
+* Links a new leaf as the left or right child of parent (or as the root if
+* parent is NULL), as found by insertPosition. Balanced trees override this
+* to restore their invariants afterwards, calling noteLinked() as this does.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::linkNode(Node<Key, Value>* parent, bool isLeft, Node<Key, Value>* node)
+{
+    noteLinked(parent, isLeft, node);
+    node->setParent(parent);
+    if (parent == nullptr) {
+        root_ = node;
+    }
+    else if (isLeft) {
+        parent->setLeft(node);
+    }
     else {
-        int leftHeight = height(node->getLeft());
-        int rightHeight = height(node->getRight());
-        return std::max(leftHeight, rightHeight) + 1;
+        parent->setRight(node);
     }
 }
 
-template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::isBalancedHelp(Node<Key, Value>* node) const {
-    if (node == nullptr) {
-        return true; // An empty tree is always balanced
+/**
+* Keeps leftmost_ and rightmost_ current as node is linked below parent:
+* a leaf becomes an extreme only as the outer child of the old one.
+* Rotations keep the order, so they never change either.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::noteLinked(
+    Node<Key, Value>* parent, bool isLeft, Node<Key, Value>* node)
+{
+    if (parent == nullptr) {
+        leftmost_ = node;
+        rightmost_ = node;
+    }
+    else if (isLeft && parent == leftmost_) {
+        leftmost_ = node;
     }
+    else if (!isLeft && parent == rightmost_) {
+        rightmost_ = node;
+    }
+}
 
-    // Calculate the height difference between the left and right subtrees
-    int heightDiff = height(node->getLeft()) - height(node->getRight());
+/**
+* Called by every remove path before node is swapped or unlinked: if node
+* is an extreme, its neighbour takes over. The extreme has no outer child,
+* so the neighbour is its parent or within its one short inner subtree.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::noteUnlinking(Node<Key, Value>* node)
+{
+    if (node == leftmost_) {
+        leftmost_ = successor(node);
+    }
+    if (node == rightmost_) {
+        rightmost_ = predecessor(node);
+    }
+}
 
-    // Check if the height difference is within the allowed range [-1, 1]
-    if (std::abs(heightDiff) > 1) {
-        return false;
+/**
+* Installs root after a bulk restructuring (split, join, rebuilds) and
+* finds the extremes again down its spines in O(log n).
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::setRoot(Node<Key, Value>* root)
+{
+    root_ = root;
+    leftmost_ = root;
+    while (leftmost_ && leftmost_->getLeft()) {
+        leftmost_ = leftmost_->getLeft();
+    }
+    rightmost_ = root;
+    while (rightmost_ && rightmost_->getRight()) {
+        rightmost_ = rightmost_->getRight();
     }
+}
 
-    // Recursively check if both left and right subtrees are balanced
-    return isBalancedHelp(node->getLeft()) && isBalancedHelp(node->getRight());
+/**
+* Returns true iff leftmost_ and rightmost_ are the actual extremes, for
+* the validate() of each balanced tree.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+bool BinarySearchTree<Key, Value, Compare, Alloc>::extremesValid() const
+{
+    const Node<Key, Value>* smallest = root_;
+    while (smallest && smallest->getLeft()) {
+        smallest = smallest->getLeft();
+    }
+    const Node<Key, Value>* largest = root_;
+    while (largest && largest->getRight()) {
+        largest = largest->getRight();
+    }
+    return smallest == leftmost_ && largest == rightmost_;
 }
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2)
+/**
+* Frees a single node. Nodes have no virtual destructor, so trees that
+* allocate a derived node type must override this (and releaseNodes) to
+* free through their own allocator, and must call clear() from their own
+* destructor since the overrides are no longer reachable once
+* ~BinarySearchTree runs.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::destroyNode(Node<Key, Value>* node)
+{
+    deallocateNode(nodeAlloc_, node);
+}
+
+/**
+* Frees every node for clear(). When the allocator can release all of its
+* memory at once, shares it with no other tree, and the items need no
+* destructor, the tree is not walked at all; otherwise the walk runs the
+* destructors and returns the nodes one by one.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::releaseNodes()
+{
+    typedef AllocatorRelease<NodeAllocator> Release;
+    bool exclusive = Release::exclusive(nodeAlloc_);
+    if(!exclusive || !std::is_trivially_destructible<std::pair<const Key, Value> >::value) {
+        clearHelp(root_);
+    }
+    if(exclusive) {
+        Release::release(nodeAlloc_);
+    }
+}
+
+/**
+* Walks the whole tree once, in O(n) time, with an explicit stack instead of
+* recursion so skewed trees can't overflow the call stack. Calls
+* inOrder(node) as each node is reached in key order, and
+* postOrder(node, leftHeight, rightHeight) once both of its subtrees are
+* done, where the heights count nodes (an empty subtree has height 0).
+* Stops and returns false as soon as either callback does.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+template<typename InOrder, typename PostOrder>
+bool BinarySearchTree<Key, Value, Compare, Alloc>::walkHeights(InOrder inOrder, PostOrder postOrder) const
+{
+    struct Frame
+    {
+        Node<Key, Value>* node;
+        int leftHeight;
+        bool leftDone;
+    };
+    std::vector<Frame> stack;
+
+    // Height of the subtree finished most recently
+    int height = 0;
+    for (Node<Key, Value>* node = root_; node; node = node->getLeft()) {
+        stack.push_back(Frame{node, 0, false});
+    }
+
+    while (!stack.empty()) {
+        Frame& top = stack.back();
+        if (!top.leftDone) {
+            // Left subtree finished: visit the node, then do its right subtree
+            top.leftDone = true;
+            top.leftHeight = height;
+            if (!inOrder(top.node)) {
+                return false;
+            }
+            height = 0;
+            for (Node<Key, Value>* node = top.node->getRight(); node; node = node->getLeft()) {
+                stack.push_back(Frame{node, 0, false});
+            }
+        }
+        else {
+            if (!postOrder(top.node, top.leftHeight, height)) {
+                return false;
+            }
+            height = std::max(top.leftHeight, height) + 1;
+            stack.pop_back();
+        }
+    }
+    return true;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, Alloc>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2)
 {
     if((n1 == n2) || (n1 == NULL) || (n2 == NULL) ) {
         return;
@@ -0,0 +1,1161 @@
+#ifndef BTREE_H
+#define BTREE_H
+
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include "bst.h"
+
+/**
+* Counts how many of the first n keys of a node are less than key, which is
+* the slot key belongs in. The general version is a binary search with the
+* tree's comparator; unused slots are not read.
+*/
+template <typename Key, typename Compare, typename Enable = void>
+struct BTreeKeySearch
+{
+    // Value that fills unused key slots
+    static Key padding()
+    {
+        return Key();
+    }
+
+    static size_t lessCount(const Key* keys, size_t n, const Key& key, const Compare& comp)
+    {
+        size_t first = 0;
+        while (n > 0) {
+            size_t half = n / 2;
+            if (comp(keys[first + half], key)) {
+                first += half + 1;
+                n -= half + 1;
+            }
+            else {
+                n = half;
+            }
+        }
+        return first;
+    }
+};
+
+/**
+* True for key types the SIMD search below handles: plain integers and
+* floating point numbers ordered by std::less.
+*/
+template <typename Key, typename Compare>
+struct BTreeSimdSearchable : std::integral_constant<bool,
+    ((std::is_integral<Key>::value && !std::is_same<Key, bool>::value) ||
+     std::is_same<Key, float>::value || std::is_same<Key, double>::value) &&
+    (std::is_same<Compare, std::less<Key> >::value || std::is_same<Compare, std::less<> >::value)>
+{
+};
+
+#if defined(__GNUC__)
+/**
+* SIMD search for arithmetic keys, written with GCC/Clang vector extensions
+* so it compiles to whatever vector width the target has. Each step compares
+* a whole cache line of keys against key at once. Unused slots hold
+* padding(), which is never less than any key, so the scan needs no masking
+* and stops at the first cache line that isn't entirely less than key.
+*/
+template <typename Key, typename Compare>
+struct BTreeKeySearch<Key, Compare, typename std::enable_if<BTreeSimdSearchable<Key, Compare>::value>::type>
+{
+    static const size_t Lanes = 64 / sizeof(Key);
+    typedef Key Vector __attribute__((vector_size(64)));
+    typedef decltype(Vector() < Vector()) Mask;
+
+    static Key padding()
+    {
+        return std::numeric_limits<Key>::has_infinity ?
+            std::numeric_limits<Key>::infinity() : std::numeric_limits<Key>::max();
+    }
+
+    static size_t lessCount(const Key* keys, size_t n, const Key& key, const Compare&)
+    {
+        Vector probe = Vector() + key;
+        Mask total = Mask();
+        for (size_t i = 0; i < n; i += Lanes) {
+            Vector chunk;
+            std::memcpy(&chunk, keys + i, sizeof(chunk));
+            Mask less = chunk < probe;
+            total -= less;  // true lanes are -1
+            if (!less[Lanes - 1]) {
+                break;
+            }
+        }
+
+        size_t count = 0;
+        for (size_t lane = 0; lane < Lanes; ++lane) {
+            count += total[lane];
+        }
+        return count;
+    }
+};
+#endif
+
+/**
+* A sorted map stored as a B+ tree, with the same interface as
+* BinarySearchTree. Each node holds up to Slots keys, sized so the keys fill
+* four cache lines, so a lookup takes one or two cache misses per level
+* instead of one per binary node and the tree is a few levels deep even for
+* 100M keys. Items live only in the leaves, which are linked in key order
+* for iteration; inner nodes hold only separator keys.
+*
+* Leaves keep a copy of each key next to the items so a node can be
+* searched without touching the values, with SIMD for arithmetic keys (see
+* BTreeKeySearch). Keys must be default constructible and assignable to
+* fill the key arrays. Items shift within a leaf on insert and remove, so
+* unlike the binary trees, iterators are invalidated by any modification.
+*
+* Shifting an item move constructs it, which copies its const key, and
+* separators are copies of keys. So copying or assigning a Key, and moving
+* a Value, must not throw: a throw partway through a shift leaves the tree
+* inconsistent. Given that, insert() leaves the tree as it was if
+* allocating a node or copying the new item throws.
+*/
+template <typename Key, typename Value,
+          typename Compare = std::less<Key>,
+          typename Alloc = std::allocator<std::pair<const Key, Value> > >
+class BTreeMap
+{
+public:
+    // Keys per node: enough to fill four cache lines, and at least 8
+    static const size_t Slots = (256 / sizeof(Key) < 8) ? 8 : 256 / sizeof(Key);
+
+private:
+    struct Leaf;
+    struct Inner;
+
+public:
+    explicit BTreeMap(const Compare& comp = Compare(), const Alloc& alloc = Alloc());
+    BTreeMap(const BTreeMap& other) = delete;
+    BTreeMap& operator=(const BTreeMap& other) = delete;
+    ~BTreeMap();
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    bool empty() const;
+    size_t size() const;
+    Compare key_comp() const;
+
+    class const_iterator;
+
+    /**
+    * A bidirectional iterator over the items in key order.
+    * Decrementing end() yields the largest item.
+    */
+    class iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::pair<const Key, Value>* pointer;
+        typedef std::pair<const Key, Value>& reference;
+
+        iterator();
+
+        std::pair<const Key, Value>& operator*() const;
+        std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+        iterator operator++(int);
+        iterator& operator--();
+        iterator operator--(int);
+
+    protected:
+        friend class BTreeMap<Key, Value, Compare, Alloc>;
+        friend class const_iterator;
+        iterator(Leaf* leaf, size_t index, const BTreeMap<Key, Value, Compare, Alloc>* tree);
+        Leaf* leaf_;
+        size_t index_;
+        const BTreeMap<Key, Value, Compare, Alloc>* tree_;  // for decrementing end()
+    };
+
+    /**
+    * The read-only counterpart of iterator.
+    */
+    class const_iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const std::pair<const Key, Value>* pointer;
+        typedef const std::pair<const Key, Value>& reference;
+
+        const_iterator();
+        const_iterator(const iterator& it);
+
+        const std::pair<const Key, Value>& operator*() const;
+        const std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const const_iterator& rhs) const;
+        bool operator!=(const const_iterator& rhs) const;
+
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        const_iterator& operator--();
+        const_iterator operator--(int);
+
+    protected:
+        friend class BTreeMap<Key, Value, Compare, Alloc>;
+        const_iterator(Leaf* leaf, size_t index, const BTreeMap<Key, Value, Compare, Alloc>* tree);
+        Leaf* leaf_;
+        size_t index_;
+        const BTreeMap<Key, Value, Compare, Alloc>* tree_;
+    };
+
+    iterator begin();
+    const_iterator begin() const;
+    iterator end();
+    const_iterator end() const;
+    iterator find(const Key& key);
+    const_iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key);
+    const_iterator lower_bound(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+private:
+    typedef BTreeKeySearch<Key, Compare> Search;
+
+    // Fewest keys a non-root node may hold, chosen so that splitting a full
+    // node gives two legal nodes and merging two minimal ones fits in one
+    static const size_t MinLeaf = Slots / 2;
+    static const size_t MinInner = Slots / 2 - 1;
+    // Deep enough for any tree that fits in memory, even at the minimum fanout
+    static const int MaxHeight = 48;
+
+    struct Leaf
+    {
+        Leaf();
+
+        std::pair<const Key, Value>* item(size_t i);
+
+        alignas(64) Key keys_[Slots];
+        size_t count_;
+        Leaf* prev_;
+        Leaf* next_;
+        typename std::aligned_storage<sizeof(std::pair<const Key, Value>),
+                                      alignof(std::pair<const Key, Value>)>::type items_[Slots];
+    };
+
+    // keys_[i] is an upper bound on child i: every key below child i is
+    // <= keys_[i] and every key below child i + 1 is greater
+    struct Inner
+    {
+        Inner();
+
+        alignas(64) Key keys_[Slots];
+        size_t count_;
+        void* children_[Slots + 1];
+    };
+
+    typedef typename std::allocator_traits<Alloc>::template rebind_alloc<Leaf> LeafAllocator;
+    typedef typename std::allocator_traits<Alloc>::template rebind_alloc<Inner> InnerAllocator;
+
+    // Inner node and child index taken at each level of a descent
+    struct Path
+    {
+        Inner* nodes_[MaxHeight];
+        size_t index_[MaxHeight];
+    };
+
+    Leaf* findLeaf(const Key& key, Path* path) const;
+    Leaf* lowerBoundLeaf(const Key& key, size_t& index) const;
+    void insertIntoLeaf(Leaf* leaf, size_t pos, const std::pair<const Key, Value>& keyValuePair);
+    void eraseFromLeaf(Leaf* leaf, size_t pos);
+    void moveItems(Leaf* from, size_t fromPos, Leaf* to, size_t toPos, size_t n);
+    void insertIntoInner(Inner* node, size_t pos, const Key& key, void* right);
+    void eraseFromInner(Inner* node, size_t pos);
+    void splitLeaf(Leaf* leaf, size_t pos, const std::pair<const Key, Value>& keyValuePair, Path& path);
+    void rebalanceLeaf(Leaf* leaf, Path& path);
+    void rebalanceInner(Inner* node, int level, Path& path);
+    void clearHelp(void* node, int level);
+
+    void* root_;
+    int height_;        // levels including the leaves; 0 when empty
+    size_t size_;
+    Leaf* first_;
+    Leaf* last_;
+    Compare comp_;
+    LeafAllocator leafAlloc_;
+    InnerAllocator innerAlloc_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the BTreeMap nodes.
+  -------------------------------------------------
+*/
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+BTreeMap<Key, Value, Compare, Alloc>::Leaf::Leaf() :
+    count_(0),
+    prev_(nullptr),
+    next_(nullptr)
+{
+    for (size_t i = 0; i < Slots; ++i) {
+        keys_[i] = Search::padding();
+    }
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+std::pair<const Key, Value>* BTreeMap<Key, Value, Compare, Alloc>::Leaf::item(size_t i)
+{
+    return std::launder(reinterpret_cast<std::pair<const Key, Value>*>(&items_[i]));
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+BTreeMap<Key, Value, Compare, Alloc>::Inner::Inner() :
+    count_(0)
+{
+    for (size_t i = 0; i < Slots; ++i) {
+        keys_[i] = Search::padding();
+    }
+}
+
+/*
+  -------------------------------------------------
+  End implementations for the BTreeMap nodes.
+  -------------------------------------------------
+*/
+
+/*
+  --------------------------------------------------------
+  Begin implementations for the BTreeMap iterator classes.
+  --------------------------------------------------------
+*/
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+BTreeMap<Key, Value, Compare, Alloc>::iterator::iterator() :
+    leaf_(nullptr),
+    index_(0),
+    tree_(nullptr)
+{
+
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+BTreeMap<Key, Value, Compare, Alloc>::iterator::iterator(
+    Leaf* leaf, size_t index, const BTreeMap<Key, Value, Compare, Alloc>* tree) :
+    leaf_(leaf),
+    index_(index),
+    tree_(tree)
+{
+
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+std::pair<const Key, Value>& BTreeMap<Key, Value, Compare, Alloc>::iterator::operator*() const
+{
+    return *leaf_->item(index_);
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+std::pair<const Key, Value>* BTreeMap<Key, Value, Compare, Alloc>::iterator::operator->() const
+{
+    return leaf_->item(index_);
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+bool BTreeMap<Key, Value, Compare, Alloc>::iterator::operator==(const iterator& rhs) const
+{
+    return leaf_ == rhs.leaf_ && index_ == rhs.index_;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+bool BTreeMap<Key, Value, Compare, Alloc>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* Steps within the leaf, then on to the next leaf; past the last item the
+* iterator becomes end(), which has no leaf.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+typename BTreeMap<Key, Value, Compare, Alloc>::iterator&
+BTreeMap<Key, Value, Compare, Alloc>::iterator::operator++()
+{
+    if (++index_ == leaf_->count_) {
+        leaf_ = leaf_->next_;
+        index_ = 0;
+    }
+    return *this;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+typename BTreeMap<Key, Value, Compare, Alloc>::iterator
+BTreeMap<Key, Value, Compare, Alloc>::iterator::operator++(int)
+{
+    iterator old(*this);
+    ++(*this);
+    return old;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+typename BTreeMap<Key, Value, Compare, Alloc>::iterator&
+BTreeMap<Key, Value, Compare, Alloc>::iterator::operator--()
+{
+    if (!leaf_) {
+        leaf_ = tree_->last_;
+        index_ = leaf_->count_ - 1;
+    }
+    else if (index_ == 0) {
+        leaf_ = leaf_->prev_;
+        index_ = leaf_->count_ - 1;
+    }
+    else {
+        --index_;
+    }
+    return *this;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+typename BTreeMap<Key, Value, Compare, Alloc>::iterator
+BTreeMap<Key, Value, Compare, Alloc>::iterator::operator--(int)
+{
+    iterator old(*this);
+    --(*this);
+    return old;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+BTreeMap<Key, Value, Compare, Alloc>::const_iterator::const_iterator() :
+    leaf_(nullptr),
+    index_(0),
+    tree_(nullptr)
+{
+
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+BTreeMap<Key, Value, Compare, Alloc>::const_iterator::const_iterator(const iterator& it) :
+    leaf_(it.leaf_),
+    index_(it.index_),
+    tree_(it.tree_)
+{
+
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+BTreeMap<Key, Value, Compare, Alloc>::const_iterator::const_iterator(
+    Leaf* leaf, size_t index, const BTreeMap<Key, Value, Compare, Alloc>* tree) :
+    leaf_(leaf),
+    index_(index),
+    tree_(tree)
+{
+
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+const std::pair<const Key, Value>& BTreeMap<Key, Value, Compare, Alloc>::const_iterator::operator*() const
+{
+    return *leaf_->item(index_);
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+const std::pair<const Key, Value>* BTreeMap<Key, Value, Compare, Alloc>::const_iterator::operator->() const
+{
+    return leaf_->item(index_);
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+bool BTreeMap<Key, Value, Compare, Alloc>::const_iterator::operator==(const const_iterator& rhs) const
+{
+    return leaf_ == rhs.leaf_ && index_ == rhs.index_;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+bool BTreeMap<Key, Value, Compare, Alloc>::const_iterator::operator!=(const const_iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+typename BTreeMap<Key, Value, Compare, Alloc>::const_iterator&
+BTreeMap<Key, Value, Compare, Alloc>::const_iterator::operator++()
+{
+    if (++index_ == leaf_->count_) {
+        leaf_ = leaf_->next_;
+        index_ = 0;
+    }
+    return *this;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+typename BTreeMap<Key, Value, Compare, Alloc>::const_iterator
+BTreeMap<Key, Value, Compare, Alloc>::const_iterator::operator++(int)
+{
+    const_iterator old(*this);
+    ++(*this);
+    return old;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+typename BTreeMap<Key, Value, Compare, Alloc>::const_iterator&
+BTreeMap<Key, Value, Compare, Alloc>::const_iterator::operator--()
+{
+    if (!leaf_) {
+        leaf_ = tree_->last_;
+        index_ = leaf_->count_ - 1;
+    }
+    else if (index_ == 0) {
+        leaf_ = leaf_->prev_;
+        index_ = leaf_->count_ - 1;
+    }
+    else {
+        --index_;
+    }
+    return *this;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+typename BTreeMap<Key, Value, Compare, Alloc>::const_iterator
+BTreeMap<Key, Value, Compare, Alloc>::const_iterator::operator--(int)
+{
+    const_iterator old(*this);
+    --(*this);
+    return old;
+}
+
+/*
+  ------------------------------------------------------
+  End implementations for the BTreeMap iterator classes.
+  ------------------------------------------------------
+*/
+
+/*
+  -----------------------------------------------
+  Begin implementations for the BTreeMap class.
+  -----------------------------------------------
+*/
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+BTreeMap<Key, Value, Compare, Alloc>::BTreeMap(const Compare& comp, const Alloc& alloc) :
+    root_(nullptr),
+    height_(0),
+    size_(0),
+    first_(nullptr),
+    last_(nullptr),
+    comp_(comp),
+    leafAlloc_(alloc),
+    innerAlloc_(alloc)
+{
+
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+BTreeMap<Key, Value, Compare, Alloc>::~BTreeMap()
+{
+    clear();
+}
+
+/**
+* Inserts the pair, or overwrites the value if the key is already present.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BTreeMap<Key, Value, Compare, Alloc>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    if (!root_) {
+        Leaf* leaf = allocateNode<Leaf>(leafAlloc_);
+        root_ = first_ = last_ = leaf;
+        height_ = 1;
+    }
+
+    Path path;
+    Leaf* leaf = findLeaf(keyValuePair.first, &path);
+    size_t pos = Search::lessCount(leaf->keys_, leaf->count_, keyValuePair.first, comp_);
+    if (pos < leaf->count_ && !comp_(keyValuePair.first, leaf->keys_[pos])) {
+        leaf->item(pos)->second = keyValuePair.second;
+        return;
+    }
+
+    if (leaf->count_ < Slots) {
+        insertIntoLeaf(leaf, pos, keyValuePair);
+    }
+    else {
+        splitLeaf(leaf, pos, keyValuePair, path);
+    }
+    ++size_;
+}
+
+/**
+* Removes the key if present, merging or refilling nodes that fall below
+* half full on the way back up.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BTreeMap<Key, Value, Compare, Alloc>::remove(const Key& key)
+{
+    if (!root_) {
+        return;
+    }
+
+    Path path;
+    Leaf* leaf = findLeaf(key, &path);
+    size_t pos = Search::lessCount(leaf->keys_, leaf->count_, key, comp_);
+    if (pos == leaf->count_ || comp_(key, leaf->keys_[pos])) {
+        return;
+    }
+
+    eraseFromLeaf(leaf, pos);
+    --size_;
+
+    if (height_ == 1) {
+        if (leaf->count_ == 0) {
+            deallocateNode(leafAlloc_, leaf);
+            root_ = first_ = last_ = nullptr;
+            height_ = 0;
+        }
+    }
+    else if (leaf->count_ < MinLeaf) {
+        rebalanceLeaf(leaf, path);
+    }
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BTreeMap<Key, Value, Compare, Alloc>::clear()
+{
+    if (root_) {
+        clearHelp(root_, height_);
+    }
+    root_ = first_ = last_ = nullptr;
+    height_ = 0;
+    size_ = 0;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+bool BTreeMap<Key, Value, Compare, Alloc>::empty() const
+{
+    return size_ == 0;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+size_t BTreeMap<Key, Value, Compare, Alloc>::size() const
+{
+    return size_;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+Compare BTreeMap<Key, Value, Compare, Alloc>::key_comp() const
+{
+    return comp_;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+typename BTreeMap<Key, Value, Compare, Alloc>::iterator
+BTreeMap<Key, Value, Compare, Alloc>::begin()
+{
+    return iterator(first_, 0, this);
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+typename BTreeMap<Key, Value, Compare, Alloc>::const_iterator
+BTreeMap<Key, Value, Compare, Alloc>::begin() const
+{
+    return const_iterator(first_, 0, this);
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+typename BTreeMap<Key, Value, Compare, Alloc>::iterator
+BTreeMap<Key, Value, Compare, Alloc>::end()
+{
+    return iterator(nullptr, 0, this);
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+typename BTreeMap<Key, Value, Compare, Alloc>::const_iterator
+BTreeMap<Key, Value, Compare, Alloc>::end() const
+{
+    return const_iterator(nullptr, 0, this);
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+typename BTreeMap<Key, Value, Compare, Alloc>::iterator
+BTreeMap<Key, Value, Compare, Alloc>::find(const Key& key)
+{
+    size_t index;
+    Leaf* leaf = lowerBoundLeaf(key, index);
+    if (!leaf || comp_(key, leaf->keys_[index])) {
+        return end();
+    }
+    return iterator(leaf, index, this);
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+typename BTreeMap<Key, Value, Compare, Alloc>::const_iterator
+BTreeMap<Key, Value, Compare, Alloc>::find(const Key& key) const
+{
+    size_t index;
+    Leaf* leaf = lowerBoundLeaf(key, index);
+    if (!leaf || comp_(key, leaf->keys_[index])) {
+        return end();
+    }
+    return const_iterator(leaf, index, this);
+}
+
+/**
+* Returns an iterator to the first item whose key is not less than key
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+typename BTreeMap<Key, Value, Compare, Alloc>::iterator
+BTreeMap<Key, Value, Compare, Alloc>::lower_bound(const Key& key)
+{
+    size_t index;
+    Leaf* leaf = lowerBoundLeaf(key, index);
+    return iterator(leaf, leaf ? index : 0, this);
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+typename BTreeMap<Key, Value, Compare, Alloc>::const_iterator
+BTreeMap<Key, Value, Compare, Alloc>::lower_bound(const Key& key) const
+{
+    size_t index;
+    Leaf* leaf = lowerBoundLeaf(key, index);
+    return const_iterator(leaf, leaf ? index : 0, this);
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<typename Key, typename Value, typename Compare, typename Alloc>
+Value& BTreeMap<Key, Value, Compare, Alloc>::operator[](const Key& key)
+{
+    iterator it = find(key);
+    if (it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc>
+Value const & BTreeMap<Key, Value, Compare, Alloc>::operator[](const Key& key) const
+{
+    const_iterator it = find(key);
+    if (it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+/**
+* Descends from the root to the leaf whose range holds key, recording the
+* inner node and child index at each level in path (indexed by level, with
+* the leaves at level 1) when path is given. The tree must not be empty.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+typename BTreeMap<Key, Value, Compare, Alloc>::Leaf*
+BTreeMap<Key, Value, Compare, Alloc>::findLeaf(const Key& key, Path* path) const
+{
+    void* node = root_;
+    for (int level = height_; level > 1; --level) {
+        Inner* inner = static_cast<Inner*>(node);
+        size_t index = Search::lessCount(inner->keys_, inner->count_, key, comp_);
+        if (path) {
+            path->nodes_[level] = inner;
+            path->index_[level] = index;
+        }
+        node = inner->children_[index];
+    }
+    return static_cast<Leaf*>(node);
+}
+
+/**
+* Finds the first item whose key is not less than key. Returns its leaf and
+* sets index, or returns NULL if there is no such item.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+typename BTreeMap<Key, Value, Compare, Alloc>::Leaf*
+BTreeMap<Key, Value, Compare, Alloc>::lowerBoundLeaf(const Key& key, size_t& index) const
+{
+    if (!root_) {
+        return nullptr;
+    }
+    Leaf* leaf = findLeaf(key, nullptr);
+    index = Search::lessCount(leaf->keys_, leaf->count_, key, comp_);
+    if (index == leaf->count_) {
+        // Only the largest key of a leaf bounds its range, so the answer
+        // (if any) starts the next leaf
+        leaf = leaf->next_;
+        index = 0;
+    }
+    return leaf;
+}
+
+/**
+* Shifts items pos.. right by one and constructs the new item at pos.
+* The leaf must have room.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BTreeMap<Key, Value, Compare, Alloc>::insertIntoLeaf(
+    Leaf* leaf, size_t pos, const std::pair<const Key, Value>& keyValuePair)
+{
+    moveItems(leaf, pos, leaf, pos + 1, leaf->count_ - pos);
+    try {
+        ::new (&leaf->items_[pos]) std::pair<const Key, Value>(keyValuePair);
+    }
+    catch (...) {
+        moveItems(leaf, pos + 1, leaf, pos, leaf->count_ - pos);
+        throw;
+    }
+    leaf->keys_[pos] = keyValuePair.first;
+    ++leaf->count_;
+}
+
+/**
+* Destroys the item at pos and shifts the ones after it left by one.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BTreeMap<Key, Value, Compare, Alloc>::eraseFromLeaf(Leaf* leaf, size_t pos)
+{
+    leaf->item(pos)->~pair();
+    moveItems(leaf, pos + 1, leaf, pos, leaf->count_ - pos - 1);
+    --leaf->count_;
+    leaf->keys_[leaf->count_] = Search::padding();
+}
+
+/**
+* Relocates n items (and their keys) from one position to another, possibly
+* in the same leaf with overlapping ranges. Destination slots must be free
+* and source slots end up free; counts are left to the caller.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BTreeMap<Key, Value, Compare, Alloc>::moveItems(
+    Leaf* from, size_t fromPos, Leaf* to, size_t toPos, size_t n)
+{
+    typedef std::pair<const Key, Value> Item;
+    if (from == to && toPos > fromPos) {
+        for (size_t i = n; i-- > 0; ) {
+            ::new (&to->items_[toPos + i]) Item(std::move(*from->item(fromPos + i)));
+            from->item(fromPos + i)->~Item();
+            to->keys_[toPos + i] = from->keys_[fromPos + i];
+        }
+    }
+    else {
+        for (size_t i = 0; i < n; ++i) {
+            ::new (&to->items_[toPos + i]) Item(std::move(*from->item(fromPos + i)));
+            from->item(fromPos + i)->~Item();
+            to->keys_[toPos + i] = from->keys_[fromPos + i];
+        }
+    }
+}
+
+/**
+* Inserts separator key at pos with right as the child just after it.
+* The node must have room.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BTreeMap<Key, Value, Compare, Alloc>::insertIntoInner(Inner* node, size_t pos, const Key& key, void* right)
+{
+    for (size_t i = node->count_; i > pos; --i) {
+        node->keys_[i] = node->keys_[i - 1];
+        node->children_[i + 1] = node->children_[i];
+    }
+    node->keys_[pos] = key;
+    node->children_[pos + 1] = right;
+    ++node->count_;
+}
+
+/**
+* Removes separator pos and the child just after it.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BTreeMap<Key, Value, Compare, Alloc>::eraseFromInner(Inner* node, size_t pos)
+{
+    for (size_t i = pos; i + 1 < node->count_; ++i) {
+        node->keys_[i] = node->keys_[i + 1];
+        node->children_[i + 1] = node->children_[i + 2];
+    }
+    --node->count_;
+    node->keys_[node->count_] = Search::padding();
+}
+
+/**
+* Splits a full leaf in half, puts the new item in the half it belongs to,
+* and adds the new right leaf to the parent, splitting full inner nodes up
+* the path (and growing a new root) as needed. Every node the split needs
+* is allocated, and the item copied in, before anything is linked, so if
+* either throws the tree is left as it was. That relies on items and keys
+* relocating without throwing, as the class comment requires.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BTreeMap<Key, Value, Compare, Alloc>::splitLeaf(
+    Leaf* leaf, size_t pos, const std::pair<const Key, Value>& keyValuePair, Path& path)
+{
+    // Each full parent splits too, and if they all are a new root grows
+    int top = 2;
+    while (top <= height_ && path.nodes_[top]->count_ == Slots) {
+        ++top;
+    }
+    int needed = top - 2 + (top > height_ ? 1 : 0);
+    Inner* spare[MaxHeight];
+    int spares = 0;
+    Leaf* right = nullptr;
+    try {
+        for (; spares < needed; ++spares) {
+            spare[spares] = allocateNode<Inner>(innerAlloc_);
+        }
+        right = allocateNode<Leaf>(leafAlloc_);
+    }
+    catch (...) {
+        while (spares > 0) {
+            deallocateNode(innerAlloc_, spare[--spares]);
+        }
+        throw;
+    }
+
+    size_t half = Slots / 2;
+    moveItems(leaf, half, right, 0, Slots - half);
+    for (size_t i = half; i < Slots; ++i) {
+        leaf->keys_[i] = Search::padding();
+    }
+    leaf->count_ = half;
+    right->count_ = Slots - half;
+
+    try {
+        if (pos <= half) {
+            insertIntoLeaf(leaf, pos, keyValuePair);
+        }
+        else {
+            insertIntoLeaf(right, pos - half, keyValuePair);
+        }
+    }
+    catch (...) {
+        moveItems(right, 0, leaf, half, Slots - half);
+        leaf->count_ = Slots;
+        deallocateNode(leafAlloc_, right);
+        while (spares > 0) {
+            deallocateNode(innerAlloc_, spare[--spares]);
+        }
+        throw;
+    }
+
+    // Nothing below can throw, as only keys are copied from here on
+    right->next_ = leaf->next_;
+    right->prev_ = leaf;
+    if (leaf->next_) {
+        leaf->next_->prev_ = right;
+    }
+    else {
+        last_ = right;
+    }
+    leaf->next_ = right;
+
+    // Push (separator, right sibling) pairs up until one fits
+    Key separator = leaf->keys_[leaf->count_ - 1];
+    void* child = right;
+    int used = 0;
+    for (int level = 2; ; ++level) {
+        if (level > height_) {
+            Inner* root = spare[used++];
+            root->children_[0] = root_;
+            insertIntoInner(root, 0, separator, child);
+            root_ = root;
+            height_ = level;
+            return;
+        }
+
+        Inner* parent = path.nodes_[level];
+        size_t index = path.index_[level];
+        if (parent->count_ < Slots) {
+            insertIntoInner(parent, index, separator, child);
+            return;
+        }
+
+        // Split the full parent around its middle separator, which moves up
+        Inner* sibling = spare[used++];
+        size_t mid = Slots / 2;
+        Key up = parent->keys_[mid];
+        sibling->count_ = Slots - mid - 1;
+        for (size_t i = 0; i < sibling->count_; ++i) {
+            sibling->keys_[i] = parent->keys_[mid + 1 + i];
+            sibling->children_[i] = parent->children_[mid + 1 + i];
+        }
+        sibling->children_[sibling->count_] = parent->children_[Slots];
+        for (size_t i = mid; i < Slots; ++i) {
+            parent->keys_[i] = Search::padding();
+        }
+        parent->count_ = mid;
+
+        if (index <= mid) {
+            insertIntoInner(parent, index, separator, child);
+        }
+        else {
+            insertIntoInner(sibling, index - mid - 1, separator, child);
+        }
+        separator = up;
+        child = sibling;
+    }
+}
+
+/**
+* Restores a leaf that fell below MinLeaf by borrowing an item from a
+* sibling with some to spare, or else merging with that sibling.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BTreeMap<Key, Value, Compare, Alloc>::rebalanceLeaf(Leaf* leaf, Path& path)
+{
+    Inner* parent = path.nodes_[2];
+    size_t index = path.index_[2];
+
+    if (index > 0) {
+        Leaf* left = static_cast<Leaf*>(parent->children_[index - 1]);
+        if (left->count_ > MinLeaf) {
+            moveItems(leaf, 0, leaf, 1, leaf->count_);
+            moveItems(left, left->count_ - 1, leaf, 0, 1);
+            ++leaf->count_;
+            --left->count_;
+            left->keys_[left->count_] = Search::padding();
+            parent->keys_[index - 1] = left->keys_[left->count_ - 1];
+            return;
+        }
+    }
+    if (index < parent->count_) {
+        Leaf* right = static_cast<Leaf*>(parent->children_[index + 1]);
+        if (right->count_ > MinLeaf) {
+            moveItems(right, 0, leaf, leaf->count_, 1);
+            moveItems(right, 1, right, 0, right->count_ - 1);
+            ++leaf->count_;
+            --right->count_;
+            right->keys_[right->count_] = Search::padding();
+            parent->keys_[index] = leaf->keys_[leaf->count_ - 1];
+            return;
+        }
+    }
+
+    // Neither sibling can spare an item: merge the right one of the pair
+    // into the left one and drop it from the parent
+    size_t leftIndex = (index > 0) ? index - 1 : index;
+    Leaf* left = static_cast<Leaf*>(parent->children_[leftIndex]);
+    Leaf* right = static_cast<Leaf*>(parent->children_[leftIndex + 1]);
+    moveItems(right, 0, left, left->count_, right->count_);
+    left->count_ += right->count_;
+    left->next_ = right->next_;
+    if (right->next_) {
+        right->next_->prev_ = left;
+    }
+    else {
+        last_ = left;
+    }
+    deallocateNode(leafAlloc_, right);
+    eraseFromInner(parent, leftIndex);
+
+    if (height_ == 2 && parent->count_ == 0) {
+        root_ = left;
+        height_ = 1;
+        deallocateNode(innerAlloc_, parent);
+    }
+    else if (height_ > 2 && parent->count_ < MinInner) {
+        rebalanceInner(parent, 2, path);
+    }
+}
+
+/**
+* Same as rebalanceLeaf for an inner node at the given level, rotating a
+* child through the parent's separator or merging around it, and repeating
+* up the path while nodes underflow.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BTreeMap<Key, Value, Compare, Alloc>::rebalanceInner(Inner* node, int level, Path& path)
+{
+    Inner* parent = path.nodes_[level + 1];
+    size_t index = path.index_[level + 1];
+
+    if (index > 0) {
+        Inner* left = static_cast<Inner*>(parent->children_[index - 1]);
+        if (left->count_ > MinInner) {
+            node->children_[node->count_ + 1] = node->children_[node->count_];
+            for (size_t i = node->count_; i > 0; --i) {
+                node->keys_[i] = node->keys_[i - 1];
+                node->children_[i] = node->children_[i - 1];
+            }
+            node->keys_[0] = parent->keys_[index - 1];
+            node->children_[0] = left->children_[left->count_];
+            ++node->count_;
+            parent->keys_[index - 1] = left->keys_[left->count_ - 1];
+            --left->count_;
+            left->keys_[left->count_] = Search::padding();
+            return;
+        }
+    }
+    if (index < parent->count_) {
+        Inner* right = static_cast<Inner*>(parent->children_[index + 1]);
+        if (right->count_ > MinInner) {
+            node->keys_[node->count_] = parent->keys_[index];
+            node->children_[node->count_ + 1] = right->children_[0];
+            ++node->count_;
+            parent->keys_[index] = right->keys_[0];
+            for (size_t i = 0; i + 1 < right->count_; ++i) {
+                right->keys_[i] = right->keys_[i + 1];
+                right->children_[i] = right->children_[i + 1];
+            }
+            right->children_[right->count_ - 1] = right->children_[right->count_];
+            --right->count_;
+            right->keys_[right->count_] = Search::padding();
+            return;
+        }
+    }
+
+    size_t leftIndex = (index > 0) ? index - 1 : index;
+    Inner* left = static_cast<Inner*>(parent->children_[leftIndex]);
+    Inner* right = static_cast<Inner*>(parent->children_[leftIndex + 1]);
+    left->keys_[left->count_] = parent->keys_[leftIndex];
+    for (size_t i = 0; i < right->count_; ++i) {
+        left->keys_[left->count_ + 1 + i] = right->keys_[i];
+        left->children_[left->count_ + 1 + i] = right->children_[i];
+    }
+    left->children_[left->count_ + 1 + right->count_] = right->children_[right->count_];
+    left->count_ += right->count_ + 1;
+    deallocateNode(innerAlloc_, right);
+    eraseFromInner(parent, leftIndex);
+
+    if (level + 1 == height_ && parent->count_ == 0) {
+        root_ = left;
+        --height_;
+        deallocateNode(innerAlloc_, parent);
+    }
+    else if (level + 1 < height_ && parent->count_ < MinInner) {
+        rebalanceInner(parent, level + 1, path);
+    }
+}
+
+/**
+* Frees the subtree at node, whose level is given since nodes don't record
+* whether they are leaves. Recursion depth is the tree height.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc>
+void BTreeMap<Key, Value, Compare, Alloc>::clearHelp(void* node, int level)
+{
+    if (level == 1) {
+        Leaf* leaf = static_cast<Leaf*>(node);
+        for (size_t i = 0; i < leaf->count_; ++i) {
+            leaf->item(i)->~pair();
+        }
+        deallocateNode(leafAlloc_, leaf);
+        return;
+    }
+
+    Inner* inner = static_cast<Inner*>(node);
+    for (size_t i = 0; i <= inner->count_; ++i) {
+        clearHelp(inner->children_[i], level - 1);
+    }
+    deallocateNode(innerAlloc_, inner);
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the BTreeMap class.
+  ---------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,1219 @@
+#ifndef COMPACT_AVL_H
+#define COMPACT_AVL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+* Storage policies for CompactAVLTree. InlineValues keeps each item's
+* pair in its node. SeparateValues keeps only the key in the node and the
+* value in an arena beside the pool, at the same index, so a descent only
+* pulls keys and links into cache however large the values are.
+*/
+struct InlineValues { };
+struct SeparateValues { };
+
+/**
+* A SeparateValues tree's view of an item: the key and value by reference,
+* read through first and second like the pair an InlineValues tree yields.
+* V is Value or const Value.
+*/
+template <typename Key, typename V>
+struct CompactItemRef
+{
+    const Key& first;
+    V& second;
+
+    operator std::pair<const Key, typename std::remove_const<V>::type>() const
+    {
+        return std::pair<const Key, typename std::remove_const<V>::type>(first, second);
+    }
+};
+
+/**
+* What operator-> returns for a SeparateValues tree, there being no pair
+* in memory to point to.
+*/
+template <typename Ref>
+struct CompactItemArrow
+{
+    const Ref* operator->() const
+    {
+        return &ref_;
+    }
+
+    Ref ref_;
+};
+
+/**
+* An AVL tree with the same interface as BTreeMap whose nodes sit in a pool
+* and link to each other by 32-bit index rather than by pointer. A node is
+* just the item and three indices, the parent's carrying the balance in its
+* top two bits, with no vtable and no allocation of its own: 32 bytes for a
+* pair<uint64_t, uint64_t> against AVLNode's 56 plus malloc's overhead, so
+* twice as many nodes share each cache line on the way down.
+*
+* The pool grows in chunks that double in size up to 2^20 nodes and stay
+* at that size after, so small trees stay small, large ones never copy
+* their items to grow, and the chunk table is small enough to stay in
+* cache. Removed nodes' slots are reused. Items never move, so iterators
+* and references stay valid until their item is removed. The tree holds
+* at most 2^30 - 1 items (length_error past that).
+*
+* With the SeparateValues storage policy, iterators yield a CompactItemRef
+* instead of a pair reference; it->first and it->second read the same.
+*/
+template <typename Key, typename Value,
+          typename Compare = std::less<Key>,
+          typename Alloc = std::allocator<std::pair<const Key, Value> >,
+          typename Storage = InlineValues>
+class CompactAVLTree
+{
+    static const bool SeparateStorage = std::is_same<Storage, SeparateValues>::value;
+
+public:
+    typedef typename std::conditional<SeparateStorage,
+        CompactItemRef<Key, Value>, std::pair<const Key, Value>&>::type reference;
+    typedef typename std::conditional<SeparateStorage,
+        CompactItemRef<Key, const Value>, const std::pair<const Key, Value>&>::type const_reference;
+    typedef typename std::conditional<SeparateStorage,
+        CompactItemArrow<reference>, std::pair<const Key, Value>*>::type pointer;
+    typedef typename std::conditional<SeparateStorage,
+        CompactItemArrow<const_reference>, const std::pair<const Key, Value>*>::type const_pointer;
+
+    explicit CompactAVLTree(const Compare& comp = Compare(), const Alloc& alloc = Alloc());
+    CompactAVLTree(const CompactAVLTree& other) = delete;
+    CompactAVLTree& operator=(const CompactAVLTree& other) = delete;
+    ~CompactAVLTree();
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    bool empty() const;
+    size_t size() const;
+    size_t capacity() const;
+    Compare key_comp() const;
+
+    class const_iterator;
+
+    /**
+    * A bidirectional iterator over the items in key order.
+    * Decrementing end() yields the largest item.
+    */
+    class iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef typename CompactAVLTree::pointer pointer;
+        typedef typename CompactAVLTree::reference reference;
+
+        iterator();
+
+        reference operator*() const;
+        pointer operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+        iterator operator++(int);
+        iterator& operator--();
+        iterator operator--(int);
+
+    protected:
+        friend class CompactAVLTree<Key, Value, Compare, Alloc, Storage>;
+        friend class const_iterator;
+        iterator(uint32_t index, const CompactAVLTree<Key, Value, Compare, Alloc, Storage>* tree);
+        uint32_t index_;
+        const CompactAVLTree<Key, Value, Compare, Alloc, Storage>* tree_;
+    };
+
+    /**
+    * The read-only counterpart of iterator.
+    */
+    class const_iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef typename CompactAVLTree::const_pointer pointer;
+        typedef typename CompactAVLTree::const_reference reference;
+
+        const_iterator();
+        const_iterator(const iterator& it);
+
+        reference operator*() const;
+        pointer operator->() const;
+
+        bool operator==(const const_iterator& rhs) const;
+        bool operator!=(const const_iterator& rhs) const;
+
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        const_iterator& operator--();
+        const_iterator operator--(int);
+
+    protected:
+        friend class CompactAVLTree<Key, Value, Compare, Alloc, Storage>;
+        const_iterator(uint32_t index, const CompactAVLTree<Key, Value, Compare, Alloc, Storage>* tree);
+        uint32_t index_;
+        const CompactAVLTree<Key, Value, Compare, Alloc, Storage>* tree_;
+    };
+
+    iterator begin();
+    const_iterator begin() const;
+    iterator end();
+    const_iterator end() const;
+    iterator find(const Key& key);
+    const_iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key);
+    const_iterator lower_bound(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+    bool validate() const;
+
+private:
+    // Index 0 is the null link, so slot i is stored at pool position i - 1
+    static const uint32_t Null = 0;
+    static const uint32_t MaxIndex = (uint32_t(1) << 30) - 1;
+    static const uint32_t IndexMask = MaxIndex;
+    static const int BalanceShift = 30;
+    // The first chunk holds 2^FirstShift slots, each one after twice as
+    // many up to 2^LastShift, then all chunks hold 2^LastShift
+    static const int FirstShift = 6;
+    static const int LastShift = 20;
+    static const size_t GrowingChunks = LastShift - FirstShift;
+
+    // What a node holds besides its links: the whole item, or just the key
+    typedef typename std::conditional<SeparateStorage,
+        Key, std::pair<const Key, Value> >::type Stored;
+
+    struct Slot
+    {
+        Stored* stored();
+
+        typename std::aligned_storage<sizeof(Stored), alignof(Stored)>::type stored_;
+        uint32_t left_;
+        uint32_t right_;
+        uint32_t parent_;  // parent index, with balance + 1 in the top two bits
+    };
+
+    typedef typename std::aligned_storage<sizeof(Value), alignof(Value)>::type ValueSlot;
+    typedef typename std::allocator_traits<Alloc>::template rebind_alloc<Slot> SlotAllocator;
+    typedef typename std::allocator_traits<Alloc>::template rebind_alloc<ValueSlot> ValueAllocator;
+
+    static void locate(uint32_t index, size_t& chunk, size_t& offset);
+    Slot& slot(uint32_t index) const;
+    static size_t chunkSlots(size_t chunk);
+    const Key& key(uint32_t index) const;
+    Value& value(uint32_t index) const;
+    reference itemRef(uint32_t index) const;
+    pointer itemPtr(uint32_t index) const;
+    const_reference constItemRef(uint32_t index) const;
+    const_pointer constItemPtr(uint32_t index) const;
+    void constructItem(uint32_t index, const std::pair<const Key, Value>& keyValuePair);
+    void destroyItem(uint32_t index);
+    uint32_t left(uint32_t index) const;
+    uint32_t right(uint32_t index) const;
+    uint32_t parent(uint32_t index) const;
+    int balance(uint32_t index) const;
+    void setParent(uint32_t index, uint32_t parent);
+    void setBalance(uint32_t index, int balance);
+    void replaceChild(uint32_t parent, uint32_t oldChild, uint32_t newChild);
+
+    uint32_t first() const;
+    uint32_t last() const;
+    uint32_t next(uint32_t index) const;
+    uint32_t prev(uint32_t index) const;
+    uint32_t lowerBoundIndex(const Key& key) const;
+    uint32_t findIndex(const Key& key) const;
+
+    uint32_t allocateSlot();
+    void releaseSlot(uint32_t index);
+    void rotateUp(uint32_t child);
+    uint32_t rebalance(uint32_t node, int balance);
+    void retraceInsert(uint32_t node);
+    void retraceRemove(uint32_t node, bool leftShrank);
+    int validateHelp(uint32_t node, uint32_t parent, bool& ok) const;
+
+    std::vector<Slot*> chunks_;
+    std::vector<ValueSlot*> valueChunks_;  // SeparateValues only, sized like chunks_
+    uint32_t root_;
+    uint32_t used_;     // slots ever handed out, so the next fresh index is used_ + 1
+    uint32_t free_;     // head of the list of released slots, linked by left_
+    size_t size_;
+    Compare comp_;
+    SlotAllocator slotAlloc_;
+    ValueAllocator valueAlloc_;
+};
+
+/*
+  -------------------------------------------------------------
+  Begin implementations for the CompactAVLTree iterator classes.
+  -------------------------------------------------------------
+*/
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+CompactAVLTree<Key, Value, Compare, Alloc, Storage>::iterator::iterator() :
+    index_(Null),
+    tree_(nullptr)
+{
+
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+CompactAVLTree<Key, Value, Compare, Alloc, Storage>::iterator::iterator(
+    uint32_t index, const CompactAVLTree<Key, Value, Compare, Alloc, Storage>* tree) :
+    index_(index),
+    tree_(tree)
+{
+
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+typename CompactAVLTree<Key, Value, Compare, Alloc, Storage>::reference
+CompactAVLTree<Key, Value, Compare, Alloc, Storage>::iterator::operator*() const
+{
+    return tree_->itemRef(index_);
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+typename CompactAVLTree<Key, Value, Compare, Alloc, Storage>::pointer
+CompactAVLTree<Key, Value, Compare, Alloc, Storage>::iterator::operator->() const
+{
+    return tree_->itemPtr(index_);
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+bool CompactAVLTree<Key, Value, Compare, Alloc, Storage>::iterator::operator==(const iterator& rhs) const
+{
+    return index_ == rhs.index_;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+bool CompactAVLTree<Key, Value, Compare, Alloc, Storage>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+typename CompactAVLTree<Key, Value, Compare, Alloc, Storage>::iterator&
+CompactAVLTree<Key, Value, Compare, Alloc, Storage>::iterator::operator++()
+{
+    index_ = tree_->next(index_);
+    return *this;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+typename CompactAVLTree<Key, Value, Compare, Alloc, Storage>::iterator
+CompactAVLTree<Key, Value, Compare, Alloc, Storage>::iterator::operator++(int)
+{
+    iterator old(*this);
+    ++(*this);
+    return old;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+typename CompactAVLTree<Key, Value, Compare, Alloc, Storage>::iterator&
+CompactAVLTree<Key, Value, Compare, Alloc, Storage>::iterator::operator--()
+{
+    index_ = (index_ == Null) ? tree_->last() : tree_->prev(index_);
+    return *this;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+typename CompactAVLTree<Key, Value, Compare, Alloc, Storage>::iterator
+CompactAVLTree<Key, Value, Compare, Alloc, Storage>::iterator::operator--(int)
+{
+    iterator old(*this);
+    --(*this);
+    return old;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+CompactAVLTree<Key, Value, Compare, Alloc, Storage>::const_iterator::const_iterator() :
+    index_(Null),
+    tree_(nullptr)
+{
+
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+CompactAVLTree<Key, Value, Compare, Alloc, Storage>::const_iterator::const_iterator(const iterator& it) :
+    index_(it.index_),
+    tree_(it.tree_)
+{
+
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+CompactAVLTree<Key, Value, Compare, Alloc, Storage>::const_iterator::const_iterator(
+    uint32_t index, const CompactAVLTree<Key, Value, Compare, Alloc, Storage>* tree) :
+    index_(index),
+    tree_(tree)
+{
+
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+typename CompactAVLTree<Key, Value, Compare, Alloc, Storage>::const_reference
+CompactAVLTree<Key, Value, Compare, Alloc, Storage>::const_iterator::operator*() const
+{
+    return tree_->constItemRef(index_);
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+typename CompactAVLTree<Key, Value, Compare, Alloc, Storage>::const_pointer
+CompactAVLTree<Key, Value, Compare, Alloc, Storage>::const_iterator::operator->() const
+{
+    return tree_->constItemPtr(index_);
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+bool CompactAVLTree<Key, Value, Compare, Alloc, Storage>::const_iterator::operator==(const const_iterator& rhs) const
+{
+    return index_ == rhs.index_;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+bool CompactAVLTree<Key, Value, Compare, Alloc, Storage>::const_iterator::operator!=(const const_iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+typename CompactAVLTree<Key, Value, Compare, Alloc, Storage>::const_iterator&
+CompactAVLTree<Key, Value, Compare, Alloc, Storage>::const_iterator::operator++()
+{
+    index_ = tree_->next(index_);
+    return *this;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+typename CompactAVLTree<Key, Value, Compare, Alloc, Storage>::const_iterator
+CompactAVLTree<Key, Value, Compare, Alloc, Storage>::const_iterator::operator++(int)
+{
+    const_iterator old(*this);
+    ++(*this);
+    return old;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+typename CompactAVLTree<Key, Value, Compare, Alloc, Storage>::const_iterator&
+CompactAVLTree<Key, Value, Compare, Alloc, Storage>::const_iterator::operator--()
+{
+    index_ = (index_ == Null) ? tree_->last() : tree_->prev(index_);
+    return *this;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+typename CompactAVLTree<Key, Value, Compare, Alloc, Storage>::const_iterator
+CompactAVLTree<Key, Value, Compare, Alloc, Storage>::const_iterator::operator--(int)
+{
+    const_iterator old(*this);
+    --(*this);
+    return old;
+}
+
+/*
+  -----------------------------------------------------------
+  End implementations for the CompactAVLTree iterator classes.
+  -----------------------------------------------------------
+*/
+
+/*
+  ----------------------------------------------------
+  Begin implementations for the CompactAVLTree class.
+  ----------------------------------------------------
+*/
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+typename CompactAVLTree<Key, Value, Compare, Alloc, Storage>::Stored*
+CompactAVLTree<Key, Value, Compare, Alloc, Storage>::Slot::stored()
+{
+    return std::launder(reinterpret_cast<Stored*>(&stored_));
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+CompactAVLTree<Key, Value, Compare, Alloc, Storage>::CompactAVLTree(const Compare& comp, const Alloc& alloc) :
+    root_(Null),
+    used_(0),
+    free_(Null),
+    size_(0),
+    comp_(comp),
+    slotAlloc_(alloc),
+    valueAlloc_(alloc)
+{
+
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+CompactAVLTree<Key, Value, Compare, Alloc, Storage>::~CompactAVLTree()
+{
+    clear();
+}
+
+/**
+* Inserts the pair, or overwrites the value if the key is already present.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+void CompactAVLTree<Key, Value, Compare, Alloc, Storage>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    // One comparison per level, as in BinarySearchTree::insertPosition:
+    // the lower bound is the only node that can hold the key
+    uint32_t parent = Null;
+    uint32_t current = root_;
+    uint32_t bound = Null;
+    bool isLeft = false;
+    while (current != Null) {
+        parent = current;
+        isLeft = !comp_(key(current), keyValuePair.first);
+        if (isLeft) {
+            bound = current;
+            current = left(current);
+        }
+        else {
+            current = right(current);
+        }
+    }
+    if (bound != Null && !comp_(keyValuePair.first, key(bound))) {
+        value(bound) = keyValuePair.second;
+        return;
+    }
+
+    uint32_t node = allocateSlot();
+    Slot& s = slot(node);
+    try {
+        constructItem(node, keyValuePair);
+    }
+    catch (...) {
+        s.left_ = free_;
+        free_ = node;
+        throw;
+    }
+    s.left_ = Null;
+    s.right_ = Null;
+    s.parent_ = parent;
+    setBalance(node, 0);
+    ++size_;
+
+    if (parent == Null) {
+        root_ = node;
+    }
+    else if (isLeft) {
+        slot(parent).left_ = node;
+    }
+    else {
+        slot(parent).right_ = node;
+    }
+    retraceInsert(node);
+}
+
+/**
+* Removes the item with key, if any. A node with two children is replaced
+* by its predecessor node, relinked rather than copied, so no other item
+* moves.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+void CompactAVLTree<Key, Value, Compare, Alloc, Storage>::remove(const Key& key)
+{
+    uint32_t node = findIndex(key);
+    if (node == Null) {
+        return;
+    }
+
+    uint32_t up = parent(node);
+    uint32_t retrace;
+    bool leftShrank;
+    if (left(node) != Null && right(node) != Null) {
+        uint32_t pred = left(node);
+        while (right(pred) != Null) {
+            pred = right(pred);
+        }
+
+        if (pred == left(node)) {
+            // pred keeps its left subtree, which is one shorter than the
+            // subtree pred headed
+            retrace = pred;
+            leftShrank = true;
+        }
+        else {
+            uint32_t predParent = parent(pred);
+            uint32_t predLeft = left(pred);
+            slot(predParent).right_ = predLeft;
+            if (predLeft != Null) {
+                setParent(predLeft, predParent);
+            }
+            slot(pred).left_ = left(node);
+            setParent(left(node), pred);
+            retrace = predParent;
+            leftShrank = false;
+        }
+        slot(pred).right_ = right(node);
+        setParent(right(node), pred);
+        setParent(pred, up);
+        setBalance(pred, balance(node));
+        replaceChild(up, node, pred);
+    }
+    else {
+        uint32_t child = (left(node) != Null) ? left(node) : right(node);
+        if (child != Null) {
+            setParent(child, up);
+        }
+        leftShrank = (up != Null && left(up) == node);
+        replaceChild(up, node, child);
+        retrace = up;
+    }
+
+    releaseSlot(node);
+    --size_;
+    if (retrace != Null) {
+        retraceRemove(retrace, leftShrank);
+    }
+}
+
+/**
+* Destroys every item and returns all chunks to the allocator.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+void CompactAVLTree<Key, Value, Compare, Alloc, Storage>::clear()
+{
+    if (!std::is_trivially_destructible<Stored>::value || !std::is_trivially_destructible<Value>::value) {
+        for (uint32_t node = first(); node != Null; node = next(node)) {
+            destroyItem(node);
+        }
+    }
+    for (size_t i = 0; i < chunks_.size(); ++i) {
+        std::allocator_traits<SlotAllocator>::deallocate(slotAlloc_, chunks_[i], chunkSlots(i));
+    }
+    for (size_t i = 0; i < valueChunks_.size(); ++i) {
+        std::allocator_traits<ValueAllocator>::deallocate(valueAlloc_, valueChunks_[i], chunkSlots(i));
+    }
+    chunks_.clear();
+    valueChunks_.clear();
+    root_ = Null;
+    used_ = 0;
+    free_ = Null;
+    size_ = 0;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+bool CompactAVLTree<Key, Value, Compare, Alloc, Storage>::empty() const
+{
+    return size_ == 0;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+size_t CompactAVLTree<Key, Value, Compare, Alloc, Storage>::size() const
+{
+    return size_;
+}
+
+/**
+* Slots allocated so far, in use or not. The pool's memory is
+* capacity() * sizeof(Slot) plus the chunk table, and with SeparateValues
+* capacity() * sizeof(Value) more for the value arena.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+size_t CompactAVLTree<Key, Value, Compare, Alloc, Storage>::capacity() const
+{
+    size_t slots = 0;
+    for (size_t i = 0; i < chunks_.size(); ++i) {
+        slots += chunkSlots(i);
+    }
+    return slots;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+Compare CompactAVLTree<Key, Value, Compare, Alloc, Storage>::key_comp() const
+{
+    return comp_;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+typename CompactAVLTree<Key, Value, Compare, Alloc, Storage>::iterator
+CompactAVLTree<Key, Value, Compare, Alloc, Storage>::begin()
+{
+    return iterator(first(), this);
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+typename CompactAVLTree<Key, Value, Compare, Alloc, Storage>::const_iterator
+CompactAVLTree<Key, Value, Compare, Alloc, Storage>::begin() const
+{
+    return const_iterator(first(), this);
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+typename CompactAVLTree<Key, Value, Compare, Alloc, Storage>::iterator
+CompactAVLTree<Key, Value, Compare, Alloc, Storage>::end()
+{
+    return iterator(Null, this);
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+typename CompactAVLTree<Key, Value, Compare, Alloc, Storage>::const_iterator
+CompactAVLTree<Key, Value, Compare, Alloc, Storage>::end() const
+{
+    return const_iterator(Null, this);
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+typename CompactAVLTree<Key, Value, Compare, Alloc, Storage>::iterator
+CompactAVLTree<Key, Value, Compare, Alloc, Storage>::find(const Key& key)
+{
+    return iterator(findIndex(key), this);
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+typename CompactAVLTree<Key, Value, Compare, Alloc, Storage>::const_iterator
+CompactAVLTree<Key, Value, Compare, Alloc, Storage>::find(const Key& key) const
+{
+    return const_iterator(findIndex(key), this);
+}
+
+/**
+* Returns an iterator to the first item whose key is not less than key
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+typename CompactAVLTree<Key, Value, Compare, Alloc, Storage>::iterator
+CompactAVLTree<Key, Value, Compare, Alloc, Storage>::lower_bound(const Key& key)
+{
+    return iterator(lowerBoundIndex(key), this);
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+typename CompactAVLTree<Key, Value, Compare, Alloc, Storage>::const_iterator
+CompactAVLTree<Key, Value, Compare, Alloc, Storage>::lower_bound(const Key& key) const
+{
+    return const_iterator(lowerBoundIndex(key), this);
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+Value& CompactAVLTree<Key, Value, Compare, Alloc, Storage>::operator[](const Key& key)
+{
+    iterator it = find(key);
+    if (it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+Value const & CompactAVLTree<Key, Value, Compare, Alloc, Storage>::operator[](const Key& key) const
+{
+    const_iterator it = find(key);
+    if (it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+/**
+* Checks order, parent links, stored balances against measured heights, and
+* the item count. Meant for tests.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+bool CompactAVLTree<Key, Value, Compare, Alloc, Storage>::validate() const
+{
+    bool ok = true;
+    validateHelp(root_, Null, ok);
+    size_t count = 0;
+    for (uint32_t node = first(), before = Null; node != Null; before = node, node = next(node)) {
+        if (before != Null && !comp_(key(before), key(node))) {
+            ok = false;
+        }
+        ++count;
+    }
+    return ok && count == size_;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+int CompactAVLTree<Key, Value, Compare, Alloc, Storage>::validateHelp(uint32_t node, uint32_t up, bool& ok) const
+{
+    if (node == Null) {
+        return 0;
+    }
+    if (parent(node) != up) {
+        ok = false;
+    }
+    int leftHeight = validateHelp(left(node), node, ok);
+    int rightHeight = validateHelp(right(node), node, ok);
+    if (balance(node) != rightHeight - leftHeight) {
+        ok = false;
+    }
+    return 1 + (leftHeight > rightHeight ? leftHeight : rightHeight);
+}
+
+/**
+* Finds the chunk and offset of an index's slot. The growing chunks are
+* told apart by the bit length of the position, offset so the first chunk
+* starts at 2^FirstShift.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+void CompactAVLTree<Key, Value, Compare, Alloc, Storage>::locate(uint32_t index, size_t& chunk, size_t& offset)
+{
+    size_t position = size_t(index) - 1 + (size_t(1) << FirstShift);
+    if (position >= (size_t(1) << LastShift)) {
+        chunk = GrowingChunks - 1 + (position >> LastShift);
+        offset = position & ((size_t(1) << LastShift) - 1);
+        return;
+    }
+#if defined(__GNUC__)
+    int bits = 31 - __builtin_clz(static_cast<unsigned>(position));
+#else
+    int bits = 0;
+    for (size_t rest = position >> 1; rest; rest >>= 1) {
+        ++bits;
+    }
+#endif
+    chunk = bits - FirstShift;
+    offset = position - (size_t(1) << bits);
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+typename CompactAVLTree<Key, Value, Compare, Alloc, Storage>::Slot&
+CompactAVLTree<Key, Value, Compare, Alloc, Storage>::slot(uint32_t index) const
+{
+    size_t chunk, offset;
+    locate(index, chunk, offset);
+    return chunks_[chunk][offset];
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+size_t CompactAVLTree<Key, Value, Compare, Alloc, Storage>::chunkSlots(size_t chunk)
+{
+    return size_t(1) << (chunk < GrowingChunks ? FirstShift + chunk : LastShift);
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+const Key& CompactAVLTree<Key, Value, Compare, Alloc, Storage>::key(uint32_t index) const
+{
+    if constexpr (SeparateStorage) {
+        return *slot(index).stored();
+    }
+    else {
+        return slot(index).stored()->first;
+    }
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+Value& CompactAVLTree<Key, Value, Compare, Alloc, Storage>::value(uint32_t index) const
+{
+    if constexpr (SeparateStorage) {
+        size_t chunk, offset;
+        locate(index, chunk, offset);
+        return *std::launder(reinterpret_cast<Value*>(&valueChunks_[chunk][offset]));
+    }
+    else {
+        return slot(index).stored()->second;
+    }
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+typename CompactAVLTree<Key, Value, Compare, Alloc, Storage>::reference
+CompactAVLTree<Key, Value, Compare, Alloc, Storage>::itemRef(uint32_t index) const
+{
+    if constexpr (SeparateStorage) {
+        return reference{ key(index), value(index) };
+    }
+    else {
+        return *slot(index).stored();
+    }
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+typename CompactAVLTree<Key, Value, Compare, Alloc, Storage>::pointer
+CompactAVLTree<Key, Value, Compare, Alloc, Storage>::itemPtr(uint32_t index) const
+{
+    if constexpr (SeparateStorage) {
+        return pointer{ itemRef(index) };
+    }
+    else {
+        return slot(index).stored();
+    }
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+typename CompactAVLTree<Key, Value, Compare, Alloc, Storage>::const_reference
+CompactAVLTree<Key, Value, Compare, Alloc, Storage>::constItemRef(uint32_t index) const
+{
+    if constexpr (SeparateStorage) {
+        return const_reference{ key(index), value(index) };
+    }
+    else {
+        return *slot(index).stored();
+    }
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+typename CompactAVLTree<Key, Value, Compare, Alloc, Storage>::const_pointer
+CompactAVLTree<Key, Value, Compare, Alloc, Storage>::constItemPtr(uint32_t index) const
+{
+    if constexpr (SeparateStorage) {
+        return const_pointer{ constItemRef(index) };
+    }
+    else {
+        return slot(index).stored();
+    }
+}
+
+/**
+* Constructs the item in a freshly taken slot. With SeparateValues a
+* throwing Value constructor leaves the key destroyed again.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+void CompactAVLTree<Key, Value, Compare, Alloc, Storage>::constructItem(
+    uint32_t index, const std::pair<const Key, Value>& keyValuePair)
+{
+    Slot& s = slot(index);
+    if constexpr (SeparateStorage) {
+        size_t chunk, offset;
+        locate(index, chunk, offset);
+        ::new (static_cast<void*>(&s.stored_)) Key(keyValuePair.first);
+        try {
+            ::new (static_cast<void*>(&valueChunks_[chunk][offset])) Value(keyValuePair.second);
+        }
+        catch (...) {
+            std::destroy_at(s.stored());
+            throw;
+        }
+    }
+    else {
+        ::new (static_cast<void*>(&s.stored_)) std::pair<const Key, Value>(keyValuePair);
+    }
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+void CompactAVLTree<Key, Value, Compare, Alloc, Storage>::destroyItem(uint32_t index)
+{
+    std::destroy_at(slot(index).stored());
+    if constexpr (SeparateStorage) {
+        std::destroy_at(&value(index));
+    }
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+uint32_t CompactAVLTree<Key, Value, Compare, Alloc, Storage>::left(uint32_t index) const
+{
+    return slot(index).left_;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+uint32_t CompactAVLTree<Key, Value, Compare, Alloc, Storage>::right(uint32_t index) const
+{
+    return slot(index).right_;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+uint32_t CompactAVLTree<Key, Value, Compare, Alloc, Storage>::parent(uint32_t index) const
+{
+    return slot(index).parent_ & IndexMask;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+int CompactAVLTree<Key, Value, Compare, Alloc, Storage>::balance(uint32_t index) const
+{
+    return static_cast<int>(slot(index).parent_ >> BalanceShift) - 1;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+void CompactAVLTree<Key, Value, Compare, Alloc, Storage>::setParent(uint32_t index, uint32_t parent)
+{
+    uint32_t& word = slot(index).parent_;
+    word = (word & ~IndexMask) | parent;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+void CompactAVLTree<Key, Value, Compare, Alloc, Storage>::setBalance(uint32_t index, int balance)
+{
+    uint32_t& word = slot(index).parent_;
+    word = (word & IndexMask) | (static_cast<uint32_t>(balance + 1) << BalanceShift);
+}
+
+/**
+* Points parent's link to oldChild at newChild instead, or the root if
+* parent is Null.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+void CompactAVLTree<Key, Value, Compare, Alloc, Storage>::replaceChild(
+    uint32_t parent, uint32_t oldChild, uint32_t newChild)
+{
+    if (parent == Null) {
+        root_ = newChild;
+    }
+    else if (left(parent) == oldChild) {
+        slot(parent).left_ = newChild;
+    }
+    else {
+        slot(parent).right_ = newChild;
+    }
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+uint32_t CompactAVLTree<Key, Value, Compare, Alloc, Storage>::first() const
+{
+    uint32_t node = root_;
+    while (node != Null && left(node) != Null) {
+        node = left(node);
+    }
+    return node;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+uint32_t CompactAVLTree<Key, Value, Compare, Alloc, Storage>::last() const
+{
+    uint32_t node = root_;
+    while (node != Null && right(node) != Null) {
+        node = right(node);
+    }
+    return node;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+uint32_t CompactAVLTree<Key, Value, Compare, Alloc, Storage>::next(uint32_t index) const
+{
+    if (right(index) != Null) {
+        index = right(index);
+        while (left(index) != Null) {
+            index = left(index);
+        }
+        return index;
+    }
+    uint32_t up = parent(index);
+    while (up != Null && right(up) == index) {
+        index = up;
+        up = parent(up);
+    }
+    return up;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+uint32_t CompactAVLTree<Key, Value, Compare, Alloc, Storage>::prev(uint32_t index) const
+{
+    if (left(index) != Null) {
+        index = left(index);
+        while (right(index) != Null) {
+            index = right(index);
+        }
+        return index;
+    }
+    uint32_t up = parent(index);
+    while (up != Null && left(up) == index) {
+        index = up;
+        up = parent(up);
+    }
+    return up;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+uint32_t CompactAVLTree<Key, Value, Compare, Alloc, Storage>::lowerBoundIndex(const Key& key) const
+{
+    uint32_t node = root_;
+    uint32_t bound = Null;
+    while (node != Null) {
+        if (comp_(this->key(node), key)) {
+            node = right(node);
+        }
+        else {
+            bound = node;
+            node = left(node);
+        }
+    }
+    return bound;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+uint32_t CompactAVLTree<Key, Value, Compare, Alloc, Storage>::findIndex(const Key& key) const
+{
+    uint32_t bound = lowerBoundIndex(key);
+    if (bound == Null || comp_(key, this->key(bound))) {
+        return Null;
+    }
+    return bound;
+}
+
+/**
+* Takes a released slot if there is one, else the next fresh one, adding
+* a chunk when the fresh one starts it. The item is left unconstructed.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+uint32_t CompactAVLTree<Key, Value, Compare, Alloc, Storage>::allocateSlot()
+{
+    if (free_ != Null) {
+        uint32_t index = free_;
+        free_ = slot(index).left_;
+        return index;
+    }
+    if (used_ == MaxIndex) {
+        throw std::length_error("CompactAVLTree: too many items");
+    }
+
+    size_t chunk, offset;
+    locate(used_ + 1, chunk, offset);
+    if (chunk == chunks_.size()) {
+        size_t slots = chunkSlots(chunk);
+        chunks_.reserve(chunk + 1);
+        if (SeparateStorage) {
+            valueChunks_.reserve(chunk + 1);
+            valueChunks_.push_back(std::allocator_traits<ValueAllocator>::allocate(valueAlloc_, slots));
+            try {
+                chunks_.push_back(std::allocator_traits<SlotAllocator>::allocate(slotAlloc_, slots));
+            }
+            catch (...) {
+                std::allocator_traits<ValueAllocator>::deallocate(valueAlloc_, valueChunks_.back(), slots);
+                valueChunks_.pop_back();
+                throw;
+            }
+        }
+        else {
+            chunks_.push_back(std::allocator_traits<SlotAllocator>::allocate(slotAlloc_, slots));
+        }
+    }
+    return ++used_;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+void CompactAVLTree<Key, Value, Compare, Alloc, Storage>::releaseSlot(uint32_t index)
+{
+    destroyItem(index);
+    Slot& s = slot(index);
+    s.left_ = free_;
+    free_ = index;
+}
+
+/**
+* Rotates child above its parent, keeping the in-order sequence; balances
+* are left to the caller.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+void CompactAVLTree<Key, Value, Compare, Alloc, Storage>::rotateUp(uint32_t child)
+{
+    uint32_t up = parent(child);
+    uint32_t top = parent(up);
+    if (left(up) == child) {
+        uint32_t inner = right(child);
+        slot(up).left_ = inner;
+        if (inner != Null) {
+            setParent(inner, up);
+        }
+        slot(child).right_ = up;
+    }
+    else {
+        uint32_t inner = left(child);
+        slot(up).right_ = inner;
+        if (inner != Null) {
+            setParent(inner, up);
+        }
+        slot(child).left_ = up;
+    }
+    setParent(up, child);
+    setParent(child, top);
+    replaceChild(top, up, child);
+}
+
+/**
+* Restores a node whose balance has reached -2 or 2 (passed in, as two bits
+* can't hold it) with a single or double rotation, and returns the root of
+* the subtree. The subtree got shorter unless that root is left unevenly
+* balanced, which only happens after a removal.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+uint32_t CompactAVLTree<Key, Value, Compare, Alloc, Storage>::rebalance(uint32_t node, int nodeBalance)
+{
+    int side = (nodeBalance > 0) ? 1 : -1;
+    uint32_t child = (side > 0) ? right(node) : left(node);
+    int childBalance = balance(child);
+
+    if (childBalance != -side) {
+        // Single rotation; a balanced child only occurs after a removal
+        rotateUp(child);
+        if (childBalance == 0) {
+            setBalance(node, side);
+            setBalance(child, -side);
+        }
+        else {
+            setBalance(node, 0);
+            setBalance(child, 0);
+        }
+        return child;
+    }
+
+    // Double rotation through the child's inner grandchild
+    uint32_t grandchild = (side > 0) ? left(child) : right(child);
+    int grandBalance = balance(grandchild);
+    rotateUp(grandchild);
+    rotateUp(grandchild);
+    setBalance(node, (grandBalance == side) ? -side : 0);
+    setBalance(child, (grandBalance == -side) ? side : 0);
+    setBalance(grandchild, 0);
+    return grandchild;
+}
+
+/**
+* Walks up from a new leaf while subtrees grow, stopping at the first one
+* that evens out or needs a rotation (which restores its old height).
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+void CompactAVLTree<Key, Value, Compare, Alloc, Storage>::retraceInsert(uint32_t node)
+{
+    for (uint32_t up = parent(node); up != Null; node = up, up = parent(up)) {
+        int b = balance(up) + ((left(up) == node) ? -1 : 1);
+        if (b == 0) {
+            setBalance(up, 0);
+            return;
+        }
+        if (b == 1 || b == -1) {
+            setBalance(up, b);
+            continue;
+        }
+        rebalance(up, b);
+        return;
+    }
+}
+
+/**
+* Walks up from the node one of whose subtrees got shorter, while its
+* own subtree keeps getting shorter.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Storage>
+void CompactAVLTree<Key, Value, Compare, Alloc, Storage>::retraceRemove(uint32_t node, bool leftShrank)
+{
+    while (node != Null) {
+        uint32_t up = parent(node);
+        bool wasLeft = (up != Null && left(up) == node);
+        int b = balance(node) + (leftShrank ? 1 : -1);
+        if (b == 1 || b == -1) {
+            setBalance(node, b);
+            return;
+        }
+        if (b == 0) {
+            setBalance(node, 0);
+        }
+        else if (balance(rebalance(node, b)) != 0) {
+            return;
+        }
+        node = up;
+        leftShrank = wasLeft;
+    }
+}
+
+/*
+  --------------------------------------------------
+  End implementations for the CompactAVLTree class.
+  --------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,860 @@
+#ifndef CONCURRENT_AVL_H
+#define CONCURRENT_AVL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "epoch.h"
+
+template <typename Key, typename Value>
+struct ConcurrentAVLNode;
+
+/**
+* The part of a ConcurrentAVLNode that the tree's root holder also has.
+* Readers only use version_ and the child pointers. Writers change a
+* node's children, version and height only while holding its lock, and a
+* node's parent_ only while holding the lock of the parent it had.
+*/
+template <typename Key, typename Value>
+struct ConcurrentAVLLink
+{
+    // version_ bits: a rotation in progress is moving this node down, so
+    // keys are leaving its subtree; the node has been unlinked; the rest
+    // counts completed changes
+    static constexpr uint64_t Shrinking = 1;
+    static constexpr uint64_t Unlinked = 2;
+    static constexpr uint64_t Change = 4;
+
+    ConcurrentAVLLink();
+
+    // A spin lock held only across a few pointer updates; lets
+    // std::lock_guard and std::unique_lock take a node directly
+    void lock();
+    void unlock();
+
+    std::atomic<uint64_t> version_;
+    std::atomic<ConcurrentAVLNode<Key, Value>*> left_;
+    std::atomic<ConcurrentAVLNode<Key, Value>*> right_;
+    std::atomic<ConcurrentAVLLink<Key, Value>*> parent_;
+    std::atomic<int> height_;
+    std::atomic<bool> locked_;
+};
+
+/**
+* A node of a ConcurrentAVLTree. The value lives in a separately allocated
+* box so a writer can replace or remove it with one atomic store while
+* readers copy the old one; a NULL box means the key is not in the map and
+* the node only routes searches.
+*/
+template <typename Key, typename Value>
+struct ConcurrentAVLNode : public ConcurrentAVLLink<Key, Value>
+{
+    ConcurrentAVLNode(const Key& key, const Value* value, ConcurrentAVLLink<Key, Value>* parent);
+
+    const Key key_;
+    std::atomic<const Value*> value_;
+};
+
+template<typename Key, typename Value>
+ConcurrentAVLLink<Key, Value>::ConcurrentAVLLink() :
+    version_(0),
+    left_(nullptr),
+    right_(nullptr),
+    parent_(nullptr),
+    height_(0),
+    locked_(false)
+{
+
+}
+
+template<typename Key, typename Value>
+void ConcurrentAVLLink<Key, Value>::lock()
+{
+    while (locked_.exchange(true, std::memory_order_acquire)) {
+        while (locked_.load(std::memory_order_relaxed)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+template<typename Key, typename Value>
+void ConcurrentAVLLink<Key, Value>::unlock()
+{
+    locked_.store(false, std::memory_order_release);
+}
+
+template<typename Key, typename Value>
+ConcurrentAVLNode<Key, Value>::ConcurrentAVLNode(
+    const Key& key, const Value* value, ConcurrentAVLLink<Key, Value>* parent) :
+    key_(key),
+    value_(value)
+{
+    this->parent_.store(parent, std::memory_order_relaxed);
+    this->height_.store(1, std::memory_order_relaxed);
+}
+
+/**
+* An AVL tree that any number of threads can read and write at once.
+* Readers take no locks; writers lock only the few nodes they change, so
+* writes to different parts of the tree proceed in parallel.
+*
+* The scheme is that of Bronson et al. Every node has a version counter,
+* and a search moving from a node to its child re-checks the node's
+* version after reading the child's, retrying that step if it changed. A
+* rotation marks the node it moves down as shrinking for its duration and
+* bumps its version afterwards, so a search that might have been routed
+* past a key that left the subtree finds out and retries. Writers search
+* the same way, then lock the node they found and check its version once
+* more before changing it: linking a new leaf or swapping a value box is
+* one atomic store, which is where the write takes effect.
+*
+* Balance is relaxed: after a write, the writer walks up repairing heights
+* and rotating, locking a parent and then its child at each step (always
+* downwards, so writers cannot deadlock) and redoing any step whose parent
+* link changed under it. A removed key's node is unlinked as soon as it has
+* at most one child; until then it stays to route searches. Unlinked nodes
+* and replaced value boxes are freed through an EpochDomain once no thread
+* can still be looking at them.
+*
+* Readers get copies of values, never references, since a value may be
+* replaced as soon as the read ends.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class ConcurrentAVLTree
+{
+public:
+    explicit ConcurrentAVLTree(const Compare& comp = Compare());
+    ConcurrentAVLTree(const ConcurrentAVLTree& other) = delete;
+    ConcurrentAVLTree& operator=(const ConcurrentAVLTree& other) = delete;
+    ~ConcurrentAVLTree();
+
+    // Writers; safe to call from any thread
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+
+    // Readers; lock-free with respect to each other and to writers
+    bool find(const Key& key, Value& value) const;
+    bool contains(const Key& key) const;
+    Value operator[](const Key& key) const;
+    template<typename Visit>
+    void scan(const Key& lo, const Key& hi, Visit visit) const;
+    size_t size() const;
+    bool empty() const;
+
+private:
+    typedef ConcurrentAVLLink<Key, Value> Link;
+    typedef ConcurrentAVLNode<Key, Value> Node;
+
+    // Outcomes of one optimistic attempt
+    enum Attempt { Retry, Absent, Present };
+
+    Attempt attemptFind(const Key& key, const Link* node, bool right, uint64_t nodeVersion,
+                        Node*& found) const;
+    Attempt attemptBound(const Key* key, bool inclusive, const Link* node, bool right,
+                         uint64_t nodeVersion, const Node*& bound) const;
+    Attempt attemptInsert(const Key& key, const Value* value, Link* node, bool right,
+                          uint64_t nodeVersion, Link*& repairFrom);
+    Node* search(const Key& key) const;
+    const Node* lowerBound(const Key* key, bool inclusive) const;
+    static bool validateChild(const Link* node, bool right, uint64_t nodeVersion,
+                              const Node* next, uint64_t& nextVersion);
+    static Node* child(const Link* node, bool right);
+    void removeKey(const Key& key);
+
+    Node* root() const;
+    void replaceChild(Link* parent, Node* oldChild, Node* newChild);
+    void rotateRight(Node* node);
+    void rotateLeft(Node* node);
+    static int height(const Node* node);
+    static void updateHeight(Link* node);
+    void repair(Link* node);
+    Link* repairStep(Link* node, std::vector<Node*>& movedDown);
+    void unlink(Node* node);
+    void retire(Node* node, const Value* value);
+    void reclaim();
+    void freeSubtree(Node* node);
+
+    Link holder_;       // its right child is the root; its version never changes
+    Compare comp_;
+    std::atomic<size_t> size_;
+    mutable EpochDomain epochs_;
+
+    // Memory retired by writers, waiting for every thread to move on
+    struct Retired
+    {
+        uint64_t epoch;
+        Node* node;
+        const Value* value;
+    };
+    std::mutex retireLock_;
+    std::vector<Retired> retired_;
+};
+
+/*
+  --------------------------------------------------------
+  Begin implementations for the ConcurrentAVLTree class.
+  --------------------------------------------------------
+*/
+
+template<typename Key, typename Value, typename Compare>
+ConcurrentAVLTree<Key, Value, Compare>::ConcurrentAVLTree(const Compare& comp) :
+    comp_(comp),
+    size_(0)
+{
+
+}
+
+/**
+* No other thread may still be using the tree, so everything is freed
+* directly.
+*/
+template<typename Key, typename Value, typename Compare>
+ConcurrentAVLTree<Key, Value, Compare>::~ConcurrentAVLTree()
+{
+    freeSubtree(root());
+    for (size_t i = 0; i < retired_.size(); ++i) {
+        delete retired_[i].node;
+        delete retired_[i].value;
+    }
+}
+
+/**
+* Inserts the pair, or replaces the value if the key is already present.
+*/
+template<typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    const Value* value = new Value(keyValuePair.second);
+    {
+        EpochDomain::Guard guard(epochs_);
+        Link* repairFrom = nullptr;
+        while (attemptInsert(keyValuePair.first, value, &holder_, true, 0, repairFrom) == Retry) {
+        }
+        if (repairFrom) {
+            repair(repairFrom);
+        }
+    }
+    reclaim();
+}
+
+template<typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::remove(const Key& key)
+{
+    {
+        EpochDomain::Guard guard(epochs_);
+        removeKey(key);
+    }
+    reclaim();
+}
+
+/**
+* Removes the keys one at a time, so it is not atomic: concurrent readers
+* may see part of the tree gone, and keys inserted meanwhile may survive.
+*/
+template<typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::clear()
+{
+    {
+        EpochDomain::Guard guard(epochs_);
+        const Node* node = lowerBound(nullptr, true);
+        while (node) {
+            removeKey(node->key_);
+            node = lowerBound(&node->key_, false);
+        }
+    }
+    reclaim();
+}
+
+/**
+* Copies the value for key into value and returns true, or returns false
+* if the key is absent.
+*/
+template<typename Key, typename Value, typename Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::find(const Key& key, Value& value) const
+{
+    EpochDomain::Guard guard(epochs_);
+    const Node* found = search(key);
+    // The box load is where the lookup takes effect
+    const Value* box = found ? found->value_.load() : nullptr;
+    if (!box) {
+        return false;
+    }
+    value = *box;
+    return true;
+}
+
+template<typename Key, typename Value, typename Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::contains(const Key& key) const
+{
+    EpochDomain::Guard guard(epochs_);
+    const Node* found = search(key);
+    return found && found->value_.load() != nullptr;
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns a copy of the value associated with the key
+ */
+template<typename Key, typename Value, typename Compare>
+Value ConcurrentAVLTree<Key, Value, Compare>::operator[](const Key& key) const
+{
+    Value value;
+    if (!find(key, value)) throw std::out_of_range("Invalid key");
+    return value;
+}
+
+/**
+* Calls visit(key, value) for the keys in [lo, hi) in increasing order.
+* Each step is its own lock-free search for the next key, so the scan is
+* not a snapshot: keys inserted or removed during it may or may not be
+* seen, but each key visited was present at some point during the scan and
+* every key present throughout is visited. O(log n) per key visited.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename Visit>
+void ConcurrentAVLTree<Key, Value, Compare>::scan(const Key& lo, const Key& hi, Visit visit) const
+{
+    if (!comp_(lo, hi)) {
+        return;
+    }
+
+    EpochDomain::Guard guard(epochs_);
+    const Node* node = lowerBound(&lo, true);
+    while (node && comp_(node->key_, hi)) {
+        const Value* box = node->value_.load();
+        if (box) {
+            visit(node->key_, *box);
+        }
+        node = lowerBound(&node->key_, false);
+    }
+}
+
+template<typename Key, typename Value, typename Compare>
+size_t ConcurrentAVLTree<Key, Value, Compare>::size() const
+{
+    return size_.load();
+}
+
+template<typename Key, typename Value, typename Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::empty() const
+{
+    return size() == 0;
+}
+
+/**
+* One optimistic step of a lookup: node was reached while its version was
+* nodeVersion, and the search continues into its child on the given side.
+* Returns Retry if node changed under us, so the caller (which validated
+* node) re-reads its own child pointer; the recursion depth is the height.
+*/
+template<typename Key, typename Value, typename Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Attempt
+ConcurrentAVLTree<Key, Value, Compare>::attemptFind(
+    const Key& key, const Link* node, bool right, uint64_t nodeVersion, Node*& found) const
+{
+    while (true) {
+        Node* next = child(node, right);
+        if (node->version_.load() != nodeVersion) {
+            return Retry;
+        }
+        if (!next) {
+            return Absent;
+        }
+
+        bool nextRight;
+        if (comp_(key, next->key_)) {
+            nextRight = false;
+        }
+        else if (comp_(next->key_, key)) {
+            nextRight = true;
+        }
+        else {
+            found = next;
+            return Present;
+        }
+
+        uint64_t nextVersion;
+        if (!validateChild(node, right, nodeVersion, next, nextVersion)) {
+            if (node->version_.load() != nodeVersion) {
+                return Retry;
+            }
+            continue;
+        }
+
+        Attempt attempt = attemptFind(key, next, nextRight, nextVersion, found);
+        if (attempt != Retry) {
+            return attempt;
+        }
+    }
+}
+
+/**
+* attemptFind for the smallest node whose key is >= key (> key when not
+* inclusive), routing nodes included; a NULL key is below every key. bound
+* holds the best candidate seen on the way down.
+*/
+template<typename Key, typename Value, typename Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Attempt
+ConcurrentAVLTree<Key, Value, Compare>::attemptBound(
+    const Key* key, bool inclusive, const Link* node, bool right, uint64_t nodeVersion,
+    const Node*& bound) const
+{
+    const Node* saved = bound;
+    while (true) {
+        bound = saved;
+        const Node* next = child(node, right);
+        if (node->version_.load() != nodeVersion) {
+            return Retry;
+        }
+        if (!next) {
+            return bound ? Present : Absent;
+        }
+
+        bool nextRight = key &&
+            (inclusive ? comp_(next->key_, *key) : !comp_(*key, next->key_));
+        uint64_t nextVersion;
+        if (!validateChild(node, right, nodeVersion, next, nextVersion)) {
+            if (node->version_.load() != nodeVersion) {
+                return Retry;
+            }
+            continue;
+        }
+        if (!nextRight) {
+            bound = next;
+        }
+
+        Attempt attempt = attemptBound(key, inclusive, next, nextRight, nextVersion, bound);
+        if (attempt != Retry) {
+            return attempt;
+        }
+    }
+}
+
+/**
+* attemptFind for a writer. A node with the key is locked and, unless it
+* was unlinked meanwhile, takes the value box. Otherwise the node where
+* the search ends is locked and, if its version still matches and the
+* child slot is still empty, a new leaf holding the box is linked there;
+* repairFrom is then set to that node, whose height may have grown.
+*/
+template<typename Key, typename Value, typename Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Attempt
+ConcurrentAVLTree<Key, Value, Compare>::attemptInsert(
+    const Key& key, const Value* value, Link* node, bool right, uint64_t nodeVersion,
+    Link*& repairFrom)
+{
+    while (true) {
+        Node* next = child(node, right);
+        if (node->version_.load() != nodeVersion) {
+            return Retry;
+        }
+
+        if (!next) {
+            std::lock_guard<Link> lock(*node);
+            if (node->version_.load() != nodeVersion) {
+                return Retry;
+            }
+            if (child(node, right)) {
+                continue;
+            }
+            Node* leaf = new Node(key, value, node);
+            if (right) {
+                node->right_.store(leaf);
+            }
+            else {
+                node->left_.store(leaf);
+            }
+            size_.fetch_add(1);
+            repairFrom = node;
+            return Present;
+        }
+
+        bool nextRight;
+        if (comp_(key, next->key_)) {
+            nextRight = false;
+        }
+        else if (comp_(next->key_, key)) {
+            nextRight = true;
+        }
+        else {
+            std::unique_lock<Link> lock(*next);
+            if (next->version_.load() & Link::Unlinked) {
+                continue;
+            }
+            // Replace the box; a routing node becomes a live key again
+            const Value* old = next->value_.exchange(value);
+            lock.unlock();
+            if (old) {
+                retire(nullptr, old);
+            }
+            else {
+                size_.fetch_add(1);
+            }
+            return Present;
+        }
+
+        uint64_t nextVersion;
+        if (!validateChild(node, right, nodeVersion, next, nextVersion)) {
+            if (node->version_.load() != nodeVersion) {
+                return Retry;
+            }
+            continue;
+        }
+
+        Attempt attempt = attemptInsert(key, value, next, nextRight, nextVersion, repairFrom);
+        if (attempt != Retry) {
+            return attempt;
+        }
+    }
+}
+
+template<typename Key, typename Value, typename Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Node*
+ConcurrentAVLTree<Key, Value, Compare>::search(const Key& key) const
+{
+    Node* found = nullptr;
+    Attempt attempt;
+    while ((attempt = attemptFind(key, &holder_, true, 0, found)) == Retry) {
+    }
+    return attempt == Present ? found : nullptr;
+}
+
+template<typename Key, typename Value, typename Compare>
+const typename ConcurrentAVLTree<Key, Value, Compare>::Node*
+ConcurrentAVLTree<Key, Value, Compare>::lowerBound(const Key* key, bool inclusive) const
+{
+    const Node* bound = nullptr;
+    while (attemptBound(key, inclusive, &holder_, true, 0, bound) == Retry) {
+        bound = nullptr;
+    }
+    return bound;
+}
+
+/**
+* The hand-over-hand step: takes next's version and then checks that next
+* is still node's child and node is unchanged, so next's subtree covered
+* the search key when its version was taken. Returns false if the step
+* must be redone from node's child pointer; if next was being rotated
+* down, first waits for the rotation to finish.
+*/
+template<typename Key, typename Value, typename Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::validateChild(
+    const Link* node, bool right, uint64_t nodeVersion, const Node* next, uint64_t& nextVersion)
+{
+    nextVersion = next->version_.load();
+    if (nextVersion & (Link::Shrinking | Link::Unlinked)) {
+        while (next->version_.load() & Link::Shrinking) {
+            std::this_thread::yield();
+        }
+        return false;
+    }
+    return child(node, right) == next && node->version_.load() == nodeVersion;
+}
+
+template<typename Key, typename Value, typename Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Node*
+ConcurrentAVLTree<Key, Value, Compare>::child(const Link* node, bool right)
+{
+    return right ? node->right_.load() : node->left_.load();
+}
+
+/**
+* Clears the key's value box under the node's lock, then unlinks the node
+* if it is left with at most one child. The caller holds an epoch guard.
+*/
+template<typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::removeKey(const Key& key)
+{
+    while (true) {
+        Node* node = search(key);
+        if (!node) {
+            return;
+        }
+
+        std::unique_lock<Link> lock(*node);
+        if (node->version_.load() & Link::Unlinked) {
+            continue;
+        }
+        const Value* old = node->value_.exchange(nullptr);
+        bool unlinkable = !node->left_.load() || !node->right_.load();
+        lock.unlock();
+        if (old) {
+            retire(nullptr, old);
+            size_.fetch_sub(1);
+            if (unlinkable) {
+                repair(node);
+            }
+        }
+        return;
+    }
+}
+
+template<typename Key, typename Value, typename Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Node*
+ConcurrentAVLTree<Key, Value, Compare>::root() const
+{
+    return holder_.right_.load();
+}
+
+/**
+* Points whichever child pointer of parent held oldChild at newChild.
+* The caller holds the locks of parent and of newChild's old parent.
+*/
+template<typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::replaceChild(Link* parent, Node* oldChild, Node* newChild)
+{
+    if (parent->left_.load() == oldChild) {
+        parent->left_.store(newChild);
+    }
+    else {
+        parent->right_.store(newChild);
+    }
+    if (newChild) {
+        newChild->parent_.store(parent);
+    }
+}
+
+/**
+* Rotates node's left child up into its place. node moves down and loses
+* its left child's left subtree, so it is marked shrinking throughout;
+* its left child only gains keys and needs no mark. The caller holds the
+* locks of node's parent, node and its left child.
+*/
+template<typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::rotateRight(Node* node)
+{
+    Link* parent = node->parent_.load();
+    Node* left = node->left_.load();
+    Node* middle = left->right_.load();
+
+    uint64_t version = node->version_.load();
+    node->version_.store(version | Link::Shrinking);
+
+    node->left_.store(middle);
+    if (middle) {
+        middle->parent_.store(node);
+    }
+    left->right_.store(node);
+    node->parent_.store(left);
+    replaceChild(parent, node, left);
+
+    updateHeight(node);
+    updateHeight(left);
+    node->version_.store(version + Link::Change);
+}
+
+template<typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::rotateLeft(Node* node)
+{
+    Link* parent = node->parent_.load();
+    Node* right = node->right_.load();
+    Node* middle = right->left_.load();
+
+    uint64_t version = node->version_.load();
+    node->version_.store(version | Link::Shrinking);
+
+    node->right_.store(middle);
+    if (middle) {
+        middle->parent_.store(node);
+    }
+    right->left_.store(node);
+    node->parent_.store(right);
+    replaceChild(parent, node, right);
+
+    updateHeight(node);
+    updateHeight(right);
+    node->version_.store(version + Link::Change);
+}
+
+template<typename Key, typename Value, typename Compare>
+int ConcurrentAVLTree<Key, Value, Compare>::height(const Node* node)
+{
+    return node ? node->height_.load() : 0;
+}
+
+template<typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::updateHeight(Link* node)
+{
+    int left = height(node->left_.load());
+    int right = height(node->right_.load());
+    node->height_.store(1 + (left > right ? left : right));
+}
+
+/**
+* Walks from node towards the root restoring heights and the AVL balance,
+* and unlinking routing nodes that are down to one child. Children's
+* heights are read without their locks; a writer changing one walks up
+* here afterwards, so a stale read is repaired by that walk. Because a
+* rotation may have used such a stale height, each node a rotation moved
+* down gets a walk of its own afterwards.
+*/
+template<typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::repair(Link* link)
+{
+    std::vector<Node*> movedDown;
+    while (true) {
+        while (link != &holder_) {
+            link = repairStep(link, movedDown);
+        }
+        if (movedDown.empty()) {
+            return;
+        }
+        link = movedDown.back();
+        movedDown.pop_back();
+    }
+}
+
+/**
+* One step of repair(). Locks node's parent, checks it is still node's
+* parent, then locks node (and the child or grandchild a rotation moves
+* up), so locks are only ever taken downwards along live links. Returns
+* the node to look at next: node again if its parent changed meanwhile,
+* the parent if node's height may have changed, or the holder to stop
+* (the height came out unchanged, or someone else unlinked node).
+*/
+template<typename Key, typename Value, typename Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Link*
+ConcurrentAVLTree<Key, Value, Compare>::repairStep(Link* link, std::vector<Node*>& movedDown)
+{
+    Node* node = static_cast<Node*>(link);
+    Link* parent = node->parent_.load();
+
+    std::lock_guard<Link> parentLock(*parent);
+    if (node->parent_.load() != parent || (parent->version_.load() & Link::Unlinked)) {
+        return (node->version_.load() & Link::Unlinked) ? &holder_ : node;
+    }
+    std::lock_guard<Link> nodeLock(*node);
+    if (node->version_.load() & Link::Unlinked) {
+        return &holder_;
+    }
+
+    Node* left = node->left_.load();
+    Node* right = node->right_.load();
+    if (!node->value_.load() && (!left || !right)) {
+        unlink(node);
+        return parent;
+    }
+
+    int balance = height(left) - height(right);
+    if (balance > 1) {
+        std::lock_guard<Link> leftLock(*left);
+        Node* middle = left->right_.load();
+        if (height(left->left_.load()) < height(middle)) {
+            std::lock_guard<Link> middleLock(*middle);
+            rotateLeft(left);
+            rotateRight(node);
+            movedDown.push_back(left);
+        }
+        else {
+            rotateRight(node);
+        }
+        movedDown.push_back(node);
+    }
+    else if (balance < -1) {
+        std::lock_guard<Link> rightLock(*right);
+        Node* middle = right->left_.load();
+        if (height(right->right_.load()) < height(middle)) {
+            std::lock_guard<Link> middleLock(*middle);
+            rotateRight(right);
+            rotateLeft(node);
+            movedDown.push_back(right);
+        }
+        else {
+            rotateLeft(node);
+        }
+        movedDown.push_back(node);
+    }
+    else {
+        int oldHeight = node->height_.load();
+        updateHeight(node);
+        if (node->height_.load() == oldHeight) {
+            return &holder_;
+        }
+    }
+    return parent;
+}
+
+/**
+* Splices out a node with at most one child and retires it. Searches that
+* already reached it see the Unlinked mark and re-read from the parent.
+* The caller holds the locks of node and its parent.
+*/
+template<typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::unlink(Node* node)
+{
+    Node* only = node->left_.load() ? node->left_.load() : node->right_.load();
+    replaceChild(node->parent_.load(), node, only);
+    node->version_.store(node->version_.load() | Link::Unlinked);
+    retire(node, nullptr);
+}
+
+template<typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::retire(Node* node, const Value* value)
+{
+    std::lock_guard<std::mutex> lock(retireLock_);
+    retired_.push_back(Retired{epochs_.epoch(), node, value});
+}
+
+/**
+* Frees whatever was retired at least two epochs ago, after nudging the
+* epoch forward. Called outside any epoch guard; if another writer is
+* already reclaiming, leaves the work to it. Retired entries are in epoch
+* order.
+*/
+template<typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::reclaim()
+{
+    std::unique_lock<std::mutex> lock(retireLock_, std::try_to_lock);
+    if (!lock.owns_lock() || retired_.empty()) {
+        return;
+    }
+    epochs_.tryAdvance();
+    uint64_t safe = epochs_.epoch();
+
+    size_t done = 0;
+    while (done < retired_.size() && retired_[done].epoch + 2 <= safe) {
+        delete retired_[done].node;
+        delete retired_[done].value;
+        ++done;
+    }
+    retired_.erase(retired_.begin(), retired_.begin() + done);
+}
+
+/**
+* Frees a subtree and its values with an explicit stack.
+*/
+template<typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::freeSubtree(Node* node)
+{
+    std::vector<Node*> stack;
+    if (node) {
+        stack.push_back(node);
+    }
+    while (!stack.empty()) {
+        Node* top = stack.back();
+        stack.pop_back();
+        if (top->left_.load()) {
+            stack.push_back(top->left_.load());
+        }
+        if (top->right_.load()) {
+            stack.push_back(top->right_.load());
+        }
+        delete top->value_.load();
+        delete top;
+    }
+}
+
+/*
+  ------------------------------------------------------
+  End implementations for the ConcurrentAVLTree class.
+  ------------------------------------------------------
+*/
+
+#endif
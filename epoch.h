@@ -0,0 +1,126 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+/**
+* Epoch-based deferred reclamation for structures read without locks.
+*
+* Readers wrap each access in a Guard. A writer that unlinks memory retires
+* it with the current epoch() and may free it once epoch() has advanced two
+* past that, since by then every reader that could have seen it is gone.
+* tryAdvance() moves the epoch forward when no reader from the epoch before
+* the current one remains.
+*
+* Readers are counted, per epoch parity, in cache-line-sized stripes picked
+* by thread, so concurrent readers rarely touch the same line and the domain
+* needs no per-thread registration.
+*/
+class EpochDomain
+{
+public:
+    /**
+    * Marks the calling thread as reading for its lifetime.
+    */
+    class Guard
+    {
+    public:
+        explicit Guard(const EpochDomain& domain);
+        ~Guard();
+        Guard(const Guard& other) = delete;
+        Guard& operator=(const Guard& other) = delete;
+
+    private:
+        std::atomic<uint64_t>* counter_;
+    };
+
+    EpochDomain();
+
+    uint64_t epoch() const;
+    bool tryAdvance();
+
+private:
+    static const size_t Stripes = 64;
+
+    struct alignas(64) Stripe
+    {
+        std::atomic<uint64_t> readers_[2];  // by epoch parity
+    };
+
+    static size_t stripeIndex();
+
+    std::atomic<uint64_t> epoch_;
+    mutable Stripe stripes_[Stripes];
+};
+
+/**
+* Counts the thread in the stripe for the current epoch's parity. If the
+* epoch moved on in between, the count may have landed after the writer
+* checked that parity, so undo it and try again with the new epoch.
+*/
+inline EpochDomain::Guard::Guard(const EpochDomain& domain)
+{
+    Stripe& stripe = domain.stripes_[stripeIndex()];
+    while (true) {
+        uint64_t epoch = domain.epoch_.load();
+        counter_ = &stripe.readers_[epoch & 1];
+        counter_->fetch_add(1);
+        if (domain.epoch_.load() == epoch) {
+            return;
+        }
+        counter_->fetch_sub(1);
+    }
+}
+
+inline EpochDomain::Guard::~Guard()
+{
+    counter_->fetch_sub(1, std::memory_order_release);
+}
+
+inline EpochDomain::EpochDomain() :
+    epoch_(2)
+{
+    for (size_t i = 0; i < Stripes; ++i) {
+        stripes_[i].readers_[0].store(0, std::memory_order_relaxed);
+        stripes_[i].readers_[1].store(0, std::memory_order_relaxed);
+    }
+}
+
+inline uint64_t EpochDomain::epoch() const
+{
+    return epoch_.load();
+}
+
+/**
+* Advances the epoch from e to e + 1 if no reader that entered during e - 1
+* is left. Those readers share e + 1's parity, so the check also keeps the
+* counts of the two live epochs apart. Only one thread (the writer) may call
+* this at a time. Returns whether the epoch advanced.
+*/
+inline bool EpochDomain::tryAdvance()
+{
+    uint64_t epoch = epoch_.load();
+    size_t parity = (epoch + 1) & 1;
+    for (size_t i = 0; i < Stripes; ++i) {
+        if (stripes_[i].readers_[parity].load() != 0) {
+            return false;
+        }
+    }
+    epoch_.store(epoch + 1);
+    return true;
+}
+
+/**
+* Each thread sticks to one stripe, chosen by hashing its id once.
+*/
+inline size_t EpochDomain::stripeIndex()
+{
+    thread_local size_t index = std::hash<std::thread::id>()(std::this_thread::get_id()) % Stripes;
+    return index;
+}
+
+#endif
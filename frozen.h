@@ -0,0 +1,746 @@
+#ifndef FROZEN_H
+#define FROZEN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define FROZEN_MMAP 1
+#endif
+
+/**
+* The header of a FrozenMap image file. The key and item arrays follow at
+* the given offsets, each starting on a cache line, in exactly the layout
+* a FrozenMap searches in memory: key 0 is unused padding and key i is the
+* key at Eytzinger index i, whose item is item i - 1. The sizes and byte
+* order marker let a load reject an image written for other types or on
+* another architecture.
+*/
+struct FrozenImageHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t keySize;
+    uint32_t valueSize;
+    uint32_t itemSize;
+    uint32_t itemAlign;
+    uint64_t size;
+    uint64_t keysOffset;
+    uint64_t itemsOffset;
+    uint64_t fileSize;
+};
+
+/**
+* An immutable sorted map for read-mostly data, made by AVLTree::freeze().
+* The keys sit in one flat array in Eytzinger (BFS) order: the root at
+* index 1 and the children of i at 2i and 2i + 1. A lookup is a branchless
+* descent, i = 2i + (key[i] < key), that prefetches the cache line holding
+* the node's descendants a few levels down, so the misses of consecutive
+* levels overlap instead of being chased one pointer at a time.
+*
+* Items are stored in the same order beside the keys, so a lookup only
+* touches the items array once it has found its slot. Iteration in key
+* order walks the implicit tree, which takes amortized O(1) per step.
+*
+* For trivially copyable keys and values, save() writes the two arrays to
+* a file and load_mapped() maps one back in: the map then searches the
+* mapped pages in place, so loading costs a few system calls whatever the
+* size, and pages are read in as lookups first touch them. The map is
+* immutable, so copies share their arrays (or mapping) rather than copy.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class FrozenMap
+{
+public:
+    template<typename InputIt>
+    FrozenMap(InputIt first, InputIt last, const Compare& comp = Compare());
+
+    void save(const std::string& path, bool durable = false) const;
+    template<typename InputIt>
+    static void save(InputIt first, InputIt last, const std::string& path, bool durable = false);
+    static FrozenMap load_mapped(const std::string& path, const Compare& comp = Compare());
+
+    /**
+    * A read-only bidirectional iterator over the items in key order.
+    * Decrementing end() yields the largest item.
+    */
+    class const_iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const std::pair<const Key, Value>* pointer;
+        typedef const std::pair<const Key, Value>& reference;
+
+        const_iterator();
+
+        const std::pair<const Key, Value>& operator*() const;
+        const std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const const_iterator& rhs) const;
+        bool operator!=(const const_iterator& rhs) const;
+
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        const_iterator& operator--();
+        const_iterator operator--(int);
+
+    private:
+        friend class FrozenMap<Key, Value, Compare>;
+        const_iterator(size_t index, const FrozenMap<Key, Value, Compare>* map);
+        size_t index_;  // Eytzinger index, 0 for end()
+        const FrozenMap<Key, Value, Compare>* map_;
+    };
+    typedef const_iterator iterator;
+
+    const_iterator begin() const;
+    const_iterator end() const;
+    const_iterator find(const Key& key) const;
+    const_iterator lower_bound(const Key& key) const;
+    Value const & operator[](const Key& key) const;
+    size_t size() const;
+    bool empty() const;
+
+private:
+    typedef std::pair<const Key, Value> Item;
+
+    // Keys per cache line; prefetching keys_[i * Stride] fetches the
+    // descendants of i that are log2(Stride) levels further down
+    static const size_t Stride = (sizeof(Key) >= 64) ? 1 : 64 / sizeof(Key);
+    static const uint32_t ImageVersion = 1;
+    static const uint32_t ByteOrderMark = 0x01020304;
+
+    // The arrays of a map built in memory
+    struct Arrays
+    {
+        std::vector<Key> keys;
+        std::vector<Item> items;
+    };
+
+    explicit FrozenMap(const Compare& comp);
+    const Key& key(size_t index) const;
+    size_t lowerBoundIndex(const Key& key) const;
+    static size_t fill(std::vector<size_t>& order, size_t size, size_t index, size_t rank);
+    template<typename KeyAt, typename ItemAt>
+    static void writeImage(const std::string& path, size_t size, KeyAt keyAt, ItemAt itemAt, bool durable);
+    static void syncPath(const std::string& path, bool directory);
+    static FrozenImageHeader imageHeader(size_t size);
+    static void checkImageTypes();
+    size_t first() const;
+    size_t last() const;
+    size_t successor(size_t index) const;
+    size_t predecessor(size_t index) const;
+    static int trailingOnes(size_t index);
+    static int trailingZeros(size_t index);
+
+    size_t size_;
+    const Key* keys_;    // Eytzinger order, key(i) is keys_[i]
+    const Item* items_;  // Eytzinger order, item i at i - 1
+    std::shared_ptr<const void> storage_;  // the Arrays or the mapping behind keys_ and items_
+    Compare comp_;
+};
+
+/*
+  --------------------------------------------------------
+  Begin implementations for the FrozenMap::const_iterator.
+  --------------------------------------------------------
+*/
+
+template<typename Key, typename Value, typename Compare>
+FrozenMap<Key, Value, Compare>::const_iterator::const_iterator() :
+    index_(0),
+    map_(nullptr)
+{
+
+}
+
+template<typename Key, typename Value, typename Compare>
+FrozenMap<Key, Value, Compare>::const_iterator::const_iterator(
+    size_t index, const FrozenMap<Key, Value, Compare>* map) :
+    index_(index),
+    map_(map)
+{
+
+}
+
+template<typename Key, typename Value, typename Compare>
+const std::pair<const Key, Value>& FrozenMap<Key, Value, Compare>::const_iterator::operator*() const
+{
+    return map_->items_[index_ - 1];
+}
+
+template<typename Key, typename Value, typename Compare>
+const std::pair<const Key, Value>* FrozenMap<Key, Value, Compare>::const_iterator::operator->() const
+{
+    return map_->items_ + (index_ - 1);
+}
+
+template<typename Key, typename Value, typename Compare>
+bool FrozenMap<Key, Value, Compare>::const_iterator::operator==(const const_iterator& rhs) const
+{
+    return index_ == rhs.index_;
+}
+
+template<typename Key, typename Value, typename Compare>
+bool FrozenMap<Key, Value, Compare>::const_iterator::operator!=(const const_iterator& rhs) const
+{
+    return index_ != rhs.index_;
+}
+
+template<typename Key, typename Value, typename Compare>
+typename FrozenMap<Key, Value, Compare>::const_iterator&
+FrozenMap<Key, Value, Compare>::const_iterator::operator++()
+{
+    index_ = map_->successor(index_);
+    return *this;
+}
+
+template<typename Key, typename Value, typename Compare>
+typename FrozenMap<Key, Value, Compare>::const_iterator
+FrozenMap<Key, Value, Compare>::const_iterator::operator++(int)
+{
+    const_iterator old(*this);
+    ++(*this);
+    return old;
+}
+
+template<typename Key, typename Value, typename Compare>
+typename FrozenMap<Key, Value, Compare>::const_iterator&
+FrozenMap<Key, Value, Compare>::const_iterator::operator--()
+{
+    index_ = index_ ? map_->predecessor(index_) : map_->last();
+    return *this;
+}
+
+template<typename Key, typename Value, typename Compare>
+typename FrozenMap<Key, Value, Compare>::const_iterator
+FrozenMap<Key, Value, Compare>::const_iterator::operator--(int)
+{
+    const_iterator old(*this);
+    --(*this);
+    return old;
+}
+
+/*
+  ------------------------------------------------------
+  End implementations for the FrozenMap::const_iterator.
+  ------------------------------------------------------
+*/
+
+/*
+  -----------------------------------------------
+  Begin implementations for the FrozenMap class.
+  -----------------------------------------------
+*/
+
+/**
+* Builds the snapshot from [first, last), which must be sorted by strictly
+* increasing key, such as a tree's begin() and end().
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename InputIt>
+FrozenMap<Key, Value, Compare>::FrozenMap(InputIt first, InputIt last, const Compare& comp) :
+    size_(0),
+    keys_(nullptr),
+    items_(nullptr),
+    comp_(comp)
+{
+    std::vector<const Item*> sorted;
+    for (; first != last; ++first) {
+        sorted.push_back(&*first);
+    }
+    size_ = sorted.size();
+
+    // order[i] is the sorted rank of the item at Eytzinger index i
+    std::vector<size_t> order(size_ + 1);
+    fill(order, size_, 1, 0);
+
+    // Pad so key(0) starts a cache line, putting siblings 8k..8k+7 (for
+    // 8-byte keys) on one line; unaligned storage only costs speed
+    std::shared_ptr<Arrays> arrays = std::make_shared<Arrays>();
+    arrays->keys.resize(size_ + 1 + Stride);
+    size_t base = 0;
+    if (64 % sizeof(Key) == 0) {
+        while (reinterpret_cast<std::uintptr_t>(&arrays->keys[base]) % 64 != 0 && base < Stride) {
+            ++base;
+        }
+    }
+
+    arrays->items.reserve(size_);
+    for (size_t i = 1; i <= size_; ++i) {
+        arrays->keys[base + i] = sorted[order[i]]->first;
+        arrays->items.push_back(*sorted[order[i]]);
+    }
+    keys_ = arrays->keys.data() + base;
+    items_ = arrays->items.data();
+    storage_ = arrays;
+}
+
+template<typename Key, typename Value, typename Compare>
+FrozenMap<Key, Value, Compare>::FrozenMap(const Compare& comp) :
+    size_(0),
+    keys_(nullptr),
+    items_(nullptr),
+    comp_(comp)
+{
+
+}
+
+/**
+* Writes the map to path as an image load_mapped() can map. The file is
+* written under a temporary name and renamed over path once complete, so
+* a crash mid-save leaves any earlier image intact. That only covers the
+* process dying: the OS may still hold the data and the rename in memory.
+* With durable set, both are forced to disk before save() returns, so the
+* new image survives a power loss too. Throws std::runtime_error if the
+* file cannot be written or synced.
+*/
+template<typename Key, typename Value, typename Compare>
+void FrozenMap<Key, Value, Compare>::save(const std::string& path, bool durable) const
+{
+    writeImage(path, size_,
+               [this](size_t index) -> const Key& { return keys_[index]; },
+               [this](size_t index) -> const Item& { return items_[index - 1]; },
+               durable);
+}
+
+/**
+* Writes the image of the map [first, last) would build, without building
+* it: only a pointer and a rank per item are held in memory.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename InputIt>
+void FrozenMap<Key, Value, Compare>::save(InputIt first, InputIt last, const std::string& path, bool durable)
+{
+    std::vector<const Item*> sorted;
+    for (; first != last; ++first) {
+        sorted.push_back(&*first);
+    }
+    std::vector<size_t> order(sorted.size() + 1);
+    fill(order, sorted.size(), 1, 0);
+    writeImage(path, sorted.size(),
+               [&](size_t index) -> const Key& { return sorted[order[index]]->first; },
+               [&](size_t index) -> const Item& { return *sorted[order[index]]; },
+               durable);
+}
+
+/**
+* Maps an image written by save() and returns a map that searches it in
+* place. The mapping is private and read-only and lasts as long as the map
+* or any copy of it. comp must order keys as the saved map's did. Throws
+* std::runtime_error if the file cannot be read or is not an image of
+* this map type.
+*/
+template<typename Key, typename Value, typename Compare>
+FrozenMap<Key, Value, Compare> FrozenMap<Key, Value, Compare>::load_mapped(
+    const std::string& path, const Compare& comp)
+{
+    checkImageTypes();
+    FrozenMap map(comp);
+    const char* base;
+    size_t length;
+#if defined(FROZEN_MMAP)
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("FrozenMap: cannot open " + path);
+    }
+    struct stat status;
+    if (::fstat(fd, &status) != 0 || status.st_size < static_cast<off_t>(sizeof(FrozenImageHeader))) {
+        ::close(fd);
+        throw std::runtime_error("FrozenMap: not an image: " + path);
+    }
+    length = static_cast<size_t>(status.st_size);
+    void* mapping = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("FrozenMap: cannot map " + path);
+    }
+    map.storage_ = std::shared_ptr<const void>(mapping, [length](const void* address) {
+        ::munmap(const_cast<void*>(address), length);
+    });
+    base = static_cast<const char*>(mapping);
+#else
+    // No mmap: read the image into memory laid out the same way
+    std::ifstream in(path.c_str(), std::ios::binary | std::ios::ate);
+    if (!in) {
+        throw std::runtime_error("FrozenMap: cannot open " + path);
+    }
+    length = static_cast<size_t>(in.tellg());
+    std::shared_ptr<std::vector<std::max_align_t> > buffer =
+        std::make_shared<std::vector<std::max_align_t> >(length / sizeof(std::max_align_t) + 1);
+    in.seekg(0);
+    if (!in.read(reinterpret_cast<char*>(buffer->data()), length) || length < sizeof(FrozenImageHeader)) {
+        throw std::runtime_error("FrozenMap: not an image: " + path);
+    }
+    map.storage_ = buffer;
+    base = reinterpret_cast<const char*>(buffer->data());
+#endif
+
+    FrozenImageHeader header;
+    std::memcpy(&header, base, sizeof(header));
+    FrozenImageHeader expected = imageHeader(static_cast<size_t>(header.size));
+    if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 ||
+        header.version != expected.version || header.byteOrder != expected.byteOrder ||
+        header.keySize != expected.keySize || header.valueSize != expected.valueSize ||
+        header.itemSize != expected.itemSize || header.itemAlign != expected.itemAlign ||
+        header.keysOffset != expected.keysOffset || header.itemsOffset != expected.itemsOffset ||
+        header.fileSize != expected.fileSize || length < expected.fileSize) {
+        throw std::runtime_error("FrozenMap: not an image of this map type: " + path);
+    }
+    map.size_ = static_cast<size_t>(header.size);
+    map.keys_ = reinterpret_cast<const Key*>(base + header.keysOffset);
+    map.items_ = reinterpret_cast<const Item*>(base + header.itemsOffset);
+    return map;
+}
+
+template<typename Key, typename Value, typename Compare>
+typename FrozenMap<Key, Value, Compare>::const_iterator
+FrozenMap<Key, Value, Compare>::begin() const
+{
+    return const_iterator(first(), this);
+}
+
+template<typename Key, typename Value, typename Compare>
+typename FrozenMap<Key, Value, Compare>::const_iterator
+FrozenMap<Key, Value, Compare>::end() const
+{
+    return const_iterator(0, this);
+}
+
+template<typename Key, typename Value, typename Compare>
+typename FrozenMap<Key, Value, Compare>::const_iterator
+FrozenMap<Key, Value, Compare>::find(const Key& k) const
+{
+    size_t index = lowerBoundIndex(k);
+    if (index == 0 || comp_(k, key(index))) {
+        return end();
+    }
+    return const_iterator(index, this);
+}
+
+/**
+* Returns an iterator to the first item whose key is not less than key
+*/
+template<typename Key, typename Value, typename Compare>
+typename FrozenMap<Key, Value, Compare>::const_iterator
+FrozenMap<Key, Value, Compare>::lower_bound(const Key& k) const
+{
+    return const_iterator(lowerBoundIndex(k), this);
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<typename Key, typename Value, typename Compare>
+Value const & FrozenMap<Key, Value, Compare>::operator[](const Key& k) const
+{
+    const_iterator it = find(k);
+    if (it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+template<typename Key, typename Value, typename Compare>
+size_t FrozenMap<Key, Value, Compare>::size() const
+{
+    return size_;
+}
+
+template<typename Key, typename Value, typename Compare>
+bool FrozenMap<Key, Value, Compare>::empty() const
+{
+    return size_ == 0;
+}
+
+template<typename Key, typename Value, typename Compare>
+const Key& FrozenMap<Key, Value, Compare>::key(size_t index) const
+{
+    return keys_[index];
+}
+
+/**
+* The branchless descent: every level goes left or right by adding the
+* comparison result, so there is nothing for the branch predictor to miss.
+* The path taken is recorded in the bits of index; it ends by going left
+* once past the answer and then right to the bottom, so stripping the
+* trailing ones plus one more bit lands on the answer (0 if every key is
+* less than key).
+*/
+template<typename Key, typename Value, typename Compare>
+size_t FrozenMap<Key, Value, Compare>::lowerBoundIndex(const Key& k) const
+{
+    const Key* keys = keys_;
+    size_t index = 1;
+    while (index <= size_) {
+#if defined(__GNUC__)
+        __builtin_prefetch(reinterpret_cast<const char*>(keys) + index * Stride * sizeof(Key));
+#endif
+        index = 2 * index + comp_(keys[index], k);
+    }
+    return index >> (trailingOnes(index) + 1);
+}
+
+/**
+* Assigns sorted ranks to the subtree at index of a map of size items in
+* order (left subtree, index, right subtree), starting from rank. Returns
+* the next unused rank.
+*/
+template<typename Key, typename Value, typename Compare>
+size_t FrozenMap<Key, Value, Compare>::fill(std::vector<size_t>& order, size_t size, size_t index, size_t rank)
+{
+    if (index > size) {
+        return rank;
+    }
+    rank = fill(order, size, 2 * index, rank);
+    order[index] = rank++;
+    return fill(order, size, 2 * index + 1, rank);
+}
+
+/**
+* Writes the header, then keyAt(i) and itemAt(i) for Eytzinger indices
+* 1..size into their arrays. Items are copied into a zeroed buffer first so
+* that padding inside the pair is written as zeros, not leftover bytes.
+* When durable, the temporary file is synced before the rename and its
+* directory after it.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename KeyAt, typename ItemAt>
+void FrozenMap<Key, Value, Compare>::writeImage(const std::string& path, size_t size, KeyAt keyAt, ItemAt itemAt,
+                                                bool durable)
+{
+    checkImageTypes();
+    FrozenImageHeader header = imageHeader(size);
+    std::string temporary = path + ".tmp";
+    std::ofstream out(temporary.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("FrozenMap: cannot write " + temporary);
+    }
+
+    // Written through a buffer: one stream write per item costs more than
+    // producing the item
+    std::vector<char> buffer;
+    buffer.reserve(1 << 20);
+    auto put = [&](const void* bytes, size_t length) {
+        if (buffer.size() + length > buffer.capacity()) {
+            out.write(buffer.data(), buffer.size());
+            buffer.clear();
+        }
+        buffer.insert(buffer.end(), static_cast<const char*>(bytes), static_cast<const char*>(bytes) + length);
+    };
+
+    const char zeros[128] = { };
+    put(&header, sizeof(header));
+    put(zeros, header.keysOffset - sizeof(header));
+    Key padding = Key();
+    put(&padding, sizeof(Key));
+    for (size_t i = 1; i <= size; ++i) {
+        put(&keyAt(i), sizeof(Key));
+    }
+    uint64_t written = header.keysOffset + (uint64_t(size) + 1) * sizeof(Key);
+    for (; written < header.itemsOffset; ++written) {
+        put(zeros, 1);
+    }
+    typename std::aligned_storage<sizeof(Item), alignof(Item)>::type item;
+    for (size_t i = 1; i <= size; ++i) {
+        std::memset(&item, 0, sizeof(item));
+        ::new (static_cast<void*>(&item)) Item(itemAt(i));
+        put(&item, sizeof(Item));
+    }
+    out.write(buffer.data(), buffer.size());
+    out.close();
+    try {
+        if (!out) {
+            throw std::runtime_error("FrozenMap: cannot write " + temporary);
+        }
+        if (durable) {
+            syncPath(temporary, false);
+        }
+        if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+            throw std::runtime_error("FrozenMap: cannot write " + path);
+        }
+    }
+    catch (...) {
+        std::remove(temporary.c_str());
+        throw;
+    }
+    if (durable) {
+        syncPath(path, true);
+    }
+}
+
+/**
+* Forces path to stable storage or, if directory is set, the directory
+* holding path, which is what makes a rename into it stick. A no-op where
+* there is no fsync.
+*/
+template<typename Key, typename Value, typename Compare>
+void FrozenMap<Key, Value, Compare>::syncPath(const std::string& path, bool directory)
+{
+#if defined(FROZEN_MMAP)
+    std::string target = path;
+    if (directory) {
+        std::string::size_type slash = path.find_last_of('/');
+        target = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    }
+    int fd = ::open(target.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("FrozenMap: cannot sync " + target);
+    }
+    int result = ::fsync(fd);
+    ::close(fd);
+    if (result != 0) {
+        throw std::runtime_error("FrozenMap: cannot sync " + target);
+    }
+#else
+    (void)path;
+    (void)directory;
+#endif
+}
+
+/**
+* The header an image of size items of this map type has.
+*/
+template<typename Key, typename Value, typename Compare>
+FrozenImageHeader FrozenMap<Key, Value, Compare>::imageHeader(size_t size)
+{
+    FrozenImageHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "FROZENMP", sizeof(header.magic));
+    header.version = ImageVersion;
+    header.byteOrder = ByteOrderMark;
+    header.keySize = sizeof(Key);
+    header.valueSize = sizeof(Value);
+    header.itemSize = sizeof(Item);
+    header.itemAlign = alignof(Item);
+    header.size = size;
+    uint64_t align = alignof(Item) > 64 ? alignof(Item) : 64;
+    header.keysOffset = 64;
+    uint64_t keysEnd = header.keysOffset + (uint64_t(size) + 1) * sizeof(Key);
+    header.itemsOffset = (keysEnd + align - 1) / align * align;
+    header.fileSize = header.itemsOffset + uint64_t(size) * sizeof(Item);
+    return header;
+}
+
+/**
+* Images hold raw bytes, so only maps whose keys and values are trivially
+* copyable (no pointers to the heap, no invariants in constructors) can
+* be saved and mapped back.
+*/
+template<typename Key, typename Value, typename Compare>
+void FrozenMap<Key, Value, Compare>::checkImageTypes()
+{
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+                  "FrozenMap images need trivially copyable keys and values");
+    static_assert(sizeof(FrozenImageHeader) <= 64, "the header must fit before the keys");
+}
+
+/**
+* Index of the smallest key: the end of the leftmost path.
+*/
+template<typename Key, typename Value, typename Compare>
+size_t FrozenMap<Key, Value, Compare>::first() const
+{
+    if (size_ == 0) {
+        return 0;
+    }
+    size_t index = 1;
+    while (2 * index <= size_) {
+        index = 2 * index;
+    }
+    return index;
+}
+
+/**
+* Index of the largest key: the end of the rightmost path.
+*/
+template<typename Key, typename Value, typename Compare>
+size_t FrozenMap<Key, Value, Compare>::last() const
+{
+    if (size_ == 0) {
+        return 0;
+    }
+    size_t index = 1;
+    while (2 * index + 1 <= size_) {
+        index = 2 * index + 1;
+    }
+    return index;
+}
+
+/**
+* The in-order successor in the implicit tree, or 0 past the largest key:
+* the leftmost node of the right subtree if there is one, otherwise the
+* first ancestor reached from a left child.
+*/
+template<typename Key, typename Value, typename Compare>
+size_t FrozenMap<Key, Value, Compare>::successor(size_t index) const
+{
+    if (2 * index + 1 <= size_) {
+        index = 2 * index + 1;
+        while (2 * index <= size_) {
+            index = 2 * index;
+        }
+        return index;
+    }
+    return index >> (trailingOnes(index) + 1);
+}
+
+/**
+* The mirror image of successor().
+*/
+template<typename Key, typename Value, typename Compare>
+size_t FrozenMap<Key, Value, Compare>::predecessor(size_t index) const
+{
+    if (2 * index <= size_) {
+        index = 2 * index;
+        while (2 * index + 1 <= size_) {
+            index = 2 * index + 1;
+        }
+        return index;
+    }
+    return index >> (trailingZeros(index) + 1);
+}
+
+template<typename Key, typename Value, typename Compare>
+int FrozenMap<Key, Value, Compare>::trailingOnes(size_t index)
+{
+    return trailingZeros(~index);
+}
+
+template<typename Key, typename Value, typename Compare>
+int FrozenMap<Key, Value, Compare>::trailingZeros(size_t index)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(index);
+#else
+    int count = 0;
+    while (!(index & 1)) {
+        index >>= 1;
+        ++count;
+    }
+    return count;
+#endif
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the FrozenMap class.
+  ---------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,930 @@
+#ifndef INTRUSIVE_AVL_H
+#define INTRUSIVE_AVL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include "avlbst.h"
+
+/**
+* The links an object needs to sit in an IntrusiveAVLTree. The object's
+* type derives from the hook, once per tree it can be in at the same time,
+* with a distinct Tag for each. Copying an object gives the copy an
+* unlinked hook and assigning one leaves its links alone, so objects stay
+* copyable. An object must be unlinked before it is destroyed.
+*
+* The accessors follow AVLNode's so the rebalancing routines in avlbst.h
+* work on hooks unchanged; they are for IntrusiveAVLTree's use.
+*/
+template <typename Tag = void>
+class IntrusiveAVLHook
+{
+public:
+    IntrusiveAVLHook();
+    IntrusiveAVLHook(const IntrusiveAVLHook& other);
+    IntrusiveAVLHook& operator=(const IntrusiveAVLHook& other);
+
+    bool is_linked() const;
+
+    IntrusiveAVLHook* getParent() const;
+    IntrusiveAVLHook* getLeft() const;
+    IntrusiveAVLHook* getRight() const;
+    void setParent(IntrusiveAVLHook* parent);
+    void setLeft(IntrusiveAVLHook* left);
+    void setRight(IntrusiveAVLHook* right);
+    int8_t getBalance() const;
+    void setBalance(int8_t balance);
+    void updateBalance(int8_t diff);
+    void pullUp();
+    void unlink();
+
+protected:
+    // Balance of a hook in no tree; a linked one is between -2 and 2
+    static const int8_t Unlinked = INT8_MAX;
+
+    IntrusiveAVLHook* parent_;
+    IntrusiveAVLHook* left_;
+    IntrusiveAVLHook* right_;
+    int8_t balance_;
+};
+
+/**
+* An AVL tree over objects the caller owns, for objects that already live
+* in the caller's own pools. insert() links the object itself through its
+* hook: there is no node to allocate and nothing is copied, and the tree
+* never constructs, copies or destroys a T. unlink() takes an object out in
+* O(log n) without searching for it.
+*
+* T derives from IntrusiveAVLHook<Tag>, and KeyOf maps a const T& to its
+* key, which must not change while the object is linked. Keys are unique.
+* Rotation and retracing are the same routines AVLTree uses.
+*/
+template <typename T, typename Key, typename KeyOf,
+          typename Compare = std::less<Key>, typename Tag = void>
+class IntrusiveAVLTree
+{
+public:
+    typedef IntrusiveAVLHook<Tag> Hook;
+
+    explicit IntrusiveAVLTree(const Compare& comp = Compare(), const KeyOf& keyOf = KeyOf());
+    IntrusiveAVLTree(const IntrusiveAVLTree& other) = delete;
+    IntrusiveAVLTree& operator=(const IntrusiveAVLTree& other) = delete;
+    ~IntrusiveAVLTree();
+
+    class const_iterator;
+
+    /**
+    * A bidirectional iterator over the linked objects in key order.
+    * Decrementing end() yields the object with the largest key.
+    */
+    class iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef T* pointer;
+        typedef T& reference;
+
+        iterator();
+
+        T& operator*() const;
+        T* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+        iterator operator++(int);
+        iterator& operator--();
+        iterator operator--(int);
+
+    protected:
+        friend class IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>;
+        friend class const_iterator;
+        iterator(Hook* hook, const IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>* tree);
+        Hook* current_;
+        const IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>* tree_;
+    };
+
+    /**
+    * The read-only counterpart of iterator.
+    */
+    class const_iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const T* pointer;
+        typedef const T& reference;
+
+        const_iterator();
+        const_iterator(const iterator& it);
+
+        const T& operator*() const;
+        const T* operator->() const;
+
+        bool operator==(const const_iterator& rhs) const;
+        bool operator!=(const const_iterator& rhs) const;
+
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        const_iterator& operator--();
+        const_iterator operator--(int);
+
+    protected:
+        friend class IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>;
+        const_iterator(const Hook* hook, const IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>* tree);
+        const Hook* current_;
+        const IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>* tree_;
+    };
+
+    std::pair<iterator, bool> insert(T& object);
+    void unlink(T& object);
+    T* remove(const Key& key);
+    void clear();
+    bool empty() const;
+    size_t size() const;
+    Compare key_comp() const;
+
+    iterator begin();
+    const_iterator begin() const;
+    iterator end();
+    const_iterator end() const;
+    iterator find(const Key& key);
+    const_iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key);
+    const_iterator lower_bound(const Key& key) const;
+    iterator iterator_to(T& object);
+    const_iterator iterator_to(const T& object) const;
+
+    bool validate() const;
+
+protected:
+    const Key& key(const Hook* hook) const;
+    Hook* lowerBound(const Key& key) const;
+    Hook* findHook(const Key& key) const;
+    static Hook* successor(const Hook* hook);
+    static Hook* predecessor(const Hook* hook);
+    void replaceChild(Hook* parent, Hook* oldChild, Hook* newChild);
+    void swapWithPredecessor(Hook* hook, Hook* pred);
+    int validateHelp(const Hook* hook, bool& ok) const;
+
+    Hook* root_;
+    size_t size_;
+    Compare comp_;
+    KeyOf keyOf_;
+};
+
+/*
+  ------------------------------------------------------
+  Begin implementations for the IntrusiveAVLHook class.
+  ------------------------------------------------------
+*/
+
+template<typename Tag>
+IntrusiveAVLHook<Tag>::IntrusiveAVLHook() :
+    parent_(nullptr),
+    left_(nullptr),
+    right_(nullptr),
+    balance_(Unlinked)
+{
+
+}
+
+template<typename Tag>
+IntrusiveAVLHook<Tag>::IntrusiveAVLHook(const IntrusiveAVLHook&) :
+    parent_(nullptr),
+    left_(nullptr),
+    right_(nullptr),
+    balance_(Unlinked)
+{
+
+}
+
+template<typename Tag>
+IntrusiveAVLHook<Tag>& IntrusiveAVLHook<Tag>::operator=(const IntrusiveAVLHook&)
+{
+    return *this;
+}
+
+template<typename Tag>
+bool IntrusiveAVLHook<Tag>::is_linked() const
+{
+    return balance_ != Unlinked;
+}
+
+template<typename Tag>
+IntrusiveAVLHook<Tag>* IntrusiveAVLHook<Tag>::getParent() const
+{
+    return parent_;
+}
+
+template<typename Tag>
+IntrusiveAVLHook<Tag>* IntrusiveAVLHook<Tag>::getLeft() const
+{
+    return left_;
+}
+
+template<typename Tag>
+IntrusiveAVLHook<Tag>* IntrusiveAVLHook<Tag>::getRight() const
+{
+    return right_;
+}
+
+template<typename Tag>
+void IntrusiveAVLHook<Tag>::setParent(IntrusiveAVLHook* parent)
+{
+    parent_ = parent;
+}
+
+template<typename Tag>
+void IntrusiveAVLHook<Tag>::setLeft(IntrusiveAVLHook* left)
+{
+    left_ = left;
+}
+
+template<typename Tag>
+void IntrusiveAVLHook<Tag>::setRight(IntrusiveAVLHook* right)
+{
+    right_ = right;
+}
+
+template<typename Tag>
+int8_t IntrusiveAVLHook<Tag>::getBalance() const
+{
+    return balance_;
+}
+
+template<typename Tag>
+void IntrusiveAVLHook<Tag>::setBalance(int8_t balance)
+{
+    balance_ = balance;
+}
+
+template<typename Tag>
+void IntrusiveAVLHook<Tag>::updateBalance(int8_t diff)
+{
+    balance_ += diff;
+}
+
+/**
+* Hooks carry no augmentation, so there is nothing to recompute.
+*/
+template<typename Tag>
+void IntrusiveAVLHook<Tag>::pullUp()
+{
+
+}
+
+/**
+* Resets the links to those of a hook in no tree.
+*/
+template<typename Tag>
+void IntrusiveAVLHook<Tag>::unlink()
+{
+    parent_ = left_ = right_ = nullptr;
+    balance_ = Unlinked;
+}
+
+/*
+  ----------------------------------------------------
+  End implementations for the IntrusiveAVLHook class.
+  ----------------------------------------------------
+*/
+
+/*
+  -------------------------------------------------------------
+  Begin implementations for the IntrusiveAVLTree iterator classes.
+  -------------------------------------------------------------
+*/
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::iterator::iterator() :
+    current_(nullptr),
+    tree_(nullptr)
+{
+
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::iterator::iterator(
+    Hook* hook, const IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>* tree) :
+    current_(hook),
+    tree_(tree)
+{
+
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+T& IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::iterator::operator*() const
+{
+    return static_cast<T&>(*current_);
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+T* IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::iterator::operator->() const
+{
+    return static_cast<T*>(current_);
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+bool IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::iterator::operator==(const iterator& rhs) const
+{
+    return current_ == rhs.current_;
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+bool IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+typename IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::iterator&
+IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::iterator::operator++()
+{
+    current_ = successor(current_);
+    return *this;
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+typename IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::iterator
+IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::iterator::operator++(int)
+{
+    iterator old(*this);
+    ++(*this);
+    return old;
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+typename IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::iterator&
+IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::iterator::operator--()
+{
+    if (current_) {
+        current_ = predecessor(current_);
+    }
+    else {
+        current_ = tree_->root_;
+        while (current_ && current_->getRight()) {
+            current_ = current_->getRight();
+        }
+    }
+    return *this;
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+typename IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::iterator
+IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::iterator::operator--(int)
+{
+    iterator old(*this);
+    --(*this);
+    return old;
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::const_iterator::const_iterator() :
+    current_(nullptr),
+    tree_(nullptr)
+{
+
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::const_iterator::const_iterator(const iterator& it) :
+    current_(it.current_),
+    tree_(it.tree_)
+{
+
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::const_iterator::const_iterator(
+    const Hook* hook, const IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>* tree) :
+    current_(hook),
+    tree_(tree)
+{
+
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+const T& IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::const_iterator::operator*() const
+{
+    return static_cast<const T&>(*current_);
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+const T* IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::const_iterator::operator->() const
+{
+    return static_cast<const T*>(current_);
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+bool IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::const_iterator::operator==(const const_iterator& rhs) const
+{
+    return current_ == rhs.current_;
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+bool IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::const_iterator::operator!=(const const_iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+typename IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::const_iterator&
+IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::const_iterator::operator++()
+{
+    current_ = successor(current_);
+    return *this;
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+typename IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::const_iterator
+IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::const_iterator::operator++(int)
+{
+    const_iterator old(*this);
+    ++(*this);
+    return old;
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+typename IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::const_iterator&
+IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::const_iterator::operator--()
+{
+    if (current_) {
+        current_ = predecessor(current_);
+    }
+    else {
+        current_ = tree_->root_;
+        while (current_ && current_->getRight()) {
+            current_ = current_->getRight();
+        }
+    }
+    return *this;
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+typename IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::const_iterator
+IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::const_iterator::operator--(int)
+{
+    const_iterator old(*this);
+    --(*this);
+    return old;
+}
+
+/*
+  -----------------------------------------------------------
+  End implementations for the IntrusiveAVLTree iterator classes.
+  -----------------------------------------------------------
+*/
+
+/*
+  ------------------------------------------------------
+  Begin implementations for the IntrusiveAVLTree class.
+  ------------------------------------------------------
+*/
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::IntrusiveAVLTree(const Compare& comp, const KeyOf& keyOf) :
+    root_(nullptr),
+    size_(0),
+    comp_(comp),
+    keyOf_(keyOf)
+{
+
+}
+
+/**
+* Unlinks every object; none is destroyed.
+*/
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::~IntrusiveAVLTree()
+{
+    clear();
+}
+
+/**
+* Links object into the tree unless an object with an equal key is already
+* there. Returns an iterator to whichever object holds the key and whether
+* it is the one passed in. Throws std::logic_error if object is already
+* linked (in this tree or another using the same hook).
+*/
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+std::pair<typename IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::iterator, bool>
+IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::insert(T& object)
+{
+    Hook* hook = &object;
+    if (hook->is_linked()) {
+        throw std::logic_error("IntrusiveAVLTree: object is already linked");
+    }
+
+    const Key& newKey = keyOf_(object);
+    // One comparison per level, as in lowerBound()
+    Hook* parent = nullptr;
+    Hook* current = root_;
+    Hook* bound = nullptr;
+    bool isLeft = false;
+    while (current) {
+        parent = current;
+        isLeft = !comp_(key(current), newKey);
+        if (isLeft) {
+            bound = current;
+            current = current->getLeft();
+        }
+        else {
+            current = current->getRight();
+        }
+    }
+    if (bound && !comp_(newKey, key(bound))) {
+        return std::make_pair(iterator(bound, this), false);
+    }
+
+    hook->setParent(parent);
+    hook->setBalance(0);
+    ++size_;
+    if (!parent) {
+        root_ = hook;
+    }
+    else {
+        if (isLeft) {
+            parent->setLeft(hook);
+            parent->updateBalance(-1);
+        }
+        else {
+            parent->setRight(hook);
+            parent->updateBalance(1);
+        }
+        if (parent->getBalance() != 0) {
+            avlInsertRetrace(root_, parent, hook);
+        }
+    }
+    return std::make_pair(iterator(hook, this), true);
+}
+
+/**
+ * @precondition object is linked in this tree
+ * Takes object out of the tree; the object itself is left alone. Like
+ * AVLTree::remove, a hook with two children first trades places with its
+ * predecessor. Throws std::logic_error if object is not linked at all,
+ * which would otherwise unhook the root and drop the whole tree.
+ */
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+void IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::unlink(T& object)
+{
+    Hook* hook = &object;
+    if (!hook->is_linked()) {
+        throw std::logic_error("IntrusiveAVLTree: object is not linked");
+    }
+    if (hook->getLeft() && hook->getRight()) {
+        swapWithPredecessor(hook, predecessor(hook));
+    }
+
+    Hook* parent = hook->getParent();
+    Hook* child = hook->getLeft() ? hook->getLeft() : hook->getRight();
+    int difference = 0;
+    if (parent) {
+        difference = (parent->getLeft() == hook) ? 1 : -1;
+    }
+    if (child) {
+        child->setParent(parent);
+    }
+    replaceChild(parent, hook, child);
+    hook->unlink();
+    --size_;
+    avlRemoveRetrace(root_, parent, difference);
+}
+
+/**
+* Unlinks the object with key and returns it, or returns nullptr if there
+* is none.
+*/
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+T* IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::remove(const Key& key)
+{
+    Hook* hook = findHook(key);
+    if (!hook) {
+        return nullptr;
+    }
+    T* object = static_cast<T*>(hook);
+    unlink(*object);
+    return object;
+}
+
+/**
+* Unlinks every object, leaving each hook as if newly constructed. O(n),
+* walking the tree in post-order without a stack.
+*/
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+void IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::clear()
+{
+    Hook* hook = root_;
+    while (hook) {
+        if (hook->getLeft()) {
+            hook = hook->getLeft();
+        }
+        else if (hook->getRight()) {
+            hook = hook->getRight();
+        }
+        else {
+            Hook* parent = hook->getParent();
+            if (parent) {
+                if (parent->getLeft() == hook) {
+                    parent->setLeft(nullptr);
+                }
+                else {
+                    parent->setRight(nullptr);
+                }
+            }
+            hook->unlink();
+            hook = parent;
+        }
+    }
+    root_ = nullptr;
+    size_ = 0;
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+bool IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::empty() const
+{
+    return size_ == 0;
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+size_t IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::size() const
+{
+    return size_;
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+Compare IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::key_comp() const
+{
+    return comp_;
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+typename IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::iterator
+IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::begin()
+{
+    Hook* hook = root_;
+    while (hook && hook->getLeft()) {
+        hook = hook->getLeft();
+    }
+    return iterator(hook, this);
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+typename IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::const_iterator
+IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::begin() const
+{
+    const Hook* hook = root_;
+    while (hook && hook->getLeft()) {
+        hook = hook->getLeft();
+    }
+    return const_iterator(hook, this);
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+typename IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::iterator
+IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::end()
+{
+    return iterator(nullptr, this);
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+typename IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::const_iterator
+IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::end() const
+{
+    return const_iterator(nullptr, this);
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+typename IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::iterator
+IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::find(const Key& key)
+{
+    return iterator(findHook(key), this);
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+typename IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::const_iterator
+IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::find(const Key& key) const
+{
+    return const_iterator(findHook(key), this);
+}
+
+/**
+* Returns an iterator to the first object whose key is not less than key
+*/
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+typename IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::iterator
+IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::lower_bound(const Key& key)
+{
+    return iterator(lowerBound(key), this);
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+typename IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::const_iterator
+IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::lower_bound(const Key& key) const
+{
+    return const_iterator(lowerBound(key), this);
+}
+
+/**
+ * @precondition object is linked in this tree
+ * Returns an iterator to object, in O(1)
+ */
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+typename IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::iterator
+IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::iterator_to(T& object)
+{
+    return iterator(&object, this);
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+typename IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::const_iterator
+IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::iterator_to(const T& object) const
+{
+    return const_iterator(&object, this);
+}
+
+/**
+* Checks order, parent links, stored balances against measured heights, and
+* the object count. Meant for tests.
+*/
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+bool IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::validate() const
+{
+    bool ok = !root_ || !root_->getParent();
+    validateHelp(root_, ok);
+    size_t count = 0;
+    const Hook* before = nullptr;
+    for (const_iterator it = begin(); it != end(); ++it) {
+        if (before && !comp_(key(before), keyOf_(*it))) {
+            ok = false;
+        }
+        before = it.current_;
+        ++count;
+    }
+    return ok && count == size_;
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+int IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::validateHelp(const Hook* hook, bool& ok) const
+{
+    if (!hook) {
+        return 0;
+    }
+    if ((hook->getLeft() && hook->getLeft()->getParent() != hook) ||
+        (hook->getRight() && hook->getRight()->getParent() != hook)) {
+        ok = false;
+    }
+    int leftHeight = validateHelp(hook->getLeft(), ok);
+    int rightHeight = validateHelp(hook->getRight(), ok);
+    if (hook->getBalance() != rightHeight - leftHeight) {
+        ok = false;
+    }
+    return 1 + std::max(leftHeight, rightHeight);
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+const Key& IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::key(const Hook* hook) const
+{
+    return keyOf_(static_cast<const T&>(*hook));
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+typename IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::Hook*
+IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::lowerBound(const Key& key) const
+{
+    Hook* hook = root_;
+    Hook* bound = nullptr;
+    while (hook) {
+        if (comp_(this->key(hook), key)) {
+            hook = hook->getRight();
+        }
+        else {
+            bound = hook;
+            hook = hook->getLeft();
+        }
+    }
+    return bound;
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+typename IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::Hook*
+IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::findHook(const Key& key) const
+{
+    Hook* bound = lowerBound(key);
+    if (!bound || comp_(key, this->key(bound))) {
+        return nullptr;
+    }
+    return bound;
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+typename IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::Hook*
+IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::successor(const Hook* hook)
+{
+    if (hook->getRight()) {
+        Hook* next = hook->getRight();
+        while (next->getLeft()) {
+            next = next->getLeft();
+        }
+        return next;
+    }
+    Hook* parent = hook->getParent();
+    while (parent && parent->getRight() == hook) {
+        hook = parent;
+        parent = parent->getParent();
+    }
+    return parent;
+}
+
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+typename IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::Hook*
+IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::predecessor(const Hook* hook)
+{
+    if (hook->getLeft()) {
+        Hook* prev = hook->getLeft();
+        while (prev->getRight()) {
+            prev = prev->getRight();
+        }
+        return prev;
+    }
+    Hook* parent = hook->getParent();
+    while (parent && parent->getLeft() == hook) {
+        hook = parent;
+        parent = parent->getParent();
+    }
+    return parent;
+}
+
+/**
+* Points parent's link to oldChild at newChild instead, or root_ if parent
+* is null.
+*/
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+void IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::replaceChild(Hook* parent, Hook* oldChild, Hook* newChild)
+{
+    if (!parent) {
+        root_ = newChild;
+    }
+    else if (parent->getLeft() == oldChild) {
+        parent->setLeft(newChild);
+    }
+    else {
+        parent->setRight(newChild);
+    }
+}
+
+/**
+* Exchanges the positions and balances of a hook with two children and its
+* predecessor, the rightmost hook of its left subtree. Afterwards hook has
+* at most a left child. The hooks trade places rather than contents, since
+* the objects are the caller's.
+*/
+template<typename T, typename Key, typename KeyOf, typename Compare, typename Tag>
+void IntrusiveAVLTree<T, Key, KeyOf, Compare, Tag>::swapWithPredecessor(Hook* hook, Hook* pred)
+{
+    Hook* parent = hook->getParent();
+    Hook* left = hook->getLeft();
+    Hook* right = hook->getRight();
+    Hook* predParent = pred->getParent();
+    Hook* predLeft = pred->getLeft();
+
+    replaceChild(parent, hook, pred);
+    pred->setParent(parent);
+    pred->setRight(right);
+    right->setParent(pred);
+    if (pred == left) {
+        pred->setLeft(hook);
+        hook->setParent(pred);
+    }
+    else {
+        pred->setLeft(left);
+        left->setParent(pred);
+        predParent->setRight(hook);
+        hook->setParent(predParent);
+    }
+    hook->setLeft(predLeft);
+    if (predLeft) {
+        predLeft->setParent(hook);
+    }
+    hook->setRight(nullptr);
+
+    int8_t balance = hook->getBalance();
+    hook->setBalance(pred->getBalance());
+    pred->setBalance(balance);
+}
+
+/*
+  ----------------------------------------------------
+  End implementations for the IntrusiveAVLTree class.
+  ----------------------------------------------------
+*/
+
+#endif
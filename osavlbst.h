@@ -0,0 +1,269 @@
+#ifndef OSAVLBST_H
+#define OSAVLBST_H
+
+#include <cstddef>
+#include "avlbst.h"
+
+/**
+* An AVL node that also records the number of nodes in its subtree
+* (itself included), which is what makes rank and select O(log n).
+*/
+template <typename Key, typename Value>
+class OSAVLNode : public AVLNode<Key, Value>
+{
+public:
+    OSAVLNode(const Key& key, const Value& value, OSAVLNode<Key, Value>* parent);
+    OSAVLNode(const ItemBuilder<Key, Value>& builder, OSAVLNode<Key, Value>* parent);
+
+    size_t getSize() const;
+    static size_t sizeOf(const OSAVLNode<Key, Value>* node);
+
+    // Hide the AVLNode getters so they return OSAVLNodes.
+    OSAVLNode<Key, Value>* getParent() const;
+    OSAVLNode<Key, Value>* getLeft() const;
+    OSAVLNode<Key, Value>* getRight() const;
+
+    // Augmentation hooks called by AVLTree, see AVLNode.
+    void pullUp();
+    void swapAugmentation(OSAVLNode<Key, Value>* other);
+    static void adjustAncestors(OSAVLNode<Key, Value>* from, int delta);
+
+protected:
+    size_t size_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the OSAVLNode class.
+  -------------------------------------------------
+*/
+
+/**
+* A new node is always a leaf, so its subtree is just itself.
+*/
+template<class Key, class Value>
+OSAVLNode<Key, Value>::OSAVLNode(const Key& key, const Value& value, OSAVLNode<Key, Value>* parent) :
+    AVLNode<Key, Value>(key, value, parent), size_(1)
+{
+
+}
+
+template<class Key, class Value>
+OSAVLNode<Key, Value>::OSAVLNode(const ItemBuilder<Key, Value>& builder, OSAVLNode<Key, Value>* parent) :
+    AVLNode<Key, Value>(builder, parent), size_(1)
+{
+
+}
+
+template<class Key, class Value>
+size_t OSAVLNode<Key, Value>::getSize() const
+{
+    return size_;
+}
+
+/**
+* Subtree size that treats NULL as an empty subtree.
+*/
+template<class Key, class Value>
+size_t OSAVLNode<Key, Value>::sizeOf(const OSAVLNode<Key, Value>* node)
+{
+    return node ? node->size_ : 0;
+}
+
+template<class Key, class Value>
+OSAVLNode<Key, Value>* OSAVLNode<Key, Value>::getParent() const
+{
+    return static_cast<OSAVLNode<Key, Value>*>(this->parent_);
+}
+
+template<class Key, class Value>
+OSAVLNode<Key, Value>* OSAVLNode<Key, Value>::getLeft() const
+{
+    return static_cast<OSAVLNode<Key, Value>*>(this->left_);
+}
+
+template<class Key, class Value>
+OSAVLNode<Key, Value>* OSAVLNode<Key, Value>::getRight() const
+{
+    return static_cast<OSAVLNode<Key, Value>*>(this->right_);
+}
+
+/**
+* Recomputes the size from the children, which must already be correct.
+*/
+template<class Key, class Value>
+void OSAVLNode<Key, Value>::pullUp()
+{
+    size_ = 1 + sizeOf(getLeft()) + sizeOf(getRight());
+}
+
+/**
+* nodeSwap exchanges positions, and the size belongs to the position.
+*/
+template<class Key, class Value>
+void OSAVLNode<Key, Value>::swapAugmentation(OSAVLNode<Key, Value>* other)
+{
+    size_t temp = size_;
+    size_ = other->size_;
+    other->size_ = temp;
+}
+
+/**
+* Adds delta to every size from 'from' up to the root. AVLTree calls this
+* right after linking or unlinking a leaf and before retracing, so the
+* rotations done while retracing see correct child sizes.
+*/
+template<class Key, class Value>
+void OSAVLNode<Key, Value>::adjustAncestors(OSAVLNode<Key, Value>* from, int delta)
+{
+    for (OSAVLNode<Key, Value>* node = from; node; node = node->getParent()) {
+        node->size_ += delta;
+    }
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the OSAVLNode class.
+  -----------------------------------------------
+*/
+
+/**
+* An order-statistic AVL tree: an AVLTree whose nodes track subtree sizes,
+* adding O(log n) positional queries. Insert and remove stay O(log n) but
+* always walk to the root to update sizes.
+*/
+template <class Key, class Value,
+          class Compare = std::less<Key>,
+          class Alloc = std::allocator<std::pair<const Key, Value> > >
+class OrderStatisticAVLTree : public AVLTree<Key, Value, Compare, Alloc, OSAVLNode<Key, Value> >
+{
+public:
+    typedef typename BinarySearchTree<Key, Value, Compare, Alloc>::iterator iterator;
+    typedef typename BinarySearchTree<Key, Value, Compare, Alloc>::const_iterator const_iterator;
+
+    explicit OrderStatisticAVLTree(const Compare& comp = Compare(), const Alloc& alloc = Alloc());
+    template<class ForwardIt>
+    OrderStatisticAVLTree(ForwardIt first, ForwardIt last,
+                          const Compare& comp = Compare(), const Alloc& alloc = Alloc());
+
+    size_t size() const;
+    iterator select(size_t k);
+    const_iterator select(size_t k) const;
+    size_t rank(const Key& key) const;
+    size_t count(const Key& lo, const Key& hi) const;
+
+protected:
+    OSAVLNode<Key, Value>* getRoot() const;
+    OSAVLNode<Key, Value>* selectNode(size_t k) const;
+};
+
+template<class Key, class Value, class Compare, class Alloc>
+OrderStatisticAVLTree<Key, Value, Compare, Alloc>::OrderStatisticAVLTree(const Compare& comp, const Alloc& alloc) :
+    AVLTree<Key, Value, Compare, Alloc, OSAVLNode<Key, Value> >(comp, alloc)
+{
+
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+template<class ForwardIt>
+OrderStatisticAVLTree<Key, Value, Compare, Alloc>::OrderStatisticAVLTree(
+    ForwardIt first, ForwardIt last, const Compare& comp, const Alloc& alloc) :
+    AVLTree<Key, Value, Compare, Alloc, OSAVLNode<Key, Value> >(first, last, comp, alloc)
+{
+
+}
+
+/**
+* Returns the number of items in the tree in O(1).
+*/
+template<class Key, class Value, class Compare, class Alloc>
+size_t OrderStatisticAVLTree<Key, Value, Compare, Alloc>::size() const
+{
+    return OSAVLNode<Key, Value>::sizeOf(getRoot());
+}
+
+/**
+* Returns an iterator to the k-th smallest item (0-based),
+* or the end iterator if k >= size()
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename OrderStatisticAVLTree<Key, Value, Compare, Alloc>::iterator
+OrderStatisticAVLTree<Key, Value, Compare, Alloc>::select(size_t k)
+{
+    return this->makeIterator(selectNode(k));
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename OrderStatisticAVLTree<Key, Value, Compare, Alloc>::const_iterator
+OrderStatisticAVLTree<Key, Value, Compare, Alloc>::select(size_t k) const
+{
+    return this->makeIterator(selectNode(k));
+}
+
+/**
+* Returns the number of keys strictly less than key, which is the
+* position key has (or would have) in sorted order
+*/
+template<class Key, class Value, class Compare, class Alloc>
+size_t OrderStatisticAVLTree<Key, Value, Compare, Alloc>::rank(const Key& key) const
+{
+    OSAVLNode<Key, Value>* current = getRoot();
+    size_t less = 0;
+
+    while (current) {
+        if (this->comp_(current->getKey(), key)) {
+            // This node and its whole left subtree are smaller
+            less += OSAVLNode<Key, Value>::sizeOf(current->getLeft()) + 1;
+            current = current->getRight();
+        }
+        else {
+            current = current->getLeft();
+        }
+    }
+    return less;
+}
+
+/**
+* Returns the number of keys in [lo, hi)
+*/
+template<class Key, class Value, class Compare, class Alloc>
+size_t OrderStatisticAVLTree<Key, Value, Compare, Alloc>::count(const Key& lo, const Key& hi) const
+{
+    if (!this->comp_(lo, hi)) {
+        return 0;
+    }
+    return rank(hi) - rank(lo);
+}
+
+/**
+* Helper for select(): skips whole left subtrees by their size.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+OSAVLNode<Key, Value>* OrderStatisticAVLTree<Key, Value, Compare, Alloc>::selectNode(size_t k) const
+{
+    OSAVLNode<Key, Value>* current = getRoot();
+
+    while (current) {
+        size_t leftSize = OSAVLNode<Key, Value>::sizeOf(current->getLeft());
+        if (k < leftSize) {
+            current = current->getLeft();
+        }
+        else if (k == leftSize) {
+            break;
+        }
+        else {
+            // Skip the left subtree and this node
+            k -= leftSize + 1;
+            current = current->getRight();
+        }
+    }
+    return current;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+OSAVLNode<Key, Value>* OrderStatisticAVLTree<Key, Value, Compare, Alloc>::getRoot() const
+{
+    return static_cast<OSAVLNode<Key, Value>*>(this->root_);
+}
+
+#endif
@@ -0,0 +1,630 @@
+#ifndef PERSISTENT_AVL_H
+#define PERSISTENT_AVL_H
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/**
+* A node of a PersistentAVLTree. Nodes are shared between versions, so
+* refs_ counts the parents and tree handles pointing at one; a node is only
+* ever changed by a handle that reaches it through nodes no other version
+* can see.
+*/
+template <typename Key, typename Value>
+struct PersistentAVLNode
+{
+    PersistentAVLNode(const std::pair<const Key, Value>& item,
+                      PersistentAVLNode* left, PersistentAVLNode* right, int height);
+
+    std::pair<const Key, Value> item_;
+    PersistentAVLNode* left_;
+    PersistentAVLNode* right_;
+    int height_;
+    std::atomic<size_t> refs_;
+};
+
+template<typename Key, typename Value>
+PersistentAVLNode<Key, Value>::PersistentAVLNode(
+    const std::pair<const Key, Value>& item,
+    PersistentAVLNode* left, PersistentAVLNode* right, int height) :
+    item_(item),
+    left_(left),
+    right_(right),
+    height_(height),
+    refs_(1)
+{
+
+}
+
+/**
+* An AVL tree whose versions share structure, for readers that need a
+* consistent view while writers keep going. snapshot() (or copying the
+* tree) is O(1): it only takes another reference to the root. insert()
+* and remove() then copy just the O(log n) nodes on the path they change
+* (plus the one or two a rotation reshapes) and leave every other version
+* untouched; untouched subtrees stay shared. Nodes are freed by reference
+* counting when the last version using them goes away.
+*
+* A node that is not shared with any other version is updated in place,
+* so a tree nobody has snapshotted costs about what an AVLTree does.
+*
+* Versions are immutable once shared, so any number of threads may read
+* the same version, and handing a snapshot to another thread is safe. A
+* single handle must not be written while it is read or snapshotted.
+* Iterators into a handle stay valid until that handle is next written;
+* iterate a snapshot to keep them.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class PersistentAVLTree
+{
+public:
+    explicit PersistentAVLTree(const Compare& comp = Compare());
+    PersistentAVLTree(const PersistentAVLTree& other);
+    PersistentAVLTree(PersistentAVLTree&& other) noexcept;
+    PersistentAVLTree& operator=(const PersistentAVLTree& other);
+    PersistentAVLTree& operator=(PersistentAVLTree&& other) noexcept;
+    ~PersistentAVLTree();
+
+    /**
+    * A read-only forward iterator over the items in key order. It holds
+    * the path back up the tree, since nodes have no parent pointers (a
+    * shared node has a parent in every version that uses it).
+    */
+    class const_iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const std::pair<const Key, Value>* pointer;
+        typedef const std::pair<const Key, Value>& reference;
+
+        const_iterator();
+
+        const std::pair<const Key, Value>& operator*() const;
+        const std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const const_iterator& rhs) const;
+        bool operator!=(const const_iterator& rhs) const;
+
+        const_iterator& operator++();
+        const_iterator operator++(int);
+
+    private:
+        friend class PersistentAVLTree<Key, Value, Compare>;
+        void pushLeftSpine(const PersistentAVLNode<Key, Value>* node);
+        // The current node on top, below it the ancestors still to visit
+        std::vector<const PersistentAVLNode<Key, Value>*> path_;
+    };
+    typedef const_iterator iterator;
+
+    PersistentAVLTree snapshot() const;
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    const_iterator begin() const;
+    const_iterator end() const;
+    const_iterator find(const Key& key) const;
+    Value const & operator[](const Key& key) const;
+    size_t size() const;
+    bool empty() const;
+
+private:
+    typedef PersistentAVLNode<Key, Value> Node;
+
+    static Node* share(Node* node);
+    static void release(Node* node);
+    static Node* own(Node*& slot);
+    static int height(const Node* node);
+    static void updateHeight(Node* node);
+    static Node* rotateRight(Node* node);
+    static Node* rotateLeft(Node* node);
+    static Node* rebalance(Node* node);
+    bool insertHelp(Node*& slot, const std::pair<const Key, Value>& keyValuePair);
+    void removeHelp(Node*& slot, const Key& key);
+    static Node* removeMin(Node*& slot);
+    const Node* internalFind(const Key& key) const;
+
+    Node* root_;
+    size_t size_;
+    Compare comp_;
+};
+
+/*
+  -----------------------------------------------------------
+  Begin implementations for the PersistentAVLTree class.
+  -----------------------------------------------------------
+*/
+
+template<typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>::PersistentAVLTree(const Compare& comp) :
+    root_(nullptr),
+    size_(0),
+    comp_(comp)
+{
+
+}
+
+/**
+* O(1): the copy shares every node with other.
+*/
+template<typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>::PersistentAVLTree(const PersistentAVLTree& other) :
+    root_(share(other.root_)),
+    size_(other.size_),
+    comp_(other.comp_)
+{
+
+}
+
+template<typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>::PersistentAVLTree(PersistentAVLTree&& other) noexcept :
+    root_(other.root_),
+    size_(other.size_),
+    comp_(other.comp_)
+{
+    other.root_ = nullptr;
+    other.size_ = 0;
+}
+
+template<typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>&
+PersistentAVLTree<Key, Value, Compare>::operator=(const PersistentAVLTree& other)
+{
+    Node* old = root_;
+    root_ = share(other.root_);
+    size_ = other.size_;
+    comp_ = other.comp_;
+    release(old);
+    return *this;
+}
+
+template<typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>&
+PersistentAVLTree<Key, Value, Compare>::operator=(PersistentAVLTree&& other) noexcept
+{
+    if (this != &other) {
+        release(root_);
+        root_ = other.root_;
+        size_ = other.size_;
+        comp_ = other.comp_;
+        other.root_ = nullptr;
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+template<typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>::~PersistentAVLTree()
+{
+    release(root_);
+}
+
+/**
+* Returns the current version, which later writes to this tree leave
+* unchanged. O(1).
+*/
+template<typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare> PersistentAVLTree<Key, Value, Compare>::snapshot() const
+{
+    return *this;
+}
+
+/**
+* Inserts the pair, or replaces the value if the key is already present,
+* copying the path to it wherever that path is shared with a snapshot.
+*/
+template<typename Key, typename Value, typename Compare>
+void PersistentAVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    if (insertHelp(root_, keyValuePair)) {
+        ++size_;
+    }
+}
+
+template<typename Key, typename Value, typename Compare>
+void PersistentAVLTree<Key, Value, Compare>::remove(const Key& key)
+{
+    // Look first, so a miss copies nothing
+    if (internalFind(key)) {
+        removeHelp(root_, key);
+        --size_;
+    }
+}
+
+/**
+* Drops this version's reference; nodes still used by snapshots survive.
+*/
+template<typename Key, typename Value, typename Compare>
+void PersistentAVLTree<Key, Value, Compare>::clear()
+{
+    release(root_);
+    root_ = nullptr;
+    size_ = 0;
+}
+
+template<typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::const_iterator
+PersistentAVLTree<Key, Value, Compare>::begin() const
+{
+    const_iterator it;
+    it.pushLeftSpine(root_);
+    return it;
+}
+
+template<typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::const_iterator
+PersistentAVLTree<Key, Value, Compare>::end() const
+{
+    return const_iterator();
+}
+
+/**
+* Keeps the ancestors it went left at, which are the ones ++ visits next.
+*/
+template<typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::const_iterator
+PersistentAVLTree<Key, Value, Compare>::find(const Key& key) const
+{
+    const_iterator it;
+    const Node* curr = root_;
+    while (curr) {
+        if (comp_(key, curr->item_.first)) {
+            it.path_.push_back(curr);
+            curr = curr->left_;
+        }
+        else if (comp_(curr->item_.first, key)) {
+            curr = curr->right_;
+        }
+        else {
+            it.path_.push_back(curr);
+            return it;
+        }
+    }
+    return end();
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<typename Key, typename Value, typename Compare>
+Value const & PersistentAVLTree<Key, Value, Compare>::operator[](const Key& key) const
+{
+    const Node* curr = internalFind(key);
+    if (curr == nullptr) throw std::out_of_range("Invalid key");
+    return curr->item_.second;
+}
+
+template<typename Key, typename Value, typename Compare>
+size_t PersistentAVLTree<Key, Value, Compare>::size() const
+{
+    return size_;
+}
+
+template<typename Key, typename Value, typename Compare>
+bool PersistentAVLTree<Key, Value, Compare>::empty() const
+{
+    return size_ == 0;
+}
+
+template<typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::Node*
+PersistentAVLTree<Key, Value, Compare>::share(Node* node)
+{
+    if (node) {
+        node->refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return node;
+}
+
+/**
+* Drops one reference, freeing the nodes it was the last one to, with an
+* explicit stack so a long release cannot overflow the call stack.
+*/
+template<typename Key, typename Value, typename Compare>
+void PersistentAVLTree<Key, Value, Compare>::release(Node* node)
+{
+    std::vector<Node*> stack;
+    while (true) {
+        if (node && node->refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            if (node->left_) {
+                stack.push_back(node->left_);
+            }
+            if (node->right_) {
+                stack.push_back(node->right_);
+            }
+            delete node;
+        }
+        if (stack.empty()) {
+            return;
+        }
+        node = stack.back();
+        stack.pop_back();
+    }
+}
+
+/**
+* Makes slot's node safe to change and returns it. slot belongs to a node
+* (or handle) that only this version can reach, so if slot holds the only
+* reference, nobody else can see the node either; otherwise slot is
+* pointed at a private copy sharing the original's children.
+*/
+template<typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::Node*
+PersistentAVLTree<Key, Value, Compare>::own(Node*& slot)
+{
+    // Acquire pairs with the release of whoever dropped the other reference
+    if (slot->refs_.load(std::memory_order_acquire) != 1) {
+        // Share the children only once copying the item can no longer throw
+        Node* copy = new Node(slot->item_, nullptr, nullptr, slot->height_);
+        copy->left_ = share(slot->left_);
+        copy->right_ = share(slot->right_);
+        release(slot);
+        slot = copy;
+    }
+    return slot;
+}
+
+template<typename Key, typename Value, typename Compare>
+int PersistentAVLTree<Key, Value, Compare>::height(const Node* node)
+{
+    return node ? node->height_ : 0;
+}
+
+template<typename Key, typename Value, typename Compare>
+void PersistentAVLTree<Key, Value, Compare>::updateHeight(Node* node)
+{
+    int left = height(node->left_);
+    int right = height(node->right_);
+    node->height_ = 1 + (left > right ? left : right);
+}
+
+/**
+* Rotations take a node this version owns, own the child that moves up,
+* and only move references around, so no counts change.
+*/
+template<typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::Node*
+PersistentAVLTree<Key, Value, Compare>::rotateRight(Node* node)
+{
+    Node* left = own(node->left_);
+    node->left_ = left->right_;
+    left->right_ = node;
+    updateHeight(node);
+    updateHeight(left);
+    return left;
+}
+
+template<typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::Node*
+PersistentAVLTree<Key, Value, Compare>::rotateLeft(Node* node)
+{
+    Node* right = own(node->right_);
+    node->right_ = right->left_;
+    right->left_ = node;
+    updateHeight(node);
+    updateHeight(right);
+    return right;
+}
+
+/**
+* Restores the AVL balance at an owned node whose subtrees differ in
+* height by at most two, returning the subtree's new root.
+*/
+template<typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::Node*
+PersistentAVLTree<Key, Value, Compare>::rebalance(Node* node)
+{
+    int balance = height(node->left_) - height(node->right_);
+    if (balance > 1) {
+        if (height(node->left_->left_) < height(node->left_->right_)) {
+            node->left_ = rotateLeft(own(node->left_));
+        }
+        return rotateRight(node);
+    }
+    if (balance < -1) {
+        if (height(node->right_->right_) < height(node->right_->left_)) {
+            node->right_ = rotateRight(own(node->right_));
+        }
+        return rotateLeft(node);
+    }
+    updateHeight(node);
+    return node;
+}
+
+/**
+* Inserts below slot, which this version owns. Returns whether a new
+* node was added.
+*/
+template<typename Key, typename Value, typename Compare>
+bool PersistentAVLTree<Key, Value, Compare>::insertHelp(
+    Node*& slot, const std::pair<const Key, Value>& keyValuePair)
+{
+    if (!slot) {
+        slot = new Node(keyValuePair, nullptr, nullptr, 1);
+        return true;
+    }
+
+    Node* node = own(slot);
+    bool added;
+    if (comp_(keyValuePair.first, node->item_.first)) {
+        added = insertHelp(node->left_, keyValuePair);
+    }
+    else if (comp_(node->item_.first, keyValuePair.first)) {
+        added = insertHelp(node->right_, keyValuePair);
+    }
+    else {
+        node->item_.second = keyValuePair.second;
+        return false;
+    }
+    slot = rebalance(node);
+    return added;
+}
+
+/**
+* Removes key, which is known to be present, from below slot. A node with
+* two children is replaced by its successor node, detached from the right
+* subtree, rather than by a copy of the successor's item.
+*/
+template<typename Key, typename Value, typename Compare>
+void PersistentAVLTree<Key, Value, Compare>::removeHelp(Node*& slot, const Key& key)
+{
+    Node* node = own(slot);
+    if (comp_(key, node->item_.first)) {
+        removeHelp(node->left_, key);
+    }
+    else if (comp_(node->item_.first, key)) {
+        removeHelp(node->right_, key);
+    }
+    else {
+        if (!node->left_ || !node->right_) {
+            slot = node->left_ ? node->left_ : node->right_;
+            node->left_ = node->right_ = nullptr;
+            release(node);
+            return;
+        }
+        Node* replacement = removeMin(node->right_);
+        replacement->left_ = node->left_;
+        replacement->right_ = node->right_;
+        node->left_ = node->right_ = nullptr;
+        release(node);
+        node = replacement;
+    }
+    slot = rebalance(node);
+}
+
+/**
+* Detaches the smallest node below slot and returns it, owned and with
+* no children; the caller takes over its reference.
+*/
+template<typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::Node*
+PersistentAVLTree<Key, Value, Compare>::removeMin(Node*& slot)
+{
+    Node* node = own(slot);
+    if (!node->left_) {
+        slot = node->right_;
+        node->right_ = nullptr;
+        return node;
+    }
+    Node* min = removeMin(node->left_);
+    slot = rebalance(node);
+    return min;
+}
+
+template<typename Key, typename Value, typename Compare>
+const typename PersistentAVLTree<Key, Value, Compare>::Node*
+PersistentAVLTree<Key, Value, Compare>::internalFind(const Key& key) const
+{
+    const Node* curr = root_;
+    while (curr) {
+        if (comp_(key, curr->item_.first)) {
+            curr = curr->left_;
+        }
+        else if (comp_(curr->item_.first, key)) {
+            curr = curr->right_;
+        }
+        else {
+            return curr;
+        }
+    }
+    return nullptr;
+}
+
+/*
+  ---------------------------------------------------------
+  End implementations for the PersistentAVLTree class.
+  ---------------------------------------------------------
+*/
+
+/*
+  -----------------------------------------------------------------------
+  Begin implementations for the PersistentAVLTree::const_iterator class.
+  -----------------------------------------------------------------------
+*/
+
+template<typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>::const_iterator::const_iterator()
+{
+
+}
+
+template<typename Key, typename Value, typename Compare>
+const std::pair<const Key, Value>&
+PersistentAVLTree<Key, Value, Compare>::const_iterator::operator*() const
+{
+    return path_.back()->item_;
+}
+
+template<typename Key, typename Value, typename Compare>
+const std::pair<const Key, Value>*
+PersistentAVLTree<Key, Value, Compare>::const_iterator::operator->() const
+{
+    return &(path_.back()->item_);
+}
+
+/**
+* Iterators at the same node have the same path, so only the tops need
+* comparing.
+*/
+template<typename Key, typename Value, typename Compare>
+bool PersistentAVLTree<Key, Value, Compare>::const_iterator::operator==(const const_iterator& rhs) const
+{
+    if (path_.empty() || rhs.path_.empty()) {
+        return path_.empty() == rhs.path_.empty();
+    }
+    return path_.back() == rhs.path_.back();
+}
+
+template<typename Key, typename Value, typename Compare>
+bool PersistentAVLTree<Key, Value, Compare>::const_iterator::operator!=(const const_iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* Amortized O(1): the right subtree's leftmost path replaces the current
+* node, or, with no right subtree, the next ancestor comes up.
+*/
+template<typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::const_iterator&
+PersistentAVLTree<Key, Value, Compare>::const_iterator::operator++()
+{
+    const PersistentAVLNode<Key, Value>* curr = path_.back();
+    path_.pop_back();
+    pushLeftSpine(curr->right_);
+    return *this;
+}
+
+template<typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::const_iterator
+PersistentAVLTree<Key, Value, Compare>::const_iterator::operator++(int)
+{
+    const_iterator old(*this);
+    ++(*this);
+    return old;
+}
+
+template<typename Key, typename Value, typename Compare>
+void PersistentAVLTree<Key, Value, Compare>::const_iterator::pushLeftSpine(
+    const PersistentAVLNode<Key, Value>* node)
+{
+    while (node) {
+        path_.push_back(node);
+        node = node->left_;
+    }
+}
+
+/*
+  ---------------------------------------------------------------------
+  End implementations for the PersistentAVLTree::const_iterator class.
+  ---------------------------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,496 @@
+#ifndef RBBST_H
+#define RBBST_H
+
+#include <cstddef>
+#include <type_traits>
+#include "avlbst.h"
+
+/**
+* A node for a red-black tree, which adds the color as a data member. A
+* missing child counts as black.
+*/
+template <typename Key, typename Value>
+class RBNode : public Node<Key, Value>
+{
+public:
+    RBNode(const Key& key, const Value& value, RBNode<Key, Value>* parent);
+    RBNode(const ItemBuilder<Key, Value>& builder, RBNode<Key, Value>* parent);
+
+    bool isRed() const;
+    void setRed(bool red);
+    static bool redNode(const RBNode<Key, Value>* node);
+
+    // Hide the Node getters so they return RBNodes, as AVLNode does.
+    RBNode<Key, Value>* getParent() const;
+    RBNode<Key, Value>* getLeft() const;
+    RBNode<Key, Value>* getRight() const;
+
+    // Augmentation hooks, called by RBTree through its NodeType at the same
+    // points AVLTree calls them (see AVLNode). Here they do nothing.
+    void pullUp();
+    void swapAugmentation(RBNode<Key, Value>* other);
+    static void adjustAncestors(RBNode<Key, Value>* from, int delta);
+
+protected:
+    bool red_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the RBNode class.
+  -------------------------------------------------
+*/
+
+/**
+* A new node is red, so linking it never changes a black height.
+*/
+template<class Key, class Value>
+RBNode<Key, Value>::RBNode(const Key& key, const Value& value, RBNode<Key, Value>* parent) :
+    Node<Key, Value>(key, value, parent), red_(true)
+{
+
+}
+
+template<class Key, class Value>
+RBNode<Key, Value>::RBNode(const ItemBuilder<Key, Value>& builder, RBNode<Key, Value>* parent) :
+    Node<Key, Value>(builder, parent), red_(true)
+{
+
+}
+
+template<class Key, class Value>
+bool RBNode<Key, Value>::isRed() const
+{
+    return red_;
+}
+
+template<class Key, class Value>
+void RBNode<Key, Value>::setRed(bool red)
+{
+    red_ = red;
+}
+
+/**
+* The color of a possibly NULL child: NULL is black.
+*/
+template<class Key, class Value>
+bool RBNode<Key, Value>::redNode(const RBNode<Key, Value>* node)
+{
+    return node && node->red_;
+}
+
+template<class Key, class Value>
+RBNode<Key, Value>* RBNode<Key, Value>::getParent() const
+{
+    return static_cast<RBNode<Key, Value>*>(this->parent_);
+}
+
+template<class Key, class Value>
+RBNode<Key, Value>* RBNode<Key, Value>::getLeft() const
+{
+    return static_cast<RBNode<Key, Value>*>(this->left_);
+}
+
+template<class Key, class Value>
+RBNode<Key, Value>* RBNode<Key, Value>::getRight() const
+{
+    return static_cast<RBNode<Key, Value>*>(this->right_);
+}
+
+template<class Key, class Value>
+void RBNode<Key, Value>::pullUp()
+{
+
+}
+
+template<class Key, class Value>
+void RBNode<Key, Value>::swapAugmentation(RBNode<Key, Value>*)
+{
+
+}
+
+template<class Key, class Value>
+void RBNode<Key, Value>::adjustAncestors(RBNode<Key, Value>*, int)
+{
+
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the RBNode class.
+  -----------------------------------------------
+*/
+
+/**
+* A red-black tree with the same interface as AVLTree's single-item
+* operations. Its balance is looser (height up to 2 log n against AVL's
+* 1.44 log n), which buys cheaper updates: an insert does at most two
+* rotations and a remove at most three, against AVL's O(log n) rotations
+* per remove, and the recoloring done on the way up is O(1) amortized.
+*/
+template <class Key, class Value,
+          class Compare = std::less<Key>,
+          class Alloc = std::allocator<std::pair<const Key, Value> >,
+          class NodeType = RBNode<Key, Value> >
+class RBTree : public BinarySearchTree<Key, Value, Compare, Alloc>
+{
+public:
+    explicit RBTree(const Compare& comp = Compare(), const Alloc& alloc = Alloc());
+    virtual ~RBTree();
+    virtual void remove(const Key& key);
+    bool validate() const;
+
+protected:
+    virtual void nodeSwap(NodeType* n1, NodeType* n2);
+    typedef typename std::allocator_traits<Alloc>::template rebind_alloc<NodeType> RBNodeAllocator;
+    virtual Node<Key, Value>* createNode(const ItemBuilder<Key, Value>& builder, Node<Key, Value>* parent);
+    virtual void linkNode(Node<Key, Value>* parent, bool isLeft, Node<Key, Value>* node);
+    virtual void destroyNode(Node<Key, Value>* node);
+    virtual void releaseNodes();
+
+    void insertFixup(NodeType* node);
+    void removeNode(NodeType* node);
+    void removeFixup(NodeType* node, NodeType* parent);
+    void rotateRight(NodeType* node);
+    void rotateLeft(NodeType* node);
+
+    RBNodeAllocator rbAlloc_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the RBTree class.
+  -------------------------------------------------
+*/
+
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+RBTree<Key, Value, Compare, Alloc, NodeType>::RBTree(const Compare& comp, const Alloc& alloc) :
+    BinarySearchTree<Key, Value, Compare, Alloc>(comp, alloc),
+    rbAlloc_(alloc)
+{
+
+}
+
+/*
+ * Clears here rather than in ~BinarySearchTree so the nodes are freed
+ * as RBNodes through this tree's allocator.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+RBTree<Key, Value, Compare, Alloc, NodeType>::~RBTree()
+{
+    this->clear();
+}
+
+/*
+ * Checks every red-black invariant: keys strictly increase in order, each
+ * child points back at its parent (and the root has none), the cached
+ * extremes are the actual ones, the root is black, no red node has a red
+ * child, and every path from the root down to a missing child passes the
+ * same number of black nodes. The last is checked by walking up from each
+ * node missing a child, so this is O(n log n). Returns false at the first
+ * violation.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+bool RBTree<Key, Value, Compare, Alloc, NodeType>::validate() const
+{
+    const NodeType* root = static_cast<const NodeType*>(this->root_);
+    if ((root && (root->getParent() || root->isRed())) || !this->extremesValid()) {
+        return false;
+    }
+
+    const Node<Key, Value>* prev = nullptr;
+    int blackHeight = -1;
+    return this->walkHeights(
+        [this, &prev, &blackHeight](const Node<Key, Value>* node) {
+            bool ordered = !prev || this->comp_(prev->getKey(), node->getKey());
+            prev = node;
+            if (node->getLeft() && node->getRight()) {
+                return ordered;
+            }
+            int blacks = 0;
+            for (const NodeType* up = static_cast<const NodeType*>(node); up; up = up->getParent()) {
+                blacks += up->isRed() ? 0 : 1;
+            }
+            if (blackHeight < 0) {
+                blackHeight = blacks;
+            }
+            return ordered && blacks == blackHeight;
+        },
+        [](const Node<Key, Value>* node, int, int) {
+            const NodeType* rbNode = static_cast<const NodeType*>(node);
+            if ((node->getLeft() && node->getLeft()->getParent() != node) ||
+                (node->getRight() && node->getRight()->getParent() != node)) {
+                return false;
+            }
+            return !rbNode->isRed() ||
+                   (!NodeType::redNode(rbNode->getLeft()) && !NodeType::redNode(rbNode->getRight()));
+        });
+}
+
+/*
+ * Links a new red leaf, then repairs a red parent on the way up. insert,
+ * emplace and try_emplace all come through here (see
+ * BinarySearchTree::insertItem).
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void RBTree<Key, Value, Compare, Alloc, NodeType>::linkNode(
+    Node<Key, Value>* slot, bool isLeft, Node<Key, Value>* node) {
+
+    this->noteLinked(slot, isLeft, node);
+    NodeType* parent = static_cast<NodeType*>(slot);
+    NodeType* child = static_cast<NodeType*>(node);
+    child->setParent(parent);
+
+    // If root empty, new node is the root, which is always black
+    if (!parent) {
+        child->setRed(false);
+        this->root_ = child;
+        return;
+    }
+
+    if (isLeft) {
+        parent->setLeft(child);
+    }
+    else {
+        parent->setRight(child);
+    }
+    NodeType::adjustAncestors(parent, 1);
+
+    if (parent->isRed()) {
+        insertFixup(child);
+    }
+}
+
+/*
+ * Repairs node, red, having a red parent. A red uncle only recolors and
+ * moves the problem two levels up; a black uncle ends it with one or two
+ * rotations.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void RBTree<Key, Value, Compare, Alloc, NodeType>::insertFixup(NodeType* node) {
+    NodeType* parent = node->getParent();
+    while (parent && parent->isRed()) {
+        // A red parent is never the root, so the grandparent exists
+        NodeType* grandparent = parent->getParent();
+        if (parent == grandparent->getLeft()) {
+            NodeType* uncle = grandparent->getRight();
+            if (NodeType::redNode(uncle)) {
+                parent->setRed(false);
+                uncle->setRed(false);
+                grandparent->setRed(true);
+                node = grandparent;
+                parent = node->getParent();
+                continue;
+            }
+            if (node == parent->getRight()) {
+                rotateLeft(parent);
+                parent = node;
+            }
+            parent->setRed(false);
+            grandparent->setRed(true);
+            rotateRight(grandparent);
+        }
+        else {
+            NodeType* uncle = grandparent->getLeft();
+            if (NodeType::redNode(uncle)) {
+                parent->setRed(false);
+                uncle->setRed(false);
+                grandparent->setRed(true);
+                node = grandparent;
+                parent = node->getParent();
+                continue;
+            }
+            if (node == parent->getLeft()) {
+                rotateRight(parent);
+                parent = node;
+            }
+            parent->setRed(false);
+            grandparent->setRed(true);
+            rotateLeft(grandparent);
+        }
+        break;
+    }
+    static_cast<NodeType*>(this->root_)->setRed(false);
+}
+
+/*
+ * As in AVLTree, a node with two children is first swapped with its
+ * predecessor.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void RBTree<Key, Value, Compare, Alloc, NodeType>::remove(const Key& key) {
+    if (!this->root_){
+        return;
+    }
+
+    NodeType* node = static_cast<NodeType*>(BinarySearchTree<Key, Value, Compare, Alloc>::internalFind(key));
+    if (node) {
+        removeNode(node);
+    }
+}
+
+/*
+ * Unlinks and frees node. Removing a red node, or a black one with a
+ * (necessarily red) child that can take its color, leaves every black
+ * height intact; only a black leaf needs removeFixup.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void RBTree<Key, Value, Compare, Alloc, NodeType>::removeNode(NodeType* node) {
+    this->noteUnlinking(node);
+    if (node->getLeft() && node->getRight()) {
+        nodeSwap(static_cast<NodeType*>(BinarySearchTree<Key, Value, Compare, Alloc>::predecessor(node)), node);
+    }
+
+    NodeType* parent = node->getParent();
+    NodeType* child = node->getLeft() ? node->getLeft() : node->getRight();
+    bool blackLeaf = !node->isRed() && !child;
+
+    if (child) {
+        child->setParent(parent);
+        child->setRed(false);
+    }
+    if (!parent) {
+        this->root_ = child;
+    }
+    else if (parent->getLeft() == node) {
+        parent->setLeft(child);
+    }
+    else {
+        parent->setRight(child);
+    }
+    destroyNode(node);
+    NodeType::adjustAncestors(parent, -1);
+
+    if (blackLeaf && parent) {
+        removeFixup(nullptr, parent);
+    }
+}
+
+/*
+ * Restores the black height of the subtree at node (possibly NULL), below
+ * parent, which is one black short. A red sibling is rotated over first;
+ * a black sibling with black children is recolored and the shortage moves
+ * up; otherwise one or two rotations end it.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void RBTree<Key, Value, Compare, Alloc, NodeType>::removeFixup(NodeType* node, NodeType* parent) {
+    while (parent && !NodeType::redNode(node)) {
+        if (node == parent->getLeft()) {
+            NodeType* sibling = parent->getRight();
+            if (sibling->isRed()) {
+                sibling->setRed(false);
+                parent->setRed(true);
+                rotateLeft(parent);
+                sibling = parent->getRight();
+            }
+            if (!NodeType::redNode(sibling->getLeft()) && !NodeType::redNode(sibling->getRight())) {
+                sibling->setRed(true);
+                node = parent;
+                parent = node->getParent();
+                continue;
+            }
+            if (!NodeType::redNode(sibling->getRight())) {
+                sibling->getLeft()->setRed(false);
+                sibling->setRed(true);
+                rotateRight(sibling);
+                sibling = parent->getRight();
+            }
+            sibling->setRed(parent->isRed());
+            parent->setRed(false);
+            sibling->getRight()->setRed(false);
+            rotateLeft(parent);
+        }
+        else {
+            NodeType* sibling = parent->getLeft();
+            if (sibling->isRed()) {
+                sibling->setRed(false);
+                parent->setRed(true);
+                rotateRight(parent);
+                sibling = parent->getLeft();
+            }
+            if (!NodeType::redNode(sibling->getLeft()) && !NodeType::redNode(sibling->getRight())) {
+                sibling->setRed(true);
+                node = parent;
+                parent = node->getParent();
+                continue;
+            }
+            if (!NodeType::redNode(sibling->getLeft())) {
+                sibling->getRight()->setRed(false);
+                sibling->setRed(true);
+                rotateLeft(sibling);
+                sibling = parent->getLeft();
+            }
+            sibling->setRed(parent->isRed());
+            parent->setRed(false);
+            sibling->getLeft()->setRed(false);
+            rotateRight(parent);
+        }
+        return;
+    }
+    if (node) {
+        node->setRed(false);
+    }
+}
+
+/*
+ * Swaps positions, and with them the colors, which belong to the position.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void RBTree<Key, Value, Compare, Alloc, NodeType>::nodeSwap(NodeType* n1, NodeType* n2) {
+    BinarySearchTree<Key, Value, Compare, Alloc>::nodeSwap(n1, n2);
+    bool tempRed = n1->isRed();
+    n1->setRed(n2->isRed());
+    n2->setRed(tempRed);
+    n1->swapAugmentation(n2);
+}
+
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+Node<Key, Value>* RBTree<Key, Value, Compare, Alloc, NodeType>::createNode(
+    const ItemBuilder<Key, Value>& builder, Node<Key, Value>* parent)
+{
+    return allocateNode<NodeType>(rbAlloc_, builder, static_cast<NodeType*>(parent));
+}
+
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void RBTree<Key, Value, Compare, Alloc, NodeType>::destroyNode(Node<Key, Value>* node)
+{
+    deallocateNode(rbAlloc_, static_cast<NodeType*>(node));
+}
+
+/*
+ * Same as BinarySearchTree::releaseNodes, but against the RBNode allocator.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void RBTree<Key, Value, Compare, Alloc, NodeType>::releaseNodes()
+{
+    typedef AllocatorRelease<RBNodeAllocator> Release;
+    bool exclusive = Release::exclusive(rbAlloc_);
+    if(!exclusive || !std::is_trivially_destructible<std::pair<const Key, Value> >::value) {
+        this->clearHelp(this->root_);
+    }
+    if(exclusive) {
+        Release::release(rbAlloc_);
+    }
+}
+
+/*
+ * The rotations are AVLTree's (see avlRotateRight in avlbst.h); they only
+ * relink and call pullUp, so colors are left to the caller.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void RBTree<Key, Value, Compare, Alloc, NodeType>::rotateRight(NodeType* node) {
+    avlRotateRight(this->root_, node);
+}
+
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void RBTree<Key, Value, Compare, Alloc, NodeType>::rotateLeft(NodeType* node) {
+    avlRotateLeft(this->root_, node);
+}
+
+/*
+  -------------------------------------------------
+  End implementations for the RBTree class.
+  -------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,291 @@
+#ifndef SLAB_ALLOC_H
+#define SLAB_ALLOC_H
+
+#include <cstddef>
+#include <new>
+#include <memory>
+#include <typeindex>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+#include <type_traits>
+
+/**
+* The pools of one family of SlabAllocators: an allocator and everything
+* copied or rebound from it. Holds one pool per slot type, weakly, so a
+* pool lives exactly as long as some allocator uses it.
+*/
+class SlabPools
+{
+public:
+    template <typename Pool>
+    std::shared_ptr<Pool> get();
+
+private:
+    std::vector<std::pair<std::type_index, std::weak_ptr<void> > > pools_;
+};
+
+/**
+* The family's pool of type Pool, created on first use.
+*/
+template <typename Pool>
+std::shared_ptr<Pool> SlabPools::get()
+{
+    for(std::size_t i = 0; i < pools_.size(); ++i) {
+        if(pools_[i].first == std::type_index(typeid(Pool))) {
+            std::shared_ptr<void> live = pools_[i].second.lock();
+            if(!live) {
+                live = std::make_shared<Pool>();
+                pools_[i].second = live;
+            }
+            return std::static_pointer_cast<Pool>(live);
+        }
+    }
+    std::shared_ptr<Pool> pool = std::make_shared<Pool>();
+    pools_.push_back(std::make_pair(std::type_index(typeid(Pool)), std::weak_ptr<void>(pool)));
+    return pool;
+}
+
+/**
+* A node allocator for the search trees that carves fixed-size slots out of
+* large chunks instead of asking the general-purpose heap for every node.
+* Freed slots are threaded onto an intrusive free list and handed out again
+* before a new slot is carved, and release() hands every chunk back at once,
+* which is what lets a tree's clear() skip the per-node deallocation walk.
+*
+* Copies share the same chunks (so a copy can free what the original
+* allocated). Rebinding to another type switches to the pool for that type
+* within the same family: every allocator copied or rebound from one
+* SlabAllocator shares one pool per type. A tree rebinds the allocator it
+* is given to its node type, so trees built from the same SlabAllocator
+* share a node pool, compare equal, and can move nodes between each other
+* (AVLTree::split and join). Trees given separate SlabAllocators get
+* separate pools. A pool is only released in bulk while a single
+* allocator uses it (see AllocatorRelease).
+*/
+template <typename T, std::size_t NodesPerChunk = 1024>
+class SlabAllocator
+{
+public:
+    typedef T value_type;
+    typedef std::false_type propagate_on_container_copy_assignment;
+    typedef std::false_type propagate_on_container_move_assignment;
+    typedef std::false_type propagate_on_container_swap;
+
+    template <typename U>
+    struct rebind
+    {
+        typedef SlabAllocator<U, NodesPerChunk> other;
+    };
+
+    SlabAllocator();
+    template <typename U>
+    SlabAllocator(const SlabAllocator<U, NodesPerChunk>& other);
+
+    T* allocate(std::size_t n);
+    void deallocate(T* p, std::size_t n);
+    void release();
+    bool exclusive() const;
+    std::size_t chunkCount() const;
+
+    bool operator==(const SlabAllocator& rhs) const;
+    bool operator!=(const SlabAllocator& rhs) const;
+
+private:
+    // A slot either holds a live T or, once freed, the link to the next free slot
+    union Slot
+    {
+        Slot* next_;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage_;
+    };
+
+    struct Pool
+    {
+        Pool();
+        ~Pool();
+        void release();
+
+        std::vector<Slot*> chunks_;
+        Slot* freeList_;
+        std::size_t carved_;    // slots handed out from the newest chunk
+    };
+
+    template <typename U, std::size_t N>
+    friend class SlabAllocator;
+
+    std::shared_ptr<SlabPools> family_;
+    std::shared_ptr<Pool> pool_;
+};
+
+/**
+* Allocator hook for trees: exclusive(alloc) is true when release(alloc)
+* frees every block alloc handed out, in one call and without visiting
+* them, and nothing anyone else still uses.
+*/
+template <typename Alloc>
+struct AllocatorRelease
+{
+    static bool exclusive(const Alloc&) { return false; }
+    static void release(Alloc&) { }
+};
+
+template <typename T, std::size_t NodesPerChunk>
+struct AllocatorRelease<SlabAllocator<T, NodesPerChunk> >
+{
+    static bool exclusive(const SlabAllocator<T, NodesPerChunk>& alloc) { return alloc.exclusive(); }
+    static void release(SlabAllocator<T, NodesPerChunk>& alloc) { alloc.release(); }
+};
+
+/*
+  --------------------------------------------------
+  Begin implementations for the SlabAllocator class.
+  --------------------------------------------------
+*/
+
+template <typename T, std::size_t NodesPerChunk>
+SlabAllocator<T, NodesPerChunk>::Pool::Pool() :
+    freeList_(nullptr),
+    carved_(NodesPerChunk)
+{
+
+}
+
+template <typename T, std::size_t NodesPerChunk>
+SlabAllocator<T, NodesPerChunk>::Pool::~Pool()
+{
+    release();
+}
+
+/**
+* Frees every chunk; any T still living in them must already be destroyed.
+*/
+template <typename T, std::size_t NodesPerChunk>
+void SlabAllocator<T, NodesPerChunk>::Pool::release()
+{
+    for(std::size_t i = 0; i < chunks_.size(); ++i) {
+        ::operator delete(chunks_[i], std::align_val_t(alignof(Slot)));
+    }
+    chunks_.clear();
+    freeList_ = nullptr;
+    carved_ = NodesPerChunk;
+}
+
+/**
+* Starts a new family with an empty pool.
+*/
+template <typename T, std::size_t NodesPerChunk>
+SlabAllocator<T, NodesPerChunk>::SlabAllocator() :
+    family_(std::make_shared<SlabPools>()),
+    pool_(family_->template get<Pool>())
+{
+
+}
+
+/**
+* Rebinding constructor. Joins other's family and uses its pool for T,
+* which is the same pool every other allocator rebound to T from this
+* family uses.
+*/
+template <typename T, std::size_t NodesPerChunk>
+template <typename U>
+SlabAllocator<T, NodesPerChunk>::SlabAllocator(const SlabAllocator<U, NodesPerChunk>& other) :
+    family_(other.family_),
+    pool_(family_->template get<Pool>())
+{
+
+}
+
+/**
+* Pops a freed slot if there is one, otherwise carves the next slot from the
+* newest chunk. Array requests never come from the trees and go to the heap.
+* Both honor alignof(T), which for BTreeMap's cache-line nodes is beyond
+* what plain operator new guarantees.
+*/
+template <typename T, std::size_t NodesPerChunk>
+T* SlabAllocator<T, NodesPerChunk>::allocate(std::size_t n)
+{
+    if(n != 1) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+    }
+
+    Pool& pool = *pool_;
+    if(pool.freeList_) {
+        Slot* slot = pool.freeList_;
+        pool.freeList_ = slot->next_;
+        return reinterpret_cast<T*>(slot);
+    }
+    if(pool.carved_ == NodesPerChunk) {
+        Slot* chunk = static_cast<Slot*>(::operator new(NodesPerChunk * sizeof(Slot),
+                                                        std::align_val_t(alignof(Slot))));
+        try {
+            pool.chunks_.push_back(chunk);
+        }
+        catch(...) {
+            ::operator delete(chunk, std::align_val_t(alignof(Slot)));
+            throw;
+        }
+        pool.carved_ = 0;
+    }
+    return reinterpret_cast<T*>(&pool.chunks_.back()[pool.carved_++]);
+}
+
+/**
+* Returns a slot to the free list; memory only goes back to the heap in release().
+*/
+template <typename T, std::size_t NodesPerChunk>
+void SlabAllocator<T, NodesPerChunk>::deallocate(T* p, std::size_t n)
+{
+    if(n != 1) {
+        ::operator delete(p, std::align_val_t(alignof(T)));
+        return;
+    }
+
+    Slot* slot = reinterpret_cast<Slot*>(p);
+    slot->next_ = pool_->freeList_;
+    pool_->freeList_ = slot;
+}
+
+/**
+* Frees all chunks in O(chunks). Every pointer handed out becomes invalid.
+*/
+template <typename T, std::size_t NodesPerChunk>
+void SlabAllocator<T, NodesPerChunk>::release()
+{
+    pool_->release();
+}
+
+/**
+* Whether this is the only allocator using its pool, so release() frees
+* nothing another allocator handed out.
+*/
+template <typename T, std::size_t NodesPerChunk>
+bool SlabAllocator<T, NodesPerChunk>::exclusive() const
+{
+    return pool_.use_count() == 1;
+}
+
+template <typename T, std::size_t NodesPerChunk>
+std::size_t SlabAllocator<T, NodesPerChunk>::chunkCount() const
+{
+    return pool_->chunks_.size();
+}
+
+template <typename T, std::size_t NodesPerChunk>
+bool SlabAllocator<T, NodesPerChunk>::operator==(const SlabAllocator& rhs) const
+{
+    return pool_ == rhs.pool_;
+}
+
+template <typename T, std::size_t NodesPerChunk>
+bool SlabAllocator<T, NodesPerChunk>::operator!=(const SlabAllocator& rhs) const
+{
+    return pool_ != rhs.pool_;
+}
+
+/*
+  ------------------------------------------------
+  End implementations for the SlabAllocator class.
+  ------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,536 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#define WAL_FSYNC 1
+#endif
+#include "avlbst.h"
+
+/**
+* When a WriteAheadLog forces committed groups to stable storage. Never
+* leaves it to the OS, so a commit survives the process dying but not the
+* machine; EveryCommit syncs each group before commit() returns; Interval
+* syncs at a commit once syncInterval has passed since the last sync, and
+* when the log is closed. That bounds what a power loss can take only while
+* commits keep coming: groups committed just before a lull stay unsynced
+* until the next commit or the close.
+*/
+enum class LogSync { Never, EveryCommit, Interval };
+
+struct LogOptions
+{
+    LogOptions() :
+        groupRecords(512),
+        sync(LogSync::EveryCommit),
+        syncInterval(100)
+    {
+
+    }
+
+    size_t groupRecords;  // records buffered before a group is committed
+    LogSync sync;
+    std::chrono::milliseconds syncInterval;
+};
+
+/**
+* The header at the start of a log file. As with FrozenImageHeader, the
+* sizes and byte order marker let a log written for other types or on
+* another architecture be rejected.
+*/
+struct LogFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t keySize;
+    uint32_t valueSize;
+};
+
+/**
+* An append-only log of upserts and removals for trivially copyable keys
+* and values. Records are buffered and written a group at a time (group
+* commit): one write, and per the LogSync policy one fsync, covers up to
+* groupRecords mutations, so a record is durable once the group holding
+* it is committed. Each group is framed with its length, a sequence number
+* and a checksum; opening a log reads back every complete group and stops
+* at the first torn or stale one, which later groups overwrite.
+*/
+template <typename Key, typename Value>
+class WriteAheadLog
+{
+public:
+    explicit WriteAheadLog(const std::string& path, const LogOptions& options = LogOptions());
+    WriteAheadLog(const WriteAheadLog& other) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog& other) = delete;
+    ~WriteAheadLog();
+
+    void log_insert(const std::pair<const Key, Value>& keyValuePair);
+    void log_remove(const Key& key);
+    void commit();
+    void reset();
+    std::vector<BatchOp<Key, Value> > take_recovered();
+    size_t pending() const;
+
+private:
+    static const uint32_t LogVersion = 1;
+    static const uint32_t ByteOrderMark = 0x01020304;
+    static const uint8_t InsertRecord = 0;
+    static const uint8_t RemoveRecord = 1;
+
+    // Precedes each group's records in the file
+    struct Frame
+    {
+        uint32_t bytes;
+        uint32_t checksum;
+        uint64_t sequence;
+    };
+
+    static LogFileHeader fileHeader();
+    static uint32_t checksum(uint64_t sequence, const char* bytes, size_t length);
+    void open();
+    void recover(const std::vector<char>& contents);
+    void writeAt(long offset, const void* bytes, size_t length);
+    void sync();
+
+    std::string path_;
+    LogOptions options_;
+    std::FILE* file_;
+    long end_;                  // where the next group goes
+    uint64_t sequence_;         // of the next group
+    std::vector<char> group_;   // room for the Frame, then the records since the last commit
+    size_t pending_;
+    bool unsynced_;             // groups have been written since the last sync
+    std::chrono::steady_clock::time_point lastSync_;
+    std::vector<BatchOp<Key, Value> > recovered_;
+};
+
+/**
+* An AVLTree made durable by a snapshot image (AVLTree::save) plus a
+* WriteAheadLog of every mutation since. insert() and remove() log the
+* mutation before applying it; checkpoint() saves a new snapshot and
+* empties the log. Constructing one recovers: the snapshot is bulk-built
+* into the tree, then the log's records are sorted by key (stably, so a
+* key's records keep their order) and applied with one
+* apply_sorted_batch() rather than one insert each.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class LoggedAVLTree
+{
+public:
+    LoggedAVLTree(const std::string& snapshotPath, const std::string& logPath,
+                  const LogOptions& options = LogOptions(), const Compare& comp = Compare());
+    LoggedAVLTree(const LoggedAVLTree& other) = delete;
+    LoggedAVLTree& operator=(const LoggedAVLTree& other) = delete;
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void commit();
+    void checkpoint();
+    const AVLTree<Key, Value, Compare>& tree() const;
+    size_t recovered() const;
+
+private:
+    std::string snapshotPath_;
+    AVLTree<Key, Value, Compare> tree_;
+    WriteAheadLog<Key, Value> log_;
+    size_t recovered_;
+};
+
+/*
+  ---------------------------------------------------
+  Begin implementations for the WriteAheadLog class.
+  ---------------------------------------------------
+*/
+
+/**
+* Opens the log at path, creating it if absent, and reads back the records
+* of every complete group for take_recovered(). Throws std::runtime_error
+* if the file cannot be opened or is a log of other types.
+*/
+template<typename Key, typename Value>
+WriteAheadLog<Key, Value>::WriteAheadLog(const std::string& path, const LogOptions& options) :
+    path_(path),
+    options_(options),
+    file_(nullptr),
+    end_(0),
+    sequence_(1),
+    group_(sizeof(Frame)),
+    pending_(0),
+    unsynced_(false),
+    lastSync_(std::chrono::steady_clock::now())
+{
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+                  "WriteAheadLog needs trivially copyable keys and values");
+    open();
+}
+
+/**
+* Commits what is still buffered and, under LogSync::Interval, syncs the
+* groups the interval has not reached yet. Errors are swallowed here; call
+* commit() first to see them.
+*/
+template<typename Key, typename Value>
+WriteAheadLog<Key, Value>::~WriteAheadLog()
+{
+    try {
+        commit();
+        if (options_.sync == LogSync::Interval && unsynced_) {
+            sync();
+        }
+    }
+    catch (...) {
+    }
+    if (file_) {
+        std::fclose(file_);
+    }
+}
+
+template<typename Key, typename Value>
+void WriteAheadLog<Key, Value>::log_insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    group_.push_back(static_cast<char>(InsertRecord));
+    const char* key = reinterpret_cast<const char*>(&keyValuePair.first);
+    const char* value = reinterpret_cast<const char*>(&keyValuePair.second);
+    group_.insert(group_.end(), key, key + sizeof(Key));
+    group_.insert(group_.end(), value, value + sizeof(Value));
+    if (++pending_ >= options_.groupRecords) {
+        commit();
+    }
+}
+
+template<typename Key, typename Value>
+void WriteAheadLog<Key, Value>::log_remove(const Key& key)
+{
+    group_.push_back(static_cast<char>(RemoveRecord));
+    const char* bytes = reinterpret_cast<const char*>(&key);
+    group_.insert(group_.end(), bytes, bytes + sizeof(Key));
+    if (++pending_ >= options_.groupRecords) {
+        commit();
+    }
+}
+
+/**
+* Writes the buffered records as one group and syncs per the policy.
+* Throws std::runtime_error if the write fails, keeping the group buffered.
+*/
+template<typename Key, typename Value>
+void WriteAheadLog<Key, Value>::commit()
+{
+    if (pending_ == 0) {
+        return;
+    }
+    Frame frame;
+    frame.bytes = static_cast<uint32_t>(group_.size() - sizeof(Frame));
+    frame.sequence = sequence_;
+    frame.checksum = checksum(sequence_, group_.data() + sizeof(Frame), frame.bytes);
+    std::memcpy(group_.data(), &frame, sizeof(frame));
+    writeAt(end_, group_.data(), group_.size());
+
+    end_ += static_cast<long>(group_.size());
+    ++sequence_;
+    group_.resize(sizeof(Frame));
+    pending_ = 0;
+    unsynced_ = true;
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (options_.sync == LogSync::EveryCommit ||
+        (options_.sync == LogSync::Interval && now - lastSync_ >= options_.syncInterval)) {
+        sync();
+        lastSync_ = now;
+    }
+}
+
+/**
+* Empties the log, buffered records included, once a snapshot holds
+* everything it recorded.
+*/
+template<typename Key, typename Value>
+void WriteAheadLog<Key, Value>::reset()
+{
+    std::FILE* file = std::fopen(path_.c_str(), "w+b");
+    if (!file) {
+        throw std::runtime_error("WriteAheadLog: cannot reset " + path_);
+    }
+    std::fclose(file_);
+    file_ = file;
+    LogFileHeader header = fileHeader();
+    end_ = 0;
+    writeAt(0, &header, sizeof(header));
+    end_ = sizeof(header);
+    sequence_ = 1;
+    group_.resize(sizeof(Frame));
+    pending_ = 0;
+    sync();
+}
+
+/**
+* Hands over the records read back when the log was opened, in log order.
+*/
+template<typename Key, typename Value>
+std::vector<BatchOp<Key, Value> > WriteAheadLog<Key, Value>::take_recovered()
+{
+    std::vector<BatchOp<Key, Value> > records;
+    records.swap(recovered_);
+    return records;
+}
+
+template<typename Key, typename Value>
+size_t WriteAheadLog<Key, Value>::pending() const
+{
+    return pending_;
+}
+
+template<typename Key, typename Value>
+LogFileHeader WriteAheadLog<Key, Value>::fileHeader()
+{
+    LogFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "AVLWAL\0\0", sizeof(header.magic));
+    header.version = LogVersion;
+    header.byteOrder = ByteOrderMark;
+    header.keySize = sizeof(Key);
+    header.valueSize = sizeof(Value);
+    return header;
+}
+
+/**
+* 32-bit FNV-1a over the sequence number and the group's records.
+*/
+template<typename Key, typename Value>
+uint32_t WriteAheadLog<Key, Value>::checksum(uint64_t sequence, const char* bytes, size_t length)
+{
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < 8; ++i) {
+        hash = (hash ^ static_cast<uint8_t>(sequence >> (8 * i))) * 16777619u;
+    }
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ static_cast<uint8_t>(bytes[i])) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+* Opens or creates the file. A file too short to hold a header is taken
+* to be a log whose creation was cut short, and started afresh; one whose
+* length or contents cannot be read is an error, never overwritten. This
+* runs in the constructor, so the file is closed before anything is thrown.
+*/
+template<typename Key, typename Value>
+void WriteAheadLog<Key, Value>::open()
+{
+    file_ = std::fopen(path_.c_str(), "r+b");
+    bool existed = (file_ != nullptr);
+    if (!existed) {
+        file_ = std::fopen(path_.c_str(), "w+b");
+        if (!file_) {
+            throw std::runtime_error("WriteAheadLog: cannot open " + path_);
+        }
+    }
+
+    try {
+        std::vector<char> contents;
+        if (existed) {
+            long length = -1;
+            if (std::fseek(file_, 0, SEEK_END) == 0) {
+                length = std::ftell(file_);
+            }
+            if (length < 0 || std::fseek(file_, 0, SEEK_SET) != 0) {
+                throw std::runtime_error("WriteAheadLog: cannot read " + path_);
+            }
+            contents.resize(static_cast<size_t>(length));
+            if (!contents.empty() && std::fread(contents.data(), 1, contents.size(), file_) != contents.size()) {
+                throw std::runtime_error("WriteAheadLog: cannot read " + path_);
+            }
+        }
+
+        if (contents.size() < sizeof(LogFileHeader)) {
+            LogFileHeader header = fileHeader();
+            writeAt(0, &header, sizeof(header));
+            end_ = sizeof(header);
+            sync();
+            return;
+        }
+        recover(contents);
+    }
+    catch (...) {
+        std::fclose(file_);
+        file_ = nullptr;
+        throw;
+    }
+}
+
+/**
+* Checks the header, then reads groups in sequence until one is missing,
+* short, out of sequence or fails its checksum; new groups go there.
+*/
+template<typename Key, typename Value>
+void WriteAheadLog<Key, Value>::recover(const std::vector<char>& contents)
+{
+    LogFileHeader header;
+    LogFileHeader expected = fileHeader();
+    std::memcpy(&header, contents.data(), sizeof(header));
+    if (std::memcmp(&header, &expected, sizeof(header)) != 0) {
+        throw std::runtime_error("WriteAheadLog: not a log of this map type: " + path_);
+    }
+
+    size_t offset = sizeof(header);
+    while (offset + sizeof(Frame) <= contents.size()) {
+        Frame frame;
+        std::memcpy(&frame, contents.data() + offset, sizeof(frame));
+        const char* records = contents.data() + offset + sizeof(frame);
+        if (frame.sequence != sequence_ || frame.bytes > contents.size() - offset - sizeof(frame) ||
+            frame.checksum != checksum(frame.sequence, records, frame.bytes)) {
+            break;
+        }
+
+        for (size_t at = 0; at < frame.bytes; ) {
+            BatchOp<Key, Value> op = { std::pair<Key, Value>(), records[at] == RemoveRecord };
+            std::memcpy(&op.item.first, records + at + 1, sizeof(Key));
+            at += 1 + sizeof(Key);
+            if (!op.erase) {
+                std::memcpy(&op.item.second, records + at, sizeof(Value));
+                at += sizeof(Value);
+            }
+            recovered_.push_back(op);
+        }
+        offset += sizeof(frame) + frame.bytes;
+        ++sequence_;
+    }
+    end_ = static_cast<long>(offset);
+}
+
+template<typename Key, typename Value>
+void WriteAheadLog<Key, Value>::writeAt(long offset, const void* bytes, size_t length)
+{
+    if (std::fseek(file_, offset, SEEK_SET) != 0 ||
+        std::fwrite(bytes, 1, length, file_) != length ||
+        std::fflush(file_) != 0) {
+        throw std::runtime_error("WriteAheadLog: cannot write " + path_);
+    }
+}
+
+template<typename Key, typename Value>
+void WriteAheadLog<Key, Value>::sync()
+{
+#if defined(WAL_FSYNC)
+    if (::fsync(fileno(file_)) != 0) {
+        throw std::runtime_error("WriteAheadLog: cannot sync " + path_);
+    }
+#endif
+    unsynced_ = false;
+}
+
+/*
+  -------------------------------------------------
+  End implementations for the WriteAheadLog class.
+  -------------------------------------------------
+*/
+
+/*
+  ---------------------------------------------------
+  Begin implementations for the LoggedAVLTree class.
+  ---------------------------------------------------
+*/
+
+/**
+* Recovers from the snapshot at snapshotPath, if there is one, and the log
+* at logPath, creating the log if absent.
+*/
+template<typename Key, typename Value, typename Compare>
+LoggedAVLTree<Key, Value, Compare>::LoggedAVLTree(
+    const std::string& snapshotPath, const std::string& logPath,
+    const LogOptions& options, const Compare& comp) :
+    snapshotPath_(snapshotPath),
+    tree_(comp),
+    log_(logPath, options),
+    recovered_(0)
+{
+    if (std::ifstream(snapshotPath.c_str()).good()) {
+        FrozenMap<Key, Value, Compare> snapshot = AVLTree<Key, Value, Compare>::load_mapped(snapshotPath, comp);
+        tree_.assign(snapshot.begin(), snapshot.end());
+    }
+
+    std::vector<BatchOp<Key, Value> > ops = log_.take_recovered();
+    std::stable_sort(ops.begin(), ops.end(),
+                     [&comp](const BatchOp<Key, Value>& a, const BatchOp<Key, Value>& b) {
+                         return comp(a.item.first, b.item.first);
+                     });
+    tree_.apply_sorted_batch(ops);
+    recovered_ = ops.size();
+}
+
+template<typename Key, typename Value, typename Compare>
+void LoggedAVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    log_.log_insert(keyValuePair);
+    tree_.insert(keyValuePair);
+}
+
+template<typename Key, typename Value, typename Compare>
+void LoggedAVLTree<Key, Value, Compare>::remove(const Key& key)
+{
+    log_.log_remove(key);
+    tree_.remove(key);
+}
+
+/**
+* Commits the mutations still buffered in the log's current group.
+*/
+template<typename Key, typename Value, typename Compare>
+void LoggedAVLTree<Key, Value, Compare>::commit()
+{
+    log_.commit();
+}
+
+/**
+* Saves the tree as the new snapshot, then empties the log. The snapshot
+* is saved durably (synced, renamed into place, directory synced) before
+* the log is touched, so even after a power loss either the new snapshot
+* is on disk or the old snapshot and the full log are. Should a crash come
+* between the two steps, recovery replays the log onto the new snapshot,
+* which changes nothing: every record sets or removes a key outright.
+*/
+template<typename Key, typename Value, typename Compare>
+void LoggedAVLTree<Key, Value, Compare>::checkpoint()
+{
+    log_.commit();
+    tree_.save(snapshotPath_, true);
+    log_.reset();
+}
+
+template<typename Key, typename Value, typename Compare>
+const AVLTree<Key, Value, Compare>& LoggedAVLTree<Key, Value, Compare>::tree() const
+{
+    return tree_;
+}
+
+/**
+* The number of log records applied when this tree was recovered.
+*/
+template<typename Key, typename Value, typename Compare>
+size_t LoggedAVLTree<Key, Value, Compare>::recovered() const
+{
+    return recovered_;
+}
+
+/*
+  -------------------------------------------------
+  End implementations for the LoggedAVLTree class.
+  -------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,489 @@
+#ifndef WAVLBST_H
+#define WAVLBST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include "avlbst.h"
+
+/**
+* A node for a weak AVL tree, which adds the rank as a data member. A
+* missing child has rank -1.
+*/
+template <typename Key, typename Value>
+class WAVLNode : public Node<Key, Value>
+{
+public:
+    WAVLNode(const Key& key, const Value& value, WAVLNode<Key, Value>* parent);
+    WAVLNode(const ItemBuilder<Key, Value>& builder, WAVLNode<Key, Value>* parent);
+
+    int getRank() const;
+    void setRank(int rank);
+    void updateRank(int diff);
+    static int rankOf(const WAVLNode<Key, Value>* node);
+
+    // Hide the Node getters so they return WAVLNodes, as AVLNode does.
+    WAVLNode<Key, Value>* getParent() const;
+    WAVLNode<Key, Value>* getLeft() const;
+    WAVLNode<Key, Value>* getRight() const;
+
+    // Augmentation hooks, called by WAVLTree through its NodeType at the same
+    // points AVLTree calls them (see AVLNode). Here they do nothing.
+    void pullUp();
+    void swapAugmentation(WAVLNode<Key, Value>* other);
+    static void adjustAncestors(WAVLNode<Key, Value>* from, int delta);
+
+protected:
+    int8_t rank_;   // at most 2 log n, so 127 is never reached
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the WAVLNode class.
+  -------------------------------------------------
+*/
+
+/**
+* A new node is a leaf, and leaves have rank 0.
+*/
+template<class Key, class Value>
+WAVLNode<Key, Value>::WAVLNode(const Key& key, const Value& value, WAVLNode<Key, Value>* parent) :
+    Node<Key, Value>(key, value, parent), rank_(0)
+{
+
+}
+
+template<class Key, class Value>
+WAVLNode<Key, Value>::WAVLNode(const ItemBuilder<Key, Value>& builder, WAVLNode<Key, Value>* parent) :
+    Node<Key, Value>(builder, parent), rank_(0)
+{
+
+}
+
+template<class Key, class Value>
+int WAVLNode<Key, Value>::getRank() const
+{
+    return rank_;
+}
+
+template<class Key, class Value>
+void WAVLNode<Key, Value>::setRank(int rank)
+{
+    rank_ = static_cast<int8_t>(rank);
+}
+
+template<class Key, class Value>
+void WAVLNode<Key, Value>::updateRank(int diff)
+{
+    rank_ += diff;
+}
+
+/**
+* The rank of a possibly NULL child: NULL has rank -1.
+*/
+template<class Key, class Value>
+int WAVLNode<Key, Value>::rankOf(const WAVLNode<Key, Value>* node)
+{
+    return node ? node->rank_ : -1;
+}
+
+template<class Key, class Value>
+WAVLNode<Key, Value>* WAVLNode<Key, Value>::getParent() const
+{
+    return static_cast<WAVLNode<Key, Value>*>(this->parent_);
+}
+
+template<class Key, class Value>
+WAVLNode<Key, Value>* WAVLNode<Key, Value>::getLeft() const
+{
+    return static_cast<WAVLNode<Key, Value>*>(this->left_);
+}
+
+template<class Key, class Value>
+WAVLNode<Key, Value>* WAVLNode<Key, Value>::getRight() const
+{
+    return static_cast<WAVLNode<Key, Value>*>(this->right_);
+}
+
+template<class Key, class Value>
+void WAVLNode<Key, Value>::pullUp()
+{
+
+}
+
+template<class Key, class Value>
+void WAVLNode<Key, Value>::swapAugmentation(WAVLNode<Key, Value>*)
+{
+
+}
+
+template<class Key, class Value>
+void WAVLNode<Key, Value>::adjustAncestors(WAVLNode<Key, Value>*, int)
+{
+
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the WAVLNode class.
+  -----------------------------------------------
+*/
+
+/**
+* A weak AVL (rank-balanced) tree with the same interface as AVLTree's
+* single-item operations. Every node's rank exceeds each child's by 1 or
+* 2 and leaves have rank 0. Built by inserts alone it is exactly an AVL
+* tree; removes may leave it up to 2 log n tall, like a red-black tree, but
+* in exchange an insert or remove does at most two rotations, and the rank
+* changes on the way up are O(1) amortized.
+*/
+template <class Key, class Value,
+          class Compare = std::less<Key>,
+          class Alloc = std::allocator<std::pair<const Key, Value> >,
+          class NodeType = WAVLNode<Key, Value> >
+class WAVLTree : public BinarySearchTree<Key, Value, Compare, Alloc>
+{
+public:
+    explicit WAVLTree(const Compare& comp = Compare(), const Alloc& alloc = Alloc());
+    virtual ~WAVLTree();
+    virtual void remove(const Key& key);
+    bool validate() const;
+
+protected:
+    virtual void nodeSwap(NodeType* n1, NodeType* n2);
+    typedef typename std::allocator_traits<Alloc>::template rebind_alloc<NodeType> WAVLNodeAllocator;
+    virtual Node<Key, Value>* createNode(const ItemBuilder<Key, Value>& builder, Node<Key, Value>* parent);
+    virtual void linkNode(Node<Key, Value>* parent, bool isLeft, Node<Key, Value>* node);
+    virtual void destroyNode(Node<Key, Value>* node);
+    virtual void releaseNodes();
+
+    void insertRebalance(NodeType* node);
+    void removeNode(NodeType* node);
+    void removeRebalance(NodeType* node, NodeType* parent);
+    void rotateRight(NodeType* node);
+    void rotateLeft(NodeType* node);
+
+    WAVLNodeAllocator wavlAlloc_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the WAVLTree class.
+  -------------------------------------------------
+*/
+
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+WAVLTree<Key, Value, Compare, Alloc, NodeType>::WAVLTree(const Compare& comp, const Alloc& alloc) :
+    BinarySearchTree<Key, Value, Compare, Alloc>(comp, alloc),
+    wavlAlloc_(alloc)
+{
+
+}
+
+/*
+ * Clears here rather than in ~BinarySearchTree so the nodes are freed
+ * as WAVLNodes through this tree's allocator.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+WAVLTree<Key, Value, Compare, Alloc, NodeType>::~WAVLTree()
+{
+    this->clear();
+}
+
+/*
+ * Checks every weak AVL invariant in one O(n) pass: keys strictly increase
+ * in order, each child points back at its parent (and the root has none),
+ * the cached extremes are the actual ones, every rank difference is 1 or
+ * 2, and every leaf has rank 0. Returns false at the first violation.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+bool WAVLTree<Key, Value, Compare, Alloc, NodeType>::validate() const
+{
+    if ((this->root_ && this->root_->getParent()) || !this->extremesValid()) {
+        return false;
+    }
+
+    const Node<Key, Value>* prev = nullptr;
+    return this->walkHeights(
+        [this, &prev](const Node<Key, Value>* node) {
+            bool ordered = !prev || this->comp_(prev->getKey(), node->getKey());
+            prev = node;
+            return ordered;
+        },
+        [](const Node<Key, Value>* node, int, int) {
+            const NodeType* wavlNode = static_cast<const NodeType*>(node);
+            if ((node->getLeft() && node->getLeft()->getParent() != node) ||
+                (node->getRight() && node->getRight()->getParent() != node)) {
+                return false;
+            }
+            int left = wavlNode->getRank() - NodeType::rankOf(wavlNode->getLeft());
+            int right = wavlNode->getRank() - NodeType::rankOf(wavlNode->getRight());
+            if (!node->getLeft() && !node->getRight()) {
+                return wavlNode->getRank() == 0;
+            }
+            return left >= 1 && left <= 2 && right >= 1 && right <= 2;
+        });
+}
+
+/*
+ * Links a new leaf of rank 0. That only breaks the rank rule if the parent
+ * was a leaf too, leaving the new node a 0-child. insert, emplace and
+ * try_emplace all come through here (see BinarySearchTree::insertItem).
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void WAVLTree<Key, Value, Compare, Alloc, NodeType>::linkNode(
+    Node<Key, Value>* slot, bool isLeft, Node<Key, Value>* node) {
+
+    this->noteLinked(slot, isLeft, node);
+    NodeType* parent = static_cast<NodeType*>(slot);
+    NodeType* child = static_cast<NodeType*>(node);
+    child->setParent(parent);
+
+    // If root empty, new node is the root
+    if (!parent) {
+        this->root_ = child;
+        return;
+    }
+
+    if (isLeft) {
+        parent->setLeft(child);
+    }
+    else {
+        parent->setRight(child);
+    }
+    NodeType::adjustAncestors(parent, 1);
+
+    if (parent->getRank() == 0) {
+        insertRebalance(child);
+    }
+}
+
+/*
+ * Repairs node being a 0-child of its parent. While the sibling is a
+ * 1-child, promoting the parent fixes it there and may move the problem
+ * up; once the sibling is a 2-child, one or two rotations end it.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void WAVLTree<Key, Value, Compare, Alloc, NodeType>::insertRebalance(NodeType* node) {
+    NodeType* parent = node->getParent();
+    while (parent && parent->getRank() == node->getRank()) {
+        bool isLeft = parent->getLeft() == node;
+        NodeType* sibling = isLeft ? parent->getRight() : parent->getLeft();
+        if (parent->getRank() - NodeType::rankOf(sibling) == 1) {
+            parent->updateRank(1);
+            node = parent;
+            parent = node->getParent();
+            continue;
+        }
+
+        // node is a 1,2 node here: the inner child decides between a
+        // single and a double rotation
+        NodeType* inner = isLeft ? node->getRight() : node->getLeft();
+        if (node->getRank() - NodeType::rankOf(inner) == 2) {
+            if (isLeft) {
+                rotateRight(parent);
+            }
+            else {
+                rotateLeft(parent);
+            }
+            parent->updateRank(-1);
+        }
+        else {
+            if (isLeft) {
+                rotateLeft(node);
+                rotateRight(parent);
+            }
+            else {
+                rotateRight(node);
+                rotateLeft(parent);
+            }
+            inner->updateRank(1);
+            node->updateRank(-1);
+            parent->updateRank(-1);
+        }
+        return;
+    }
+}
+
+/*
+ * As in AVLTree, a node with two children is first swapped with its
+ * predecessor.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void WAVLTree<Key, Value, Compare, Alloc, NodeType>::remove(const Key& key) {
+    if (!this->root_){
+        return;
+    }
+
+    NodeType* node = static_cast<NodeType*>(BinarySearchTree<Key, Value, Compare, Alloc>::internalFind(key));
+    if (node) {
+        removeNode(node);
+    }
+}
+
+/*
+ * Unlinks and frees node, which then has at most one child (a leaf) to
+ * take its place. Afterwards the replacement may be a 3-child of the
+ * parent, or the parent a leaf of rank 1; removeRebalance repairs either.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void WAVLTree<Key, Value, Compare, Alloc, NodeType>::removeNode(NodeType* node) {
+    this->noteUnlinking(node);
+    if (node->getLeft() && node->getRight()) {
+        nodeSwap(static_cast<NodeType*>(BinarySearchTree<Key, Value, Compare, Alloc>::predecessor(node)), node);
+    }
+
+    NodeType* parent = node->getParent();
+    NodeType* child = node->getLeft() ? node->getLeft() : node->getRight();
+
+    if (child) {
+        child->setParent(parent);
+    }
+    if (!parent) {
+        this->root_ = child;
+    }
+    else if (parent->getLeft() == node) {
+        parent->setLeft(child);
+    }
+    else {
+        parent->setRight(child);
+    }
+    destroyNode(node);
+    NodeType::adjustAncestors(parent, -1);
+
+    if (parent) {
+        removeRebalance(child, parent);
+    }
+}
+
+/*
+ * Repairs the subtree at node (possibly NULL), below parent, after it lost
+ * a rank. A parent left as a leaf of rank 1 is demoted first. Then, while
+ * node is a 3-child: a 2-child sibling, or a 1-child sibling whose children
+ * are both 2-children, is fixed by demotions that may move the problem up;
+ * otherwise one or two rotations end it.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void WAVLTree<Key, Value, Compare, Alloc, NodeType>::removeRebalance(NodeType* node, NodeType* parent) {
+    if (!parent->getLeft() && !parent->getRight() && parent->getRank() == 1) {
+        parent->setRank(0);
+        node = parent;
+        parent = node->getParent();
+    }
+
+    while (parent && parent->getRank() - NodeType::rankOf(node) == 3) {
+        // The sibling has rank at least 0 so is never NULL. When node is
+        // NULL the sibling is what tells the sides apart
+        bool isLeft = node ? parent->getLeft() == node : parent->getLeft() == nullptr;
+        NodeType* sibling = isLeft ? parent->getRight() : parent->getLeft();
+        if (parent->getRank() - sibling->getRank() == 2) {
+            parent->updateRank(-1);
+            node = parent;
+            parent = node->getParent();
+            continue;
+        }
+
+        NodeType* inner = isLeft ? sibling->getLeft() : sibling->getRight();
+        NodeType* outer = isLeft ? sibling->getRight() : sibling->getLeft();
+        if (sibling->getRank() - NodeType::rankOf(inner) == 2 &&
+            sibling->getRank() - NodeType::rankOf(outer) == 2) {
+            sibling->updateRank(-1);
+            parent->updateRank(-1);
+            node = parent;
+            parent = node->getParent();
+            continue;
+        }
+
+        if (sibling->getRank() - NodeType::rankOf(outer) == 1) {
+            if (isLeft) {
+                rotateLeft(parent);
+            }
+            else {
+                rotateRight(parent);
+            }
+            sibling->updateRank(1);
+            parent->updateRank(-1);
+            // A leaf must have rank 0, not 1
+            if (!parent->getLeft() && !parent->getRight()) {
+                parent->updateRank(-1);
+            }
+        }
+        else {
+            if (isLeft) {
+                rotateRight(sibling);
+                rotateLeft(parent);
+            }
+            else {
+                rotateLeft(sibling);
+                rotateRight(parent);
+            }
+            inner->updateRank(2);
+            sibling->updateRank(-1);
+            parent->updateRank(-2);
+        }
+        return;
+    }
+}
+
+/*
+ * Swaps positions, and with them the ranks, which belong to the position.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void WAVLTree<Key, Value, Compare, Alloc, NodeType>::nodeSwap(NodeType* n1, NodeType* n2) {
+    BinarySearchTree<Key, Value, Compare, Alloc>::nodeSwap(n1, n2);
+    int tempRank = n1->getRank();
+    n1->setRank(n2->getRank());
+    n2->setRank(tempRank);
+    n1->swapAugmentation(n2);
+}
+
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+Node<Key, Value>* WAVLTree<Key, Value, Compare, Alloc, NodeType>::createNode(
+    const ItemBuilder<Key, Value>& builder, Node<Key, Value>* parent)
+{
+    return allocateNode<NodeType>(wavlAlloc_, builder, static_cast<NodeType*>(parent));
+}
+
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void WAVLTree<Key, Value, Compare, Alloc, NodeType>::destroyNode(Node<Key, Value>* node)
+{
+    deallocateNode(wavlAlloc_, static_cast<NodeType*>(node));
+}
+
+/*
+ * Same as BinarySearchTree::releaseNodes, but against the WAVLNode allocator.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void WAVLTree<Key, Value, Compare, Alloc, NodeType>::releaseNodes()
+{
+    typedef AllocatorRelease<WAVLNodeAllocator> Release;
+    bool exclusive = Release::exclusive(wavlAlloc_);
+    if(!exclusive || !std::is_trivially_destructible<std::pair<const Key, Value> >::value) {
+        this->clearHelp(this->root_);
+    }
+    if(exclusive) {
+        Release::release(wavlAlloc_);
+    }
+}
+
+/*
+ * The rotations are AVLTree's (see avlRotateRight in avlbst.h); they only
+ * relink and call pullUp, so ranks are left to the caller.
+ */
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void WAVLTree<Key, Value, Compare, Alloc, NodeType>::rotateRight(NodeType* node) {
+    avlRotateRight(this->root_, node);
+}
+
+template<class Key, class Value, class Compare, class Alloc, class NodeType>
+void WAVLTree<Key, Value, Compare, Alloc, NodeType>::rotateLeft(NodeType* node) {
+    avlRotateLeft(this->root_, node);
+}
+
+/*
+  -------------------------------------------------
+  End implementations for the WAVLTree class.
+  -------------------------------------------------
+*/
+
+#endif